@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "spring_forces.hpp"
+#include "thread_pool.hpp"
+
+namespace simulation {
+    namespace benchmark {
+        namespace {
+            using Kernel = std::function<void(const primatives::SpringTable &, primatives::ParticleSystem &)>;
+
+            struct KernelResult {
+                double springs_per_second = 0.0;
+                float max_error = 0.f;
+            };
+
+            // Largest component difference between the forces of two particle states, relative to the force scale.
+            // Only the dynamic masses: the gather kernels leave the constrained tail alone
+            float max_relative_error(const primatives::ParticleSystem &result, const primatives::ParticleSystem &reference) {
+                float scale = 1e-6f, error = 0.f;
+                for (std::size_t i = 0; i < reference.dynamic_count(); ++i) {
+                    scale = std::max({scale, (float) std::abs(reference.fx[i]), (float) std::abs(reference.fy[i]),
+                                      (float) std::abs(reference.fz[i])});
+                    error = std::max({error, (float) std::abs(result.fx[i] - reference.fx[i]),
+                                      (float) std::abs(result.fy[i] - reference.fy[i]),
+                                      (float) std::abs(result.fz[i] - reference.fz[i])});
+                }
+                return error / scale;
+            }
+
+            KernelResult run(const Kernel &kernel, const primatives::SpringTable &springs,
+                             const primatives::ParticleSystem &particles, const primatives::ParticleSystem &reference) {
+                KernelResult result;
+                primatives::ParticleSystem state = particles;
+
+                // Accuracy on a single pass from zeroed forces
+                std::fill(state.fx.begin(), state.fx.end(), 0.f);
+                std::fill(state.fy.begin(), state.fy.end(), 0.f);
+                std::fill(state.fz.begin(), state.fz.end(), 0.f);
+                kernel(springs, state);
+                result.max_error = max_relative_error(state, reference);
+
+                // Throughput over enough repetitions to touch roughly 10M springs
+                std::size_t repetitions = std::max<std::size_t>(1, 10000000 / std::max<std::size_t>(1, springs.size()));
+                auto start = std::chrono::steady_clock::now();
+                for (std::size_t r = 0; r < repetitions; ++r) {
+                    kernel(springs, state);
+                }
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                result.springs_per_second = (double) (springs.size() * repetitions) / std::max(elapsed.count(), 1e-9);
+                return result;
+            }
+
+            // Largest distance between the positions of two particle states, infinite if either blew up
+            float max_position_error(const primatives::ParticleSystem &result, const primatives::ParticleSystem &reference) {
+                float error = 0.f;
+                for (std::size_t i = 0; i < reference.size(); ++i) {
+                    float d = glm::distance(result.position(i), reference.position(i));
+                    if (!std::isfinite(d)) return std::numeric_limits<float>::infinity();
+                    error = std::max(error, d);
+                }
+                return error;
+            }
+
+            // Steps particles for `steps` steps and returns the wall time in seconds
+            double integrate(integrators::Integrator scheme, primatives::ParticleSystem &particles,
+                             const integrators::ExplicitIntegrator::ForceFunction &compute_forces, float dt, int steps) {
+                integrators::ExplicitIntegrator integrator;
+                auto start = std::chrono::steady_clock::now();
+                for (int s = 0; s < steps; ++s) {
+                    integrator.step(scheme, particles, dt, compute_forces);
+                }
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                return elapsed.count();
+            }
+
+            // Copy of the state in another precision layout
+            template<typename Scalar, typename Accumulator>
+            primatives::BasicParticleSystem<Scalar, Accumulator> convert(const primatives::ParticleSystem &particles) {
+                using Copy = primatives::BasicParticleSystem<Scalar, Accumulator>;
+                Copy copy(particles.size());
+                primatives::FlagBits constrained;
+                constrained.resize(particles.size());
+                for (std::size_t i = 0; i < particles.size(); ++i) {
+                    copy.set_position(i, typename Copy::Vec3(particles.position(i)));
+                    copy.set_velocity(i, typename Copy::Vec3(particles.velocity(i)));
+                    copy.set_mass(i, (Scalar) particles.mass(i));
+                    constrained.set(i, particles.fixed(i));
+                }
+                copy.air_resistance_flags = particles.air_resistance_flags;
+                copy.partition(constrained); // already in order, only sets the dynamic range
+                return copy;
+            }
+
+            // Spring forces with the math in Scalar and the sums in Accumulator, like forces::kernel_scalar
+            template<typename Scalar, typename Accumulator>
+            void add_spring_forces(const primatives::SpringTable &springs,
+                                   primatives::BasicParticleSystem<Scalar, Accumulator> &particles) {
+                for (const primatives::Spring &spring: springs) {
+                    const std::uint32_t a = spring.mass_a, b = spring.mass_b;
+                    Scalar dx = particles.px[b] - particles.px[a];
+                    Scalar dy = particles.py[b] - particles.py[a];
+                    Scalar dz = particles.pz[b] - particles.pz[a];
+                    Scalar l2 = dx * dx + dy * dy + dz * dz;
+                    Scalar stretch = l2 > 0 ? spring.k_s * (1 - spring.rest_l / std::sqrt(l2)) : 0;
+                    Scalar f_x = stretch * dx - spring.k_d * (particles.vx[a] - particles.vx[b]);
+                    Scalar f_y = stretch * dy - spring.k_d * (particles.vy[a] - particles.vy[b]);
+                    Scalar f_z = stretch * dz - spring.k_d * (particles.vz[a] - particles.vz[b]);
+                    particles.fx[a] += f_x;
+                    particles.fy[a] += f_y;
+                    particles.fz[a] += f_z;
+                    particles.fx[b] -= f_x;
+                    particles.fy[b] -= f_y;
+                    particles.fz[b] -= f_z;
+                }
+            }
+
+            // Steps the layout and returns the wall time in seconds
+            template<typename Scalar, typename Accumulator>
+            double simulate(const primatives::SpringTable &springs,
+                            primatives::BasicParticleSystem<Scalar, Accumulator> &particles,
+                            const glm::vec3 &g, float c_d, float dt, int steps) {
+                auto start = std::chrono::steady_clock::now();
+                for (int s = 0; s < steps; ++s) {
+                    particles.apply_gravity(g);
+                    add_spring_forces(springs, particles);
+                    particles.apply_air_resistance(c_d);
+                    particles.integrate(dt);
+                }
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                return elapsed.count();
+            }
+
+            // Largest distance to the double run, infinite if either blew up
+            template<typename Scalar, typename Accumulator>
+            double max_deviation(const primatives::BasicParticleSystem<Scalar, Accumulator> &result,
+                                 const primatives::BasicParticleSystem<double, double> &reference) {
+                double error = 0.0;
+                for (std::size_t i = 0; i < reference.size(); ++i) {
+                    double d = glm::distance(glm::dvec3(result.position(i)), reference.position(i));
+                    if (!std::isfinite(d)) return std::numeric_limits<double>::infinity();
+                    error = std::max(error, d);
+                }
+                return error;
+            }
+        }
+
+        std::string spring_kernels(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles) {
+            if (springs.empty()) return "No springs to benchmark";
+
+            primatives::ParticleSystem reference = particles;
+            std::fill(reference.fx.begin(), reference.fx.end(), 0.f);
+            std::fill(reference.fy.begin(), reference.fy.end(), 0.f);
+            std::fill(reference.fz.begin(), reference.fz.end(), 0.f);
+            forces::accumulate_spring_forces_reference(springs, reference);
+
+            std::vector<std::pair<std::string, Kernel>> kernels = {
+                    {"force_a/force_b", forces::accumulate_spring_forces_reference}
+            };
+            for (forces::SimdLevel level: {forces::SimdLevel::Scalar, forces::SimdLevel::SSE2, forces::SimdLevel::AVX2}) {
+                if (!forces::simd_level_supported(level)) continue;
+                kernels.emplace_back(std::string("fused ") + forces::simd_level_name(level),
+                                     [level](const primatives::SpringTable &springs, primatives::ParticleSystem &particles) {
+                                         forces::accumulate_spring_forces(springs, particles, level);
+                                     });
+            }
+            auto gather = std::make_shared<forces::SpringForces>();
+            gather->build(springs, particles.size());
+            for (forces::Accumulation accumulation: {forces::Accumulation::GatherCached, forces::Accumulation::GatherRecompute}) {
+                kernels.emplace_back(std::string(forces::accumulation_name(accumulation)) + " x" +
+                                     std::to_string(threading::pool().size()),
+                                     [gather, accumulation](const primatives::SpringTable &springs,
+                                                            primatives::ParticleSystem &particles) {
+                                         gather->accumulate(springs, particles, accumulation);
+                                     });
+            }
+            if (springs.coloured() && threading::pool().size() > 1) {
+                kernels.emplace_back(std::string("fused ") + forces::simd_level_name(forces::best_simd_level()) + " x" +
+                                     std::to_string(threading::pool().size()),
+                                     [](const primatives::SpringTable &springs, primatives::ParticleSystem &particles) {
+                                         forces::accumulate_spring_forces(springs, particles);
+                                     });
+            }
+
+            std::string report;
+            char line[160];
+            std::snprintf(line, sizeof(line), "%zu springs (%zu colours), %zu masses\n",
+                          springs.size(), springs.colour_count(), particles.size());
+            report += line;
+            for (const auto &kernel: kernels) {
+                KernelResult result = run(kernel.second, springs, particles, reference);
+                std::snprintf(line, sizeof(line), "%-24s %8.1f Msprings/s  max rel. error %.1e\n",
+                              kernel.first.c_str(), result.springs_per_second * 1e-6, result.max_error);
+                report += line;
+            }
+            return report;
+        }
+
+        std::string explicit_integrators(primatives::ParticleSystem &particles,
+                                         const integrators::ExplicitIntegrator::ForceFunction &compute_forces,
+                                         float dt, float duration) {
+            using integrators::Integrator;
+            if (particles.size() == 0 || dt <= 0.f) return "Nothing to benchmark";
+            const primatives::ParticleSystem initial = particles;
+
+            // Whole steps at dt, rounded up to a multiple of 4 so every run ends at the same time
+            const int reference_subdivision = 8;
+            int base_steps = (std::max(1, (int) std::lround(duration / dt)) + 3) / 4 * 4;
+            int reference_steps = base_steps * reference_subdivision;
+            integrate(Integrator::RK4, particles, compute_forces, dt / reference_subdivision, reference_steps);
+            const primatives::ParticleSystem reference = particles;
+
+            std::string report;
+            char line[160];
+            std::snprintf(line, sizeof(line), "%zu masses, %.3f s simulated, reference RK4 at dt/%d\n",
+                          particles.size(), reference_steps * dt / reference_subdivision, reference_subdivision);
+            report += line;
+            for (Integrator scheme: {Integrator::SemiImplicitEuler, Integrator::VelocityVerlet, Integrator::RK2, Integrator::RK4}) {
+                for (int multiple: {1, 2, 4}) {
+                    int steps = base_steps / multiple;
+                    particles = initial;
+                    double seconds = integrate(scheme, particles, compute_forces, dt * multiple, steps);
+                    float error = max_position_error(particles, reference);
+                    char accuracy[32];
+                    if (std::isfinite(error)) {
+                        std::snprintf(accuracy, sizeof(accuracy), "max error %.1e", error);
+                    } else {
+                        std::snprintf(accuracy, sizeof(accuracy), "unstable");
+                    }
+                    std::snprintf(line, sizeof(line), "%-20s dt x%d %8.2f ms %6d force evals  %s\n",
+                                  integrators::integrator_name(scheme), multiple, seconds * 1e3,
+                                  steps * integrators::ExplicitIntegrator::force_evaluations(scheme), accuracy);
+                    report += line;
+                }
+            }
+            particles = initial;
+            return report;
+        }
+
+        std::string precision(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles,
+                              const glm::vec3 &g, float c_d, float dt, int steps) {
+            if (particles.size() == 0 || steps <= 0) return "Nothing to benchmark";
+
+            auto single = convert<float, float>(particles);
+            auto reference = convert<double, double>(particles);
+            auto mixed = convert<float, double>(particles);
+            double seconds[3] = {simulate(springs, single, g, c_d, dt, steps),
+                                 simulate(springs, reference, g, c_d, dt, steps),
+                                 simulate(springs, mixed, g, c_d, dt, steps)};
+            double deviation[3] = {max_deviation(single, reference), 0.0, max_deviation(mixed, reference)};
+
+            std::string report;
+            char line[160];
+            std::snprintf(line, sizeof(line), "%zu masses, %d steps of %.1e s, this build: %s\n",
+                          particles.size(), steps, dt, precision_name(build_precision));
+            report += line;
+            const Precision layouts[3] = {Precision::Single, Precision::Double, Precision::Mixed};
+            for (int k = 0; k < 3; ++k) {
+                char accuracy[40];
+                if (layouts[k] == Precision::Double) {
+                    std::snprintf(accuracy, sizeof(accuracy), "reference");
+                } else if (std::isfinite(deviation[k])) {
+                    std::snprintf(accuracy, sizeof(accuracy), "max deviation %.1e", deviation[k]);
+                } else {
+                    std::snprintf(accuracy, sizeof(accuracy), "unstable");
+                }
+                std::snprintf(line, sizeof(line), "%-36s %8.2f ms  %s\n",
+                              precision_name(layouts[k]), seconds[k] * 1e3, accuracy);
+                report += line;
+            }
+            return report;
+        }
+    } // namespace benchmark
+} // namespace simulation
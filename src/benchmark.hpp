@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+#include "explicit_integrator.hpp"
+#include "particle_system.hpp"
+#include "spring_table.hpp"
+
+namespace simulation {
+    namespace benchmark {
+        //Times every spring force kernel on a copy of the given state and returns a printable report
+        //(throughput and maximum deviation from the reference force_a()/force_b() path).
+        std::string spring_kernels(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles);
+
+        //Runs every explicit scheme for `duration` simulated seconds at dt, 2 dt and 4 dt from the current state
+        //and reports cost against accuracy (largest position deviation from RK4 at dt / 8).
+        //compute_forces must act on `particles`, which is restored to its initial state afterwards.
+        std::string explicit_integrators(primatives::ParticleSystem &particles,
+                                         const integrators::ExplicitIntegrator::ForceFunction &compute_forces,
+                                         float dt, float duration);
+
+        //Steps copies of the state for `steps` steps of gravity, springs, drag and semi-implicit Euler in every
+        //Precision layout (single-threaded scalar kernels, so the timings compare) and reports the cost and
+        //the largest position deviation from the double run.
+        std::string precision(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles,
+                              const glm::vec3 &g, float c_d, float dt, int steps);
+    } // namespace benchmark
+} // namespace simulation
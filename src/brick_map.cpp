@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include "brick_map.hpp"
+#include "bvh.hpp"
+#include "particle_system.hpp"
+#include "self_collision.hpp"
+#include "thread_pool.hpp"
+
+namespace simulation {
+    namespace collision {
+        namespace {
+            const char magic[8] = {'B', 'R', 'I', 'C', 'K', 'M', 'A', 'P'};
+            const std::uint32_t version = 1;
+
+            //Signed distance to a closed mesh: the distance to the nearest face, on the side given by the
+            //angle-weighted pseudonormal of the nearest feature (Baerentzen and Aanaes 2005)
+            class MeshDistance {
+            public:
+                explicit MeshDistance(const TriangleMesh &mesh) {
+                    faces.reserve(mesh.triangles.size());
+                    for (const glm::uvec3 &t: mesh.triangles) faces.push_back({t.x, t.y, t.z});
+                    primatives::ParticleSystem vertices;
+                    vertices.resize(mesh.vertices.size());
+                    for (std::size_t i = 0; i < mesh.vertices.size(); ++i) {
+                        vertices.set_position(i, primatives::ParticleSystem::Vec3(mesh.vertices[i]));
+                    }
+                    bvh.build(faces, vertices);
+
+                    std::vector<glm::uvec2> edges = mesh_edges(faces, &face_edges);
+                    face_normal.resize(faces.size());
+                    edge_normal.assign(edges.size(), glm::vec3(0.f));
+                    vertex_normal.assign(mesh.vertices.size(), glm::vec3(0.f));
+                    for (std::size_t f = 0; f < faces.size(); ++f) {
+                        const std::uint32_t corner[3] = {faces[f].mass_a, faces[f].mass_b, faces[f].mass_c};
+                        glm::vec3 p[3] = {mesh.vertices[corner[0]], mesh.vertices[corner[1]], mesh.vertices[corner[2]]};
+                        glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+                        float length = glm::length(n);
+                        face_normal[f] = length > 0.f ? n / length : glm::vec3(0.f); // degenerate faces add nothing
+                        for (int k = 0; k < 3; ++k) {
+                            edge_normal[face_edges[f][k]] += face_normal[f];
+                            glm::vec3 u = p[(k + 1) % 3] - p[k], v = p[(k + 2) % 3] - p[k];
+                            float angle = std::acos(glm::clamp(glm::dot(glm::normalize(u), glm::normalize(v)), -1.f, 1.f));
+                            if (std::isfinite(angle)) vertex_normal[corner[k]] += angle * face_normal[f];
+                        }
+                    }
+                }
+
+                // Unsigned distance to the mesh if it is within max_distance, else max_distance
+                float unsigned_distance(const glm::vec3 &p, float max_distance) const {
+                    return bvh.closest(p, max_distance).t;
+                }
+
+                float operator()(const glm::vec3 &p) const {
+                    BVH::Hit hit = bvh.closest(p, std::numeric_limits<float>::max());
+                    if (!hit) return std::numeric_limits<float>::max();
+                    const primatives::Face &f = faces[hit.face];
+                    const glm::vec3 &w = hit.barycentric;
+                    // Closest point on a corner, on an edge (ab, bc, ca) or inside the face
+                    glm::vec3 normal;
+                    if (w.y == 0.f && w.z == 0.f) normal = vertex_normal[f.mass_a];
+                    else if (w.x == 0.f && w.z == 0.f) normal = vertex_normal[f.mass_b];
+                    else if (w.x == 0.f && w.y == 0.f) normal = vertex_normal[f.mass_c];
+                    else if (w.z == 0.f) normal = edge_normal[face_edges[hit.face][0]];
+                    else if (w.x == 0.f) normal = edge_normal[face_edges[hit.face][1]];
+                    else if (w.y == 0.f) normal = edge_normal[face_edges[hit.face][2]];
+                    else normal = face_normal[hit.face];
+                    glm::vec3 q = w.x * bvh.position(f.mass_a) + w.y * bvh.position(f.mass_b) + w.z * bvh.position(f.mass_c);
+                    return glm::dot(p - q, normal) < 0.f ? -hit.t : hit.t;
+                }
+
+            private:
+                std::vector<primatives::Face> faces;
+                std::vector<glm::uvec3> face_edges;
+                std::vector<glm::vec3> face_normal, edge_normal, vertex_normal;
+                BVH bvh;
+            };
+
+            template<typename T>
+            void write(std::ofstream &out, const T &value) {
+                out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+            }
+
+            template<typename T>
+            void write(std::ofstream &out, const std::vector<T> &values) {
+                write(out, (std::uint64_t) values.size());
+                out.write(reinterpret_cast<const char *>(values.data()), (std::streamsize) (values.size() * sizeof(T)));
+            }
+
+            template<typename T>
+            bool read(std::ifstream &in, T &value) {
+                return (bool) in.read(reinterpret_cast<char *>(&value), sizeof(T));
+            }
+
+            template<typename T>
+            bool read(std::ifstream &in, std::vector<T> &values, std::uint64_t expected) {
+                std::uint64_t size;
+                if (!read(in, size) || size != expected) return false;
+                values.resize(size);
+                return (bool) in.read(reinterpret_cast<char *>(values.data()), (std::streamsize) (size * sizeof(T)));
+            }
+        }
+
+        BrickMap::BrickMap(const TriangleMesh &mesh, float cell, float band)
+                : cell(cell), band(band), source_hash(hash(mesh)) {
+            if (mesh.triangles.empty() || cell <= 0.f) return;
+            threading::ThreadPool &pool = threading::pool();
+            MeshDistance distance(mesh);
+
+            //Mesh bounds grown by the band and a cell, in whole bricks
+            Box mesh_box{mesh.vertices[0], mesh.vertices[0]};
+            for (const glm::vec3 &v: mesh.vertices) mesh_box = merge(mesh_box, {v, v});
+            const float brick = cell * (float) brick_cells;
+            const glm::vec3 margin(band + cell);
+            box.min = mesh_box.min - margin;
+            bricks = glm::max(glm::ivec3(glm::ceil((mesh_box.max + margin - box.min) / brick)), glm::ivec3(1));
+            box.max = box.min + glm::vec3(bricks) * brick;
+
+            //Coarse samples on the brick corners, everywhere
+            const glm::ivec3 corners = bricks + 1;
+            coarse.resize((std::size_t) corners.x * corners.y * corners.z);
+            pool.parallel_for(0, (std::size_t) corners.z, 1, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t z = begin; z < end; ++z) {
+                    for (int y = 0; y < corners.y; ++y) {
+                        for (int x = 0; x < corners.x; ++x) {
+                            coarse[(z * corners.y + y) * corners.x + x] = distance(box.min + glm::vec3(x, y, z) * brick);
+                        }
+                    }
+                }
+            });
+
+            //Bricks that may hold a point within the band: centre within the band plus half a diagonal
+            brick_of.assign((std::size_t) bricks.x * bricks.y * bricks.z, empty);
+            const float reach = band + 0.5f * std::sqrt(3.f) * brick;
+            pool.parallel_for(0, brick_of.size(), 16, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t b = begin; b < end; ++b) {
+                    glm::ivec3 at((int) (b % bricks.x), (int) (b / bricks.x % bricks.y), (int) (b / bricks.x / bricks.y));
+                    glm::vec3 centre = box.min + (glm::vec3(at) + 0.5f) * brick;
+                    if (distance.unsigned_distance(centre, reach) < reach) brick_of[b] = 0;
+                }
+            });
+            std::int32_t stored = 0;
+            for (std::int32_t &slot: brick_of) {
+                if (slot != empty) slot = stored++;
+            }
+
+            //Fine samples of the stored bricks, each brick in parallel
+            const int side = brick_cells + 1;
+            samples.resize((std::size_t) stored * brick_samples);
+            pool.parallel_for(0, brick_of.size(), 4, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t b = begin; b < end; ++b) {
+                    if (brick_of[b] == empty) continue;
+                    glm::ivec3 at((int) (b % bricks.x), (int) (b / bricks.x % bricks.y), (int) (b / bricks.x / bricks.y));
+                    glm::vec3 origin = box.min + glm::vec3(at) * brick;
+                    float *values = &samples[(std::size_t) brick_of[b] * brick_samples];
+                    for (int z = 0; z < side; ++z) {
+                        for (int y = 0; y < side; ++y) {
+                            for (int x = 0; x < side; ++x) {
+                                values[(z * side + y) * side + x] = distance(origin + glm::vec3(x, y, z) * cell);
+                            }
+                        }
+                    }
+                }
+            });
+        }
+
+        float BrickMap::distance(const glm::vec3 &p, glm::vec3 &gradient) const {
+            if (coarse.empty()) {
+                gradient = glm::vec3(0.f, 1.f, 0.f);
+                return std::numeric_limits<float>::max();
+            }
+            glm::vec3 clamped = glm::clamp(p, box.min, box.max);
+            glm::vec3 g = (clamped - box.min) / cell;
+            glm::ivec3 i = glm::min(glm::ivec3(g), bricks * brick_cells - 1);
+            glm::ivec3 b = i / brick_cells;
+
+            float corners[8], value;
+            const std::int32_t slot = brick_of[brick_index(b)];
+            if (slot != empty) {
+                const int side = brick_cells + 1;
+                const glm::ivec3 l = i - b * brick_cells;
+                const float *values = &samples[(std::size_t) slot * brick_samples];
+                for (int k = 0; k < 8; ++k) {
+                    corners[k] = values[((l.z + (k >> 2)) * side + l.y + ((k >> 1) & 1)) * side + l.x + (k & 1)];
+                }
+                value = trilinear(corners, g - glm::vec3(i), gradient);
+                gradient /= cell;
+            } else {
+                for (int k = 0; k < 8; ++k) corners[k] = coarse_at(b.x + (k & 1), b.y + ((k >> 1) & 1), b.z + (k >> 2));
+                value = trilinear(corners, g / (float) brick_cells - glm::vec3(b), gradient);
+                gradient /= cell * (float) brick_cells;
+            }
+
+            glm::vec3 outside = p - clamped;
+            if (glm::dot(outside, outside) > 0.f) {
+                float d = glm::length(outside);
+                gradient = outside / d;
+                return value + d;
+            }
+            return value;
+        }
+
+        std::size_t BrickMap::memory() const {
+            return coarse.size() * sizeof(float) + brick_of.size() * sizeof(std::int32_t) + samples.size() * sizeof(float);
+        }
+
+        bool BrickMap::save(const std::string &path) const {
+            std::ofstream out(path, std::ios::binary);
+            if (!out) return false;
+            out.write(magic, sizeof(magic));
+            write(out, version);
+            write(out, (std::int32_t) brick_cells);
+            write(out, source_hash);
+            write(out, cell);
+            write(out, band);
+            write(out, box.min);
+            write(out, box.max);
+            write(out, bricks);
+            write(out, coarse);
+            write(out, brick_of);
+            write(out, samples);
+            out.close(); // flushed here, so a full disk shows up too
+            return !out.fail();
+        }
+
+        bool BrickMap::load(const std::string &path) {
+            std::ifstream in(path, std::ios::binary);
+            char file_magic[sizeof(magic)];
+            std::uint32_t file_version;
+            std::int32_t file_brick_cells;
+            if (!in || !in.read(file_magic, sizeof(file_magic)) || std::memcmp(file_magic, magic, sizeof(magic)) != 0) return false;
+            if (!read(in, file_version) || file_version != version) return false;
+            if (!read(in, file_brick_cells) || file_brick_cells != brick_cells) return false;
+
+            BrickMap map;
+            if (!read(in, map.source_hash) || !read(in, map.cell) || !read(in, map.band) || !read(in, map.box.min) ||
+                !read(in, map.box.max) || !read(in, map.bricks)) {
+                return false;
+            }
+            if (glm::any(glm::lessThan(map.bricks, glm::ivec3(1))) || !(map.cell > 0.f)) return false;
+            const glm::ivec3 corners = map.bricks + 1;
+            if (!read(in, map.coarse, (std::uint64_t) corners.x * corners.y * corners.z)) return false;
+            if (!read(in, map.brick_of, (std::uint64_t) map.bricks.x * map.bricks.y * map.bricks.z)) return false;
+            const std::int64_t stored = std::count_if(map.brick_of.begin(), map.brick_of.end(),
+                                                      [](std::int32_t slot) { return slot != empty; });
+            if (!read(in, map.samples, (std::uint64_t) stored * brick_samples)) return false;
+            if (std::any_of(map.brick_of.begin(), map.brick_of.end(),
+                            [&](std::int32_t slot) { return slot < empty || slot >= stored; })) {
+                return false;
+            }
+            *this = std::move(map);
+            return true;
+        }
+
+        std::uint64_t BrickMap::hash(const TriangleMesh &mesh) {
+            // FNV-1a
+            std::uint64_t h = 14695981039346656037ull;
+            auto add = [&](const void *data, std::size_t size) {
+                const unsigned char *bytes = static_cast<const unsigned char *>(data);
+                for (std::size_t k = 0; k < size; ++k) h = (h ^ bytes[k]) * 1099511628211ull;
+            };
+            add(mesh.vertices.data(), mesh.vertices.size() * sizeof(glm::vec3));
+            add(mesh.triangles.data(), mesh.triangles.size() * sizeof(glm::uvec3));
+            return h;
+        }
+
+        std::shared_ptr<const BrickMap> cached_brick_map(const TriangleMesh &mesh, float cell, float band,
+                                                         const std::string &cache_path, bool *baked, bool *saved) {
+            auto map = std::make_shared<BrickMap>();
+            bool valid = map->load(cache_path) && map->mesh_hash() == BrickMap::hash(mesh) && map->cell_size() == cell &&
+                         map->band_width() == band;
+            bool written = valid;
+            if (!valid) {
+                map = std::make_shared<BrickMap>(mesh, cell, band);
+                written = map->save(cache_path);
+            }
+            if (baked) *baked = !valid;
+            if (saved) *saved = written;
+            return map;
+        }
+    } // namespace collision
+} // namespace simulation
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "proximity.hpp"
+
+namespace simulation {
+    namespace collision {
+        //Indexed triangle mesh, counter-clockwise faces seen from outside
+        struct TriangleMesh {
+            std::vector<glm::vec3> vertices;
+            std::vector<glm::uvec3> triangles;
+        };
+
+        //Signed distance field of a closed triangle mesh, baked sparsely into a brick map.
+        //Space is split into bricks of brick_cells^3 cells. Only the bricks within `band` of the surface store
+        //samples, (brick_cells + 1)^3 of them `cell` apart, so a lookup reads a single brick. Every other point
+        //falls back to a coarse grid with one sample per brick corner, which keeps the sign and a rough distance
+        //for masses far from the surface. Either way a lookup is one trilinear interpolation, whatever the
+        //mesh's triangle count.
+        //Baking finds the nearest face of each sample through a BVH over the mesh. The sign comes from the
+        //angle-weighted pseudonormal of the nearest feature (face, edge or vertex), so the mesh has to be closed
+        //and consistently oriented.
+        class BrickMap {
+        public:
+            static constexpr int brick_cells = 8;
+
+            BrickMap() = default;
+            BrickMap(const TriangleMesh &mesh, float cell, float band);
+
+            // Distance at p and its gradient. Outside the baked bounds, the distance from them plus the value at
+            // the nearest point inside
+            float distance(const glm::vec3 &p, glm::vec3 &gradient) const;
+
+            const Box &bounds() const { return box; }
+            float cell_size() const { return cell; }
+            float band_width() const { return band; }
+            std::size_t brick_count() const { return samples.size() / brick_samples; }
+            std::size_t total_bricks() const { return brick_of.size(); }
+            std::size_t memory() const; // bytes
+            std::uint64_t mesh_hash() const { return source_hash; }
+
+            // Binary cache; load() returns false (and leaves the map untouched) if the file is missing or corrupt
+            bool save(const std::string &path) const;
+            bool load(const std::string &path);
+
+            // Of the vertex and triangle data, to tell whether a cached map was baked from a mesh
+            static std::uint64_t hash(const TriangleMesh &mesh);
+
+        private:
+            static constexpr std::size_t brick_samples = (brick_cells + 1) * (brick_cells + 1) * (brick_cells + 1);
+            static constexpr std::int32_t empty = -1;
+
+            std::size_t brick_index(const glm::ivec3 &b) const { return ((std::size_t) b.z * bricks.y + b.y) * bricks.x + b.x; }
+            float coarse_at(int x, int y, int z) const {
+                return coarse[((std::size_t) z * (bricks.y + 1) + y) * (bricks.x + 1) + x];
+            }
+
+            Box box;
+            float cell = 1.f, band = 0.f;
+            glm::ivec3 bricks{0};
+            std::vector<float> coarse;          // per brick corner
+            std::vector<std::int32_t> brick_of; // per brick, its slot in samples or empty
+            std::vector<float> samples;         // brick_samples per stored brick, x fastest
+            std::uint64_t source_hash = 0;
+        };
+
+        // The brick map of mesh from cache_path if it was baked there from the same mesh and settings, else bakes it
+        // and writes it there. baked, if given, tells which happened, and saved whether the cache file now holds
+        // the map (false if a baked map could not be written)
+        std::shared_ptr<const BrickMap> cached_brick_map(const TriangleMesh &mesh, float cell, float band,
+                                                         const std::string &cache_path, bool *baked = nullptr,
+                                                         bool *saved = nullptr);
+    } // namespace collision
+} // namespace simulation
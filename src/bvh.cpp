@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include "bvh.hpp"
+#include "thread_pool.hpp"
+
+namespace simulation {
+    namespace collision {
+        namespace {
+            const std::size_t grain = 256;
+            const int bin_count = 12;
+
+            const Box empty_box{glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max())};
+
+            // Range of order[] that becomes node
+            struct Range {
+                std::uint32_t node, begin, end;
+            };
+        }
+
+        void BVH::build(const std::vector<primatives::Face> &faces, const primatives::ParticleSystem &particles) {
+            this->faces = faces;
+            positions.resize(particles.size());
+            for (std::size_t i = 0; i < particles.size(); ++i) positions[i] = glm::vec3(particles.position(i));
+            swept_from.clear();
+            rebuild();
+            rebuilds = 0;
+        }
+
+        void BVH::rebuild() {
+            rebuilds++;
+            nodes.clear();
+            level_start.clear();
+            order.resize(faces.size());
+            std::iota(order.begin(), order.end(), 0u);
+            cost = built_cost = 0.f;
+            if (faces.empty()) return;
+
+            std::vector<Box> boxes(faces.size());
+            std::vector<glm::vec3> centroids(faces.size());
+            threading::pool().parallel_for(0, faces.size(), 1024, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t f = begin; f < end; ++f) {
+                    boxes[f] = face_box((std::uint32_t) f);
+                    centroids[f] = 0.5f * (boxes[f].min + boxes[f].max);
+                }
+            });
+
+            // Median of the centroids along axis, for degenerate ranges and below sah_depth
+            auto median_split = [&](std::uint32_t begin, std::uint32_t end, int axis) {
+                std::uint32_t mid = begin + (end - begin) / 2;
+                std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                                 [&](std::uint32_t a, std::uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+                return mid;
+            };
+            // Binned SAH along the longest axis of the centroids
+            auto sah_split = [&](std::uint32_t begin, std::uint32_t end, std::size_t depth) {
+                Box bounds = empty_box;
+                for (std::uint32_t k = begin; k < end; ++k) bounds = merge(bounds, {centroids[order[k]], centroids[order[k]]});
+                glm::vec3 extent = bounds.max - bounds.min;
+                int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+                if (extent[axis] <= 0.f) return begin + (end - begin) / 2; // all centroids in one point
+                if (depth >= sah_depth) return median_split(begin, end, axis);
+
+                auto bin_of = [&](std::uint32_t face) {
+                    int bin = (int) ((centroids[face][axis] - bounds.min[axis]) / extent[axis] * bin_count);
+                    return std::min(bin, bin_count - 1);
+                };
+                Box bin_box[bin_count];
+                std::uint32_t bin_size[bin_count] = {};
+                std::fill(bin_box, bin_box + bin_count, empty_box);
+                for (std::uint32_t k = begin; k < end; ++k) {
+                    int bin = bin_of(order[k]);
+                    bin_box[bin] = merge(bin_box[bin], boxes[order[k]]);
+                    bin_size[bin]++;
+                }
+
+                // Cost of splitting after each bin, left sweep then right sweep
+                float left_cost[bin_count - 1];
+                Box left = empty_box;
+                std::uint32_t left_size = 0;
+                for (int b = 0; b < bin_count - 1; ++b) {
+                    left = merge(left, bin_box[b]);
+                    left_size += bin_size[b];
+                    left_cost[b] = surface_area(left) * (float) left_size;
+                }
+                Box right = empty_box;
+                std::uint32_t right_size = 0;
+                float best_cost = std::numeric_limits<float>::max();
+                int best = -1;
+                for (int b = bin_count - 1; b > 0; --b) {
+                    right = merge(right, bin_box[b]);
+                    right_size += bin_size[b];
+                    float split_cost = left_cost[b - 1] + surface_area(right) * (float) right_size;
+                    if (right_size < end - begin && right_size > 0 && split_cost < best_cost) {
+                        best_cost = split_cost;
+                        best = b;
+                    }
+                }
+                if (best < 0) return median_split(begin, end, axis);
+                auto middle = std::partition(order.begin() + begin, order.begin() + end,
+                                             [&](std::uint32_t face) { return bin_of(face) < best; });
+                return (std::uint32_t) (middle - order.begin());
+            };
+
+            //Top-down, one level at a time, so every level is appended as one contiguous node range
+            nodes.emplace_back();
+            std::vector<Range> level = {{0, 0, (std::uint32_t) faces.size()}}, next;
+            for (std::size_t depth = 0; !level.empty(); ++depth) {
+                level_start.push_back(level.front().node);
+                next.clear();
+                for (const Range &range: level) {
+                    Box box = empty_box;
+                    for (std::uint32_t k = range.begin; k < range.end; ++k) box = merge(box, boxes[order[k]]);
+                    nodes[range.node].box = box;
+                    if (range.end - range.begin <= max_leaf_size) {
+                        nodes[range.node].first = range.begin;
+                        nodes[range.node].count = range.end - range.begin;
+                        continue;
+                    }
+                    std::uint32_t mid = sah_split(range.begin, range.end, depth);
+                    std::uint32_t child = (std::uint32_t) nodes.size();
+                    nodes[range.node].first = child;
+                    nodes[range.node].count = 0;
+                    nodes.emplace_back();
+                    nodes.emplace_back();
+                    next.push_back({child, range.begin, mid});
+                    next.push_back({child + 1, mid, range.end});
+                }
+                std::swap(level, next);
+            }
+            level_start.push_back((std::uint32_t) nodes.size());
+            cost = built_cost = sah_cost();
+        }
+
+        void BVH::refit(const primatives::ParticleSystem &particles) {
+            threading::ThreadPool &pool = threading::pool();
+            positions.resize(particles.size());
+            pool.parallel_for(0, particles.size(), 1024, [this, &particles](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i) positions[i] = glm::vec3(particles.position(i));
+            });
+            swept_from.clear();
+            refit_nodes();
+        }
+
+        void BVH::refit(const std::vector<glm::vec3> &from, const std::vector<glm::vec3> &to) {
+            positions = to;
+            swept_from = from;
+            refit_nodes();
+        }
+
+        void BVH::refit_nodes() {
+            threading::ThreadPool &pool = threading::pool();
+            //Children live one level below their parent, so deepest level first
+            for (std::size_t level = level_start.size() - 1; level-- > 0;) {
+                pool.parallel_for(level_start[level], level_start[level + 1], grain, [this](std::size_t begin, std::size_t end) {
+                    for (std::size_t n = begin; n < end; ++n) {
+                        Node &node = nodes[n];
+                        if (node.count == 0) {
+                            node.box = merge(nodes[node.first].box, nodes[node.first + 1].box);
+                            continue;
+                        }
+                        node.box = face_box(order[node.first]);
+                        for (std::uint32_t k = node.first + 1; k < node.first + node.count; ++k) {
+                            node.box = merge(node.box, face_box(order[k]));
+                        }
+                    }
+                });
+            }
+            cost = sah_cost();
+        }
+
+        bool BVH::update(const primatives::ParticleSystem &particles) {
+            if (nodes.empty()) return false;
+            refit(particles);
+            if (quality() <= rebuild_ratio) return false;
+            rebuild();
+            return true;
+        }
+
+        float BVH::sah_cost() const {
+            // Traversal and face tests weigh the same; areas relative to the root's
+            float root = surface_area(nodes[0].box);
+            if (root <= 0.f) return 0.f;
+            float sum = 0.f;
+            for (const Node &node: nodes) {
+                sum += surface_area(node.box) * (node.count == 0 ? 1.f : (float) node.count);
+            }
+            return sum / root;
+        }
+
+        BVH::Hit BVH::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float max_t) const {
+            Hit hit;
+            hit.t = max_t;
+            const glm::vec3 inv_direction = 1.f / direction;
+            // Slab test against the nearest hit so far
+            auto enter = [&](const Box &box) {
+                glm::vec3 t0 = (box.min - origin) * inv_direction, t1 = (box.max - origin) * inv_direction;
+                glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+                float t_near = std::max(std::max(near.x, near.y), std::max(near.z, 0.f));
+                float t_far = std::min(std::min(far.x, far.y), std::min(far.z, hit.t));
+                return t_near <= t_far;
+            };
+            traverse(enter, [&](std::uint32_t face) {
+                const primatives::Face &f = faces[face];
+                glm::vec3 barycentric;
+                float t = intersect_triangle(origin, direction, positions[f.mass_a], positions[f.mass_b], positions[f.mass_c],
+                                             barycentric);
+                if (t < 0.f || t > hit.t) return;
+                hit.face = face;
+                hit.t = t;
+                hit.barycentric = barycentric;
+            });
+            return hit;
+        }
+
+        BVH::Hit BVH::closest(const glm::vec3 &p, float max_distance) const {
+            Hit hit;
+            float best = max_distance * max_distance;
+            // Nodes nearer than the nearest face so far
+            auto enter = [&](const Box &box) {
+                glm::vec3 d = glm::max(glm::max(box.min - p, p - box.max), glm::vec3(0.f));
+                return glm::dot(d, d) <= best;
+            };
+            traverse(enter, [&](std::uint32_t face) {
+                const primatives::Face &f = faces[face];
+                const glm::vec3 &a = positions[f.mass_a], &b = positions[f.mass_b], &c = positions[f.mass_c];
+                glm::vec3 w = closest_on_triangle(p, a, b, c);
+                glm::vec3 d = p - (w.x * a + w.y * b + w.z * c);
+                float distance2 = glm::dot(d, d);
+                if (distance2 > best || (distance2 == best && hit)) return;
+                best = distance2;
+                hit.face = face;
+                hit.barycentric = w;
+            });
+            hit.t = hit ? std::sqrt(best) : max_distance;
+            return hit;
+        }
+    } // namespace collision
+} // namespace simulation
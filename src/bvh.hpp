@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "particle_system.hpp"
+#include "proximity.hpp"
+#include "spring_table.hpp"
+
+namespace simulation {
+    namespace collision {
+        //Bounding volume hierarchy of boxes over the faces of a deforming mesh (the jelly's surface, the cloth).
+        //The tree is built once with binned SAH splits and its node boxes are then refitted to the moving vertices
+        //every step: bottom-up, one tree level at a time, each level in parallel. Refitting keeps the topology, so
+        //the tree loosens as the mesh deforms; once its SAH cost has grown `rebuild_ratio` times the cost it was
+        //built with, update() rebuilds it from scratch.
+        //Nodes are stored breadth first, so each level is a contiguous range and the children of a node are adjacent.
+        class BVH {
+        public:
+            static constexpr std::uint32_t none = ~0u;
+
+            struct Hit {
+                std::uint32_t face = none;
+                float t = 0.f;           // along the ray direction, or the distance for closest()
+                glm::vec3 barycentric{0.f}; // weights of the face's mass_a, mass_b and mass_c
+
+                explicit operator bool() const { return face != none; }
+            };
+
+            void build(const std::vector<primatives::Face> &faces, const primatives::ParticleSystem &particles);
+            // Refits to the current positions and rebuilds if the tree has degraded; returns true if it rebuilt
+            bool update(const primatives::ParticleSystem &particles);
+            void refit(const primatives::ParticleSystem &particles);
+            // Refits to the faces swept from the positions `from` to `to` (per mass), for continuous collision
+            // queries over a step; the next refit to particles goes back to static boxes
+            void refit(const std::vector<glm::vec3> &from, const std::vector<glm::vec3> &to);
+            void rebuild();
+
+            // Nearest face hit by origin + t * direction for t in [0, max_t]
+            Hit raycast(const glm::vec3 &origin, const glm::vec3 &direction, float max_t) const;
+            // Nearest point of the mesh to p that is at most max_distance away
+            Hit closest(const glm::vec3 &p, float max_distance) const;
+
+            // Calls fn(face) for every face whose box overlaps box
+            template<typename Fn>
+            void query(const Box &box, Fn &&fn) const {
+                traverse([&](const Box &node) { return overlaps(node, box); }, [&](std::uint32_t face) {
+                    if (overlaps(face_box(face), box)) fn(face);
+                });
+            }
+
+            // Calls fn(face, barycentric, distance) for every face within radius of center, with its closest point
+            template<typename Fn>
+            void query_sphere(const glm::vec3 &center, float radius, Fn &&fn) const {
+                const Box box{center - radius, center + radius};
+                traverse([&](const Box &node) { return overlaps(node, box); }, [&](std::uint32_t face) {
+                    const primatives::Face &f = faces[face];
+                    const glm::vec3 &a = positions[f.mass_a], &b = positions[f.mass_b], &c = positions[f.mass_c];
+                    glm::vec3 w = closest_on_triangle(center, a, b, c);
+                    float distance = glm::length(center - (w.x * a + w.y * b + w.z * c));
+                    if (distance <= radius) fn(face, w, distance);
+                });
+            }
+
+            Box face_box(std::uint32_t face) const {
+                const primatives::Face &f = faces[face];
+                const glm::vec3 &a = positions[f.mass_a], &b = positions[f.mass_b], &c = positions[f.mass_c];
+                Box box{glm::min(glm::min(a, b), c), glm::max(glm::max(a, b), c)};
+                if (swept_from.empty()) return box;
+                const glm::vec3 &a0 = swept_from[f.mass_a], &b0 = swept_from[f.mass_b], &c0 = swept_from[f.mass_c];
+                return merge(box, {glm::min(glm::min(a0, b0), c0), glm::max(glm::max(a0, b0), c0)});
+            }
+            // Vertex positions at the last refit (the end of the sweep after a swept refit)
+            const glm::vec3 &position(std::size_t mass) const { return positions[mass]; }
+            const std::vector<primatives::Face> &mesh() const { return faces; }
+
+            bool empty() const { return nodes.empty(); }
+            std::size_t node_count() const { return nodes.size(); }
+            std::size_t rebuild_count() const { return rebuilds; }
+            // SAH cost of the refitted tree relative to the cost it was built with (1 right after a build)
+            float quality() const { return built_cost > 0.f ? cost / built_cost : 1.f; }
+
+            float rebuild_ratio = 1.5f;
+            static constexpr std::uint32_t max_leaf_size = 4;
+
+        private:
+            //Leaf: faces order[first, first + count). Inner node (count == 0): children first and first + 1
+            struct Node {
+                Box box;
+                std::uint32_t first = 0, count = 0;
+            };
+
+            // Depth-first over the nodes for which enter(box) holds, calling leaf(face) on the faces of their leaves
+            template<typename Enter, typename Leaf>
+            void traverse(Enter &&enter, Leaf &&leaf) const {
+                if (nodes.empty()) return;
+                std::uint32_t stack[max_depth + 2];
+                std::size_t top = 0;
+                stack[top++] = 0;
+                while (top > 0) {
+                    const Node &node = nodes[stack[--top]];
+                    if (!enter(node.box)) continue;
+                    if (node.count == 0) {
+                        stack[top++] = node.first + 1;
+                        stack[top++] = node.first;
+                        continue;
+                    }
+                    for (std::uint32_t k = node.first; k < node.first + node.count; ++k) leaf(order[k]);
+                }
+            }
+
+            void refit_nodes();
+            float sah_cost() const;
+
+            // Splits are SAH down to this depth, median splits below it, so the traversal stack is bounded
+            static constexpr std::size_t sah_depth = 32;
+            static constexpr std::size_t max_depth = 64;
+
+            std::vector<primatives::Face> faces;
+            std::vector<glm::vec3> positions; // per mass, at the last refit
+            std::vector<glm::vec3> swept_from; // per mass, start of the sweep while refitted to swept boxes
+            std::vector<Node> nodes;
+            std::vector<std::uint32_t> order;       // face indices, each leaf's faces contiguous
+            std::vector<std::uint32_t> level_start; // per tree level + 1, node ranges
+            float cost = 0.f, built_cost = 0.f;
+            std::size_t rebuilds = 0;
+        };
+    } // namespace collision
+} // namespace simulation
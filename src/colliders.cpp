@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "colliders.hpp"
+#include "thread_pool.hpp"
+
+namespace simulation {
+    namespace collision {
+        namespace {
+            // Unit vector perpendicular to v, for normals of points exactly on a centre or axis
+            glm::vec3 any_perpendicular(const glm::vec3 &v) {
+                glm::vec3 axis = std::abs(v.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+                glm::vec3 p = glm::cross(v, axis);
+                return glm::dot(p, p) > 0.f ? glm::normalize(p) : glm::vec3(0.f, 1.f, 0.f);
+            }
+        }
+
+        //////////////////////////////////////////////////
+        ////                 SdfGrid                  ////
+        //////////////////////////////////////////////////
+
+        SdfGrid::SdfGrid(const Box &bounds, float cell, const std::function<float(const glm::vec3 &)> &distance)
+                : box(bounds), cell(cell) {
+            dims = glm::max(glm::ivec3(glm::ceil((bounds.max - bounds.min) / cell)) + 1, glm::ivec3(2));
+            box.max = box.min + glm::vec3(dims - 1) * cell;
+            values.resize((std::size_t) dims.x * dims.y * dims.z);
+            threading::pool().parallel_for(0, (std::size_t) dims.z, 1, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t z = begin; z < end; ++z) {
+                    for (int y = 0; y < dims.y; ++y) {
+                        for (int x = 0; x < dims.x; ++x) {
+                            values[(z * dims.y + y) * dims.x + x] = distance(box.min + glm::vec3(x, y, z) * cell);
+                        }
+                    }
+                }
+            });
+        }
+
+        float SdfGrid::distance(const glm::vec3 &p, glm::vec3 &gradient) const {
+            glm::vec3 clamped = glm::clamp(p, box.min, box.max);
+            glm::vec3 g = (clamped - box.min) / cell;
+            glm::ivec3 i = glm::min(glm::ivec3(g), dims - 2);
+            glm::vec3 f = g - glm::vec3(i);
+
+            float corners[8];
+            for (int k = 0; k < 8; ++k) corners[k] = at(i.x + (k & 1), i.y + ((k >> 1) & 1), i.z + (k >> 2));
+            float value = trilinear(corners, f, gradient);
+            gradient /= cell;
+
+            glm::vec3 outside = p - clamped;
+            if (glm::dot(outside, outside) > 0.f) {
+                float d = glm::length(outside);
+                gradient = outside / d;
+                return value + d;
+            }
+            return value;
+        }
+
+        //////////////////////////////////////////////////
+        ////                 Collider                 ////
+        //////////////////////////////////////////////////
+
+        const char *shape_name(Shape shape) {
+            switch (shape) {
+            case Shape::Plane:
+                return "Plane";
+            case Shape::Sphere:
+                return "Sphere";
+            case Shape::Capsule:
+                return "Capsule";
+            case Shape::Box:
+                return "Box";
+            case Shape::SdfGrid:
+                return "SDF Grid";
+            case Shape::BrickMap:
+                return "Brick Map";
+            }
+            return "";
+        }
+
+        Collider Collider::plane(const glm::vec3 &normal, float offset) {
+            Collider c;
+            c.shape = Shape::Plane;
+            c.a = glm::normalize(normal);
+            c.radius = offset;
+            return c;
+        }
+
+        Collider Collider::sphere(const glm::vec3 &center, float radius) {
+            Collider c;
+            c.shape = Shape::Sphere;
+            c.a = center;
+            c.radius = radius;
+            return c;
+        }
+
+        Collider Collider::capsule(const glm::vec3 &start, const glm::vec3 &end, float radius) {
+            Collider c;
+            c.shape = Shape::Capsule;
+            c.a = start;
+            c.b = end;
+            c.radius = radius;
+            return c;
+        }
+
+        Collider Collider::box(const glm::vec3 &center, const glm::vec3 &half_extents, const glm::mat3 &rotation) {
+            Collider c;
+            c.shape = Shape::Box;
+            c.a = center;
+            c.b = half_extents;
+            c.rotation = rotation;
+            return c;
+        }
+
+        Collider Collider::sdf_grid(std::shared_ptr<const SdfGrid> sdf) {
+            Collider c;
+            c.shape = Shape::SdfGrid;
+            c.sdf = std::move(sdf);
+            return c;
+        }
+
+        Collider Collider::brick_map(std::shared_ptr<const BrickMap> bricks, const glm::vec3 &position,
+                                     const glm::mat3 &rotation, float skin) {
+            Collider c;
+            c.shape = Shape::BrickMap;
+            c.bricks = std::move(bricks);
+            c.a = position;
+            c.rotation = rotation;
+            c.radius = skin;
+            return c;
+        }
+
+        float Collider::distance(const glm::vec3 &p, glm::vec3 &normal) const {
+            switch (shape) {
+            case Shape::Plane:
+                normal = a;
+                return glm::dot(a, p) - radius;
+            case Shape::Sphere: {
+                glm::vec3 d = p - a;
+                float length = glm::length(d);
+                normal = length > 0.f ? d / length : glm::vec3(0.f, 1.f, 0.f);
+                return length - radius;
+            }
+            case Shape::Capsule: {
+                glm::vec3 axis = b - a;
+                float length2 = glm::dot(axis, axis);
+                float t = length2 > 0.f ? glm::clamp(glm::dot(p - a, axis) / length2, 0.f, 1.f) : 0.f;
+                glm::vec3 d = p - (a + t * axis);
+                float length = glm::length(d);
+                normal = length > 0.f ? d / length : any_perpendicular(axis);
+                return length - radius;
+            }
+            case Shape::Box: {
+                glm::vec3 q = glm::transpose(rotation) * (p - a);
+                glm::vec3 d = glm::abs(q) - b;
+                glm::vec3 side = glm::sign(q) + glm::vec3(glm::equal(q, glm::vec3(0.f)));
+                glm::vec3 outside = glm::max(d, 0.f);
+                if (glm::dot(outside, outside) > 0.f) {
+                    float length = glm::length(outside);
+                    normal = rotation * (outside * side / length);
+                    return length;
+                }
+                // Inside: out through the nearest face
+                int axis = d.x > d.y ? (d.x > d.z ? 0 : 2) : (d.y > d.z ? 1 : 2);
+                glm::vec3 local(0.f);
+                local[axis] = side[axis];
+                normal = rotation * local;
+                return d[axis];
+            }
+            case Shape::SdfGrid: {
+                float d = sdf->distance(p, normal);
+                float length = glm::length(normal);
+                normal = length > 0.f ? normal / length : glm::vec3(0.f, 1.f, 0.f);
+                return d;
+            }
+            case Shape::BrickMap: {
+                glm::vec3 gradient;
+                float d = bricks->distance(glm::transpose(rotation) * (p - a), gradient);
+                float length = glm::length(gradient);
+                normal = length > 0.f ? rotation * (gradient / length) : glm::vec3(0.f, 1.f, 0.f);
+                return d - radius;
+            }
+            }
+            normal = glm::vec3(0.f, 1.f, 0.f);
+            return std::numeric_limits<float>::max();
+        }
+
+        Box Collider::bounds() const {
+            switch (shape) {
+            case Shape::Sphere:
+                return {a - radius, a + radius};
+            case Shape::Capsule:
+                return {glm::min(a, b) - radius, glm::max(a, b) + radius};
+            case Shape::Box: {
+                // Extent of the rotated half extents along each world axis
+                glm::vec3 extent = glm::abs(rotation[0]) * b.x + glm::abs(rotation[1]) * b.y + glm::abs(rotation[2]) * b.z;
+                return {a - extent, a + extent};
+            }
+            case Shape::SdfGrid:
+                return sdf->bounds();
+            case Shape::BrickMap: {
+                const Box &local = bricks->bounds();
+                glm::vec3 center = 0.5f * (local.min + local.max), half = 0.5f * (local.max - local.min);
+                glm::vec3 extent = glm::abs(rotation[0]) * half.x + glm::abs(rotation[1]) * half.y + glm::abs(rotation[2]) * half.z;
+                return {a + rotation * center - extent, a + rotation * center + extent};
+            }
+            default:
+                return {glm::vec3(-std::numeric_limits<float>::max()), glm::vec3(std::numeric_limits<float>::max())};
+            }
+        }
+
+        //////////////////////////////////////////////////
+        ////               ColliderSet                ////
+        //////////////////////////////////////////////////
+
+        std::size_t ColliderSet::add(const Collider &collider) {
+            list.push_back(collider);
+            build_broadphase();
+            return list.size() - 1;
+        }
+
+        std::size_t ColliderSet::add(const std::vector<Collider> &colliders) {
+            std::size_t first = list.size();
+            list.insert(list.end(), colliders.begin(), colliders.end());
+            build_broadphase();
+            return first;
+        }
+
+        void ColliderSet::clear() {
+            list.clear();
+            build_broadphase();
+        }
+
+        void ColliderSet::build_broadphase() {
+            unbounded.clear();
+            cell_start.clear();
+            cell_colliders.clear();
+            collider_cells.assign(list.size(), CellRange());
+            grid_bounds = {glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max())};
+            float largest = 0.f;
+            for (std::uint32_t c = 0; c < list.size(); ++c) {
+                if (!list[c].bounded()) {
+                    unbounded.push_back(c);
+                    continue;
+                }
+                Box box = list[c].bounds();
+                grid_bounds = merge(grid_bounds, box);
+                largest = std::max(largest, glm::length(box.max - box.min));
+            }
+            if (unbounded.size() == list.size()) return;
+
+            //Cells about as large as the largest collider, at most max_cells per axis
+            glm::vec3 extent = glm::max(grid_bounds.max - grid_bounds.min, glm::vec3(1.e-3f));
+            dims = glm::clamp(glm::ivec3(glm::ceil(extent / std::max(largest, 1.e-3f))), glm::ivec3(1), glm::ivec3(max_cells));
+            cell_size = extent / glm::vec3(dims);
+
+            //Counting sort of (cell, collider) pairs
+            const std::size_t cells = (std::size_t) dims.x * dims.y * dims.z;
+            for (std::uint32_t c = 0; c < list.size(); ++c) {
+                if (!list[c].bounded()) continue;
+                Box box = list[c].bounds();
+                collider_cells[c] = {cell_of(box.min), cell_of(box.max)};
+            }
+            auto for_each_cell = [&](std::uint32_t c, auto &&fn) {
+                const CellRange &range = collider_cells[c];
+                for (int z = range.min.z; z <= range.max.z; ++z)
+                    for (int y = range.min.y; y <= range.max.y; ++y)
+                        for (int x = range.min.x; x <= range.max.x; ++x) fn(((std::size_t) z * dims.y + y) * dims.x + x);
+            };
+            cell_start.assign(cells + 1, 0);
+            for (std::uint32_t c = 0; c < list.size(); ++c) {
+                if (list[c].bounded()) for_each_cell(c, [&](std::size_t cell) { cell_start[cell + 1]++; });
+            }
+            for (std::size_t cell = 0; cell < cells; ++cell) cell_start[cell + 1] += cell_start[cell];
+            cell_colliders.resize(cell_start[cells]);
+            std::vector<std::uint32_t> cursor(cell_start.begin(), cell_start.end() - 1);
+            for (std::uint32_t c = 0; c < list.size(); ++c) {
+                if (list[c].bounded()) for_each_cell(c, [&](std::size_t cell) { cell_colliders[cursor[cell]++] = c; });
+            }
+        }
+
+        bool ColliderSet::sweep(const glm::vec3 &from, const glm::vec3 &to, float &t, glm::vec3 &normal) const {
+            const float length = glm::distance(from, to);
+            const int max_iterations = 32, samples = 16, bisections = 24;
+            bool hit = false;
+            t = 1.f;
+            for_each_candidate({glm::min(from, to), glm::max(from, to)}, [&](std::uint32_t c) {
+                const Collider &collider = list[c];
+                auto touch = [&](float s) {
+                    hit = true;
+                    t = s;
+                    collider.distance(from + s * (to - from), normal);
+                };
+                // Distance is a lower bound on how far the point travels before touching, so stepping by it never
+                // skips the surface
+                float s = 0.f;
+                glm::vec3 n;
+                for (int k = 0; k < max_iterations; ++k) {
+                    float d = collider.distance(from + s * (to - from), n);
+                    if (d <= sweep_tolerance) return touch(s);
+                    if (length <= 0.f) return;
+                    s += d / length;
+                    if (s > t) return;
+                }
+                // Grazing approaches advance slowly: look for a point inside on the rest of the way, then bisect
+                // back to the last point found outside
+                float inside = -1.f;
+                for (int k = 1; k <= samples && inside < 0.f; ++k) {
+                    float q = s + (t - s) * (float) k / (float) samples;
+                    if (collider.distance(from + q * (to - from), n) <= sweep_tolerance) inside = q;
+                    else s = q;
+                }
+                if (inside < 0.f) return;
+                for (int k = 0; k < bisections; ++k) {
+                    float mid = 0.5f * (s + inside);
+                    if (collider.distance(from + mid * (to - from), n) > sweep_tolerance) s = mid;
+                    else inside = mid;
+                }
+                touch(inside);
+            });
+            return hit;
+        }
+
+        void ColliderSet::apply_penalty(primatives::ParticleSystem &particles, std::size_t begin, std::size_t end,
+                                        const ContactCallback &on_contact) const {
+            end = std::min(end, particles.dynamic_count());
+            for (std::size_t i = begin; i < end; ++i) {
+                for_each_contact(glm::vec3(particles.position(i)), [&](const Collider &collider, float d, const glm::vec3 &normal) {
+                    // Spring pushing out along the normal, damper on the normal velocity
+                    float v_n = glm::dot(glm::vec3(particles.velocity(i)), normal);
+                    particles.add_force(i, primatives::ParticleSystem::ForceVec3((-d * collider.k_s - v_n * collider.k_d) * normal));
+                    if (on_contact) on_contact(i, collider, normal);
+                });
+            }
+        }
+
+        std::size_t ColliderSet::project(primatives::ParticleSystem &particles, std::size_t begin, std::size_t end,
+                                         const ContactCallback &on_contact) const {
+            using Vec3 = primatives::ParticleSystem::Vec3;
+            std::size_t moved = 0;
+            end = std::min(end, particles.dynamic_count());
+            for (std::size_t i = begin; i < end; ++i) {
+                bool contact = false;
+                for_each_contact(glm::vec3(particles.position(i)), [&](const Collider &collider, float d, const glm::vec3 &normal) {
+                    if (on_contact) on_contact(i, collider, normal);
+                    particles.set_position(i, particles.position(i) - Vec3(d * normal));
+                    float v_n = glm::dot(glm::vec3(particles.velocity(i)), normal);
+                    if (v_n < 0.f) particles.set_velocity(i, particles.velocity(i) - Vec3(v_n * normal));
+                    contact = true;
+                });
+                moved += contact ? 1 : 0;
+            }
+            return moved;
+        }
+
+        float ColliderSet::max_stiffness() const {
+            float k_s = 0.f;
+            for (const Collider &collider: list) k_s = std::max(k_s, collider.k_s);
+            return k_s;
+        }
+    } // namespace collision
+} // namespace simulation
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "brick_map.hpp"
+#include "particle_system.hpp"
+#include "proximity.hpp"
+
+namespace simulation {
+    namespace collision {
+        //Signed distance field sampled on a regular grid, trilinear between the samples
+        class SdfGrid {
+        public:
+            // Samples distance at the corners of cells `cell` wide covering bounds
+            SdfGrid(const Box &bounds, float cell, const std::function<float(const glm::vec3 &)> &distance);
+
+            // Distance at p and its gradient. Outside the grid, the distance from the grid plus the value at the
+            // nearest point of the grid
+            float distance(const glm::vec3 &p, glm::vec3 &gradient) const;
+            const Box &bounds() const { return box; }
+
+        private:
+            float at(int x, int y, int z) const { return values[((std::size_t) z * dims.y + y) * dims.x + x]; }
+
+            Box box;
+            float cell;
+            glm::ivec3 dims;
+            std::vector<float> values;
+        };
+
+        enum class Shape {
+            Plane,
+            Sphere,
+            Capsule,
+            Box,    // oriented
+            SdfGrid,
+            BrickMap // placed, of a baked mesh
+        };
+        const char *shape_name(Shape shape);
+
+        //Static obstacle the masses of a model collide with: penalty springs of stiffness k_s and damping k_d
+        //for the force based integrators, a position projection for the position based ones
+        struct Collider {
+            Shape shape = Shape::Plane;
+            glm::vec3 a{0.f, 1.f, 0.f}; // plane normal, sphere and box centre, capsule start, brick map position
+            glm::vec3 b{0.f};           // capsule end, box half extents
+            glm::mat3 rotation{1.f};    // box and brick map, local to world
+            float radius = 0.f;         // sphere and capsule radius, plane offset along its normal, brick map skin
+            std::shared_ptr<const SdfGrid> sdf;
+            std::shared_ptr<const BrickMap> bricks;
+            float k_s = 100000.f, k_d = 0.4f;
+
+            static Collider plane(const glm::vec3 &normal, float offset);
+            static Collider sphere(const glm::vec3 &center, float radius);
+            static Collider capsule(const glm::vec3 &start, const glm::vec3 &end, float radius);
+            static Collider box(const glm::vec3 &center, const glm::vec3 &half_extents, const glm::mat3 &rotation = glm::mat3(1.f));
+            static Collider sdf_grid(std::shared_ptr<const SdfGrid> sdf);
+            // The mesh of bricks moved to position and rotated, its surface pushed out by skin
+            static Collider brick_map(std::shared_ptr<const BrickMap> bricks, const glm::vec3 &position,
+                                      const glm::mat3 &rotation = glm::mat3(1.f), float skin = 0.f);
+
+            // Signed distance from the surface (negative inside) and the outward normal there
+            float distance(const glm::vec3 &p, glm::vec3 &normal) const;
+            bool bounded() const { return shape != Shape::Plane; }
+            Box bounds() const;
+        };
+
+        //The colliders of a model and a broadphase over them: a coarse uniform grid over the bounded colliders
+        //(rebuilt when the set changes), so a mass only tests the colliders of its cell plus the unbounded planes.
+        //The contact passes work on a range of masses and can run on disjoint ranges in parallel.
+        class ColliderSet {
+        public:
+            // Called for each penetrating mass after its penalty force was added, or before it is projected out
+            using ContactCallback = std::function<void(std::size_t mass, const Collider &collider, const glm::vec3 &normal)>;
+
+            std::size_t add(const Collider &collider);
+            // Adds all of them with a single broadphase rebuild; returns the index of the first
+            std::size_t add(const std::vector<Collider> &colliders);
+            void clear();
+            const std::vector<Collider> &colliders() const { return list; }
+            bool empty() const { return list.empty(); }
+
+            // Calls fn(collider, distance, normal) for every collider p is inside of
+            template<typename Fn>
+            void for_each_contact(const glm::vec3 &p, Fn &&fn) const {
+                auto test = [&](std::uint32_t c) {
+                    glm::vec3 normal;
+                    float d = list[c].distance(p, normal);
+                    if (d < 0.f) fn(list[c], d, normal);
+                };
+                for (std::uint32_t c: unbounded) test(c);
+                if (cell_start.empty() || !contains(grid_bounds, p)) return;
+                glm::ivec3 cell = cell_of(p);
+                std::size_t index = ((std::size_t) cell.z * dims.y + cell.y) * dims.x + cell.x;
+                for (std::uint32_t k = cell_start[index]; k < cell_start[index + 1]; ++k) test(cell_colliders[k]);
+            }
+
+            // Calls fn(collider index) once for every collider whose bounds may overlap box
+            template<typename Fn>
+            void for_each_candidate(const Box &box, Fn &&fn) const {
+                for (std::uint32_t c: unbounded) fn(c);
+                if (cell_start.empty() || !overlaps(grid_bounds, box)) return;
+                glm::ivec3 lo = cell_of(box.min), hi = cell_of(box.max);
+                for (int z = lo.z; z <= hi.z; ++z) {
+                    for (int y = lo.y; y <= hi.y; ++y) {
+                        for (int x = lo.x; x <= hi.x; ++x) {
+                            std::size_t index = ((std::size_t) z * dims.y + y) * dims.x + x;
+                            for (std::uint32_t k = cell_start[index]; k < cell_start[index + 1]; ++k) {
+                                // A collider spans several cells, only the first one shared with box reports it
+                                std::uint32_t c = cell_colliders[k];
+                                if (glm::max(lo, collider_cells[c].min) == glm::ivec3(x, y, z)) fn(c);
+                            }
+                        }
+                    }
+                }
+            }
+
+            // Earliest time t in [0, 1] at which the point moving from `from` to `to` touches a collider, and the
+            // collider's normal there. False if it stays outside. Conservative advancement on the signed distance,
+            // with the grazing approaches it is slow on sampled instead, so a graze can cut a surface slightly
+            bool sweep(const glm::vec3 &from, const glm::vec3 &to, float &t, glm::vec3 &normal) const;
+
+            // Adds penalty forces to the masses in [begin, end)
+            void apply_penalty(primatives::ParticleSystem &particles, std::size_t begin, std::size_t end,
+                               const ContactCallback &on_contact = {}) const;
+            // Moves penetrating masses in [begin, end) onto the surface and removes their velocity into it; returns
+            // how many were moved
+            std::size_t project(primatives::ParticleSystem &particles, std::size_t begin, std::size_t end,
+                                const ContactCallback &on_contact = {}) const;
+
+            float max_stiffness() const;
+
+            // Cells per axis of the broadphase grid at most
+            static constexpr int max_cells = 16;
+
+            float sweep_tolerance = 1.e-4f; // distance at which a swept point counts as touching
+
+        private:
+            //Range of broadphase cells
+            struct CellRange {
+                glm::ivec3 min{0}, max{-1};
+            };
+
+            void build_broadphase();
+            glm::ivec3 cell_of(const glm::vec3 &p) const {
+                return glm::clamp(glm::ivec3((p - grid_bounds.min) / cell_size), glm::ivec3(0), dims - 1);
+            }
+
+            std::vector<Collider> list;
+            std::vector<std::uint32_t> unbounded;
+            Box grid_bounds;
+            glm::vec3 cell_size{1.f};
+            glm::ivec3 dims{0};
+            std::vector<std::uint32_t> cell_start;     // per cell + 1
+            std::vector<std::uint32_t> cell_colliders; // bounded colliders overlapping each cell
+            std::vector<CellRange> collider_cells;     // per collider
+        };
+    } // namespace collision
+} // namespace simulation
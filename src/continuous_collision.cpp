@@ -0,0 +1,352 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <tuple>
+
+#include "continuous_collision.hpp"
+#include "proximity.hpp"
+#include "self_collision.hpp"
+#include "thread_pool.hpp"
+
+namespace simulation {
+    namespace collision {
+        namespace {
+            const std::size_t grain = 256;
+
+            // Times in [0, 1] at which u, v and w, each moving linearly (u0 + t du, ...), are coplanar:
+            // the roots of (u x v) . w, a cubic in t
+            int coplanar_roots(const glm::dvec3 &u0, const glm::dvec3 &du, const glm::dvec3 &v0, const glm::dvec3 &dv,
+                               const glm::dvec3 &w0, const glm::dvec3 &dw, double roots[3]) {
+                glm::dvec3 uv = glm::cross(u0, v0), uv_t = glm::cross(u0, dv) + glm::cross(du, v0), uv_tt = glm::cross(du, dv);
+                double k0 = glm::dot(uv, w0), k1 = glm::dot(uv, dw) + glm::dot(uv_t, w0);
+                double k2 = glm::dot(uv_t, dw) + glm::dot(uv_tt, w0), k3 = glm::dot(uv_tt, dw);
+                // The positions are floats, so below their rounding the triple product is noise: coplanar all along
+                // (flat cloth), and only the start can be in contact
+                double noise = 1.e-6 * (glm::length(u0) + glm::length(du)) * (glm::length(v0) + glm::length(dv)) *
+                               (glm::length(w0) + glm::length(dw));
+                if (std::abs(k0) <= noise && std::abs(k1) <= noise && std::abs(k2) <= noise && std::abs(k3) <= noise) {
+                    roots[0] = 0.0;
+                    return 1;
+                }
+                return cubic_roots(k0, k1, k2, k3, roots);
+            }
+
+            Box swept_box(const glm::vec3 *from, const glm::vec3 *to, int count, float margin) {
+                Box box{glm::min(from[0], to[0]), glm::max(from[0], to[0])};
+                for (int k = 1; k < count; ++k) box = merge(box, {glm::min(from[k], to[k]), glm::max(from[k], to[k])});
+                return {box.min - margin, box.max + margin};
+            }
+
+            // Orients normal from the second feature to the first at the start of the step (by the motion if
+            // they start touching), false if it is degenerate or the pair is not approaching along it
+            bool face_away(glm::vec3 &normal, const glm::vec3 x0[4], const glm::vec3 x1[4], const float weight[4]) {
+                float length2 = glm::dot(normal, normal);
+                if (length2 <= 1.e-20f) return false;
+                normal /= std::sqrt(length2);
+                float gap = 0.f, motion = 0.f;
+                for (int k = 0; k < 4; ++k) {
+                    gap += weight[k] * glm::dot(normal, x0[k]);
+                    motion += weight[k] * glm::dot(normal, x1[k] - x0[k]);
+                }
+                if (gap < 0.f || (gap == 0.f && motion > 0.f)) {
+                    normal = -normal;
+                    motion = -motion;
+                }
+                return motion < 0.f;
+            }
+        }
+
+        int cubic_roots(double k0, double k1, double k2, double k3, double roots[3]) {
+            auto f = [&](double t) { return ((k3 * t + k2) * t + k1) * t + k0; };
+            // The cubic lies within the hull of its Bernstein coefficients over [0, 1]: one sign, no roots
+            const double bernstein[4] = {k0, k0 + k1 / 3.0, k0 + (2.0 * k1 + k2) / 3.0, k0 + k1 + k2 + k3};
+            if (std::all_of(bernstein, bernstein + 4, [](double b) { return b > 0.0; }) ||
+                std::all_of(bernstein, bernstein + 4, [](double b) { return b < 0.0; })) {
+                return 0;
+            }
+
+            //f is monotonic between the zeros of its derivative 3 k3 t^2 + 2 k2 t + k1, so split [0, 1] there
+            double split[4] = {0.0};
+            int splits = 1;
+            const double a = 3.0 * k3, b = 2.0 * k2, c = k1;
+            const double discriminant = b * b - 4.0 * a * c;
+            if (discriminant > 0.0) {
+                // Without cancellation, and a -> 0 sends one of them far out of [0, 1]
+                double q = -0.5 * (b + (b < 0.0 ? -1.0 : 1.0) * std::sqrt(discriminant));
+                double t0 = a != 0.0 ? q / a : -1.0, t1 = q != 0.0 ? c / q : -1.0;
+                if (t0 > t1) std::swap(t0, t1);
+                if (t0 > 0.0 && t0 < 1.0) split[splits++] = t0;
+                if (t1 > 0.0 && t1 < 1.0) split[splits++] = t1;
+            }
+            split[splits++] = 1.0;
+
+            int count = 0;
+            for (int k = 0; k + 1 < splits; ++k) {
+                double lo = split[k], hi = split[k + 1], f_lo = f(lo), f_hi = f(hi);
+                if (f_lo == 0.0) {
+                    if (count == 0 || roots[count - 1] != lo) roots[count++] = lo;
+                    continue;
+                }
+                if (f_hi == 0.0) {
+                    roots[count++] = hi;
+                    continue;
+                }
+                if ((f_lo < 0.0) == (f_hi < 0.0)) continue;
+                for (int i = 0; i < 52 && hi - lo > 1.e-9; ++i) {
+                    double mid = 0.5 * (lo + hi), f_mid = f(mid);
+                    if ((f_mid < 0.0) == (f_lo < 0.0)) {
+                        lo = mid;
+                        f_lo = f_mid;
+                    } else {
+                        hi = mid;
+                    }
+                }
+                roots[count++] = 0.5 * (lo + hi);
+            }
+            return count;
+        }
+
+        bool point_triangle_impact(const glm::vec3 x0[4], const glm::vec3 x1[4], float tolerance, float &t,
+                                   glm::vec3 &barycentric) {
+            glm::dvec3 p(x0[0]), a(x0[1]), b(x0[2]), c(x0[3]);
+            glm::dvec3 dp = glm::dvec3(x1[0]) - p, da = glm::dvec3(x1[1]) - a, db = glm::dvec3(x1[2]) - b, dc = glm::dvec3(x1[3]) - c;
+            double roots[3];
+            int count = coplanar_roots(b - a, db - da, c - a, dc - da, p - a, dp - da, roots);
+            for (int r = 0; r < count; ++r) {
+                float s = (float) roots[r];
+                glm::vec3 x[4];
+                for (int k = 0; k < 4; ++k) x[k] = glm::mix(x0[k], x1[k], s);
+                glm::vec3 w = closest_on_triangle(x[0], x[1], x[2], x[3]);
+                if (glm::distance(x[0], w.x * x[1] + w.y * x[2] + w.z * x[3]) > tolerance) continue;
+                t = s;
+                barycentric = w;
+                return true;
+            }
+            return false;
+        }
+
+        bool edge_edge_impact(const glm::vec3 x0[4], const glm::vec3 x1[4], float tolerance, float &t, glm::vec2 &st) {
+            glm::dvec3 p0(x0[0]), p1(x0[1]), q0(x0[2]), q1(x0[3]);
+            glm::dvec3 dp0 = glm::dvec3(x1[0]) - p0, dp1 = glm::dvec3(x1[1]) - p1;
+            glm::dvec3 dq0 = glm::dvec3(x1[2]) - q0, dq1 = glm::dvec3(x1[3]) - q1;
+            double roots[3];
+            int count = coplanar_roots(p1 - p0, dp1 - dp0, q1 - q0, dq1 - dq0, q0 - p0, dq0 - dp0, roots);
+            for (int r = 0; r < count; ++r) {
+                float s = (float) roots[r];
+                glm::vec3 x[4];
+                for (int k = 0; k < 4; ++k) x[k] = glm::mix(x0[k], x1[k], s);
+                glm::vec2 uv = closest_on_segments(x[0], x[1], x[2], x[3]);
+                if (glm::distance(glm::mix(x[0], x[1], uv.x), glm::mix(x[2], x[3], uv.y)) > tolerance) continue;
+                t = s;
+                st = uv;
+                return true;
+            }
+            return false;
+        }
+
+        void ContinuousCollision::build(const std::vector<primatives::Face> &faces) {
+            this->faces = faces;
+            edges = mesh_edges(faces, &face_edges);
+            edge_face.assign(edges.size(), 0);
+            for (std::size_t f = faces.size(); f-- > 0;) {
+                for (int side = 0; side < 3; ++side) edge_face[face_edges[f][side]] = (std::uint32_t) f;
+            }
+            impacts.clear();
+        }
+
+        void ContinuousCollision::begin(const primatives::ParticleSystem &particles) {
+            from.resize(particles.size());
+            threading::pool().parallel_for(0, particles.size(), 1024, [this, &particles](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i) from[i] = glm::vec3(particles.position(i));
+            });
+        }
+
+        std::size_t ContinuousCollision::collide(primatives::ParticleSystem &particles, const ColliderSet &colliders,
+                                                 const ImpactCallback &on_impact) {
+            using Vec3 = primatives::ParticleSystem::Vec3;
+            if (colliders.empty() || from.size() != particles.size()) return 0;
+            std::atomic<std::size_t> hits{0};
+            threading::pool().parallel_for(0, particles.dynamic_count(), grain, [&](std::size_t begin, std::size_t end) {
+                std::size_t count = 0;
+                for (std::size_t i = begin; i < end; ++i) {
+                    const glm::vec3 p0 = from[i], p1 = glm::vec3(particles.position(i));
+                    float t;
+                    glm::vec3 normal;
+                    if (!colliders.sweep(p0, p1, t, normal)) continue;
+                    count++;
+
+                    //Up to the impact, then only the rest of the motion along the surface
+                    glm::vec3 motion = p1 - p0;
+                    float into = glm::dot(motion, normal);
+                    glm::vec3 p = p0 + t * motion + (1.f - t) * (into < 0.f ? motion - into * normal : motion);
+                    // Sliding along a curved surface (or starting inside) can still end up in a collider
+                    colliders.for_each_contact(p, [&](const Collider &, float d, const glm::vec3 &n) { p -= d * n; });
+                    particles.set_position(i, Vec3(p));
+
+                    glm::vec3 v = glm::vec3(particles.velocity(i));
+                    float v_n = glm::dot(v, normal);
+                    if (on_impact) on_impact(i, -v_n);
+                    if (v_n < 0.f) particles.set_velocity(i, Vec3(v - (1.f + restitution) * v_n * normal));
+                }
+                hits += count;
+            });
+            return hits;
+        }
+
+        std::size_t ContinuousCollision::collide_self(primatives::ParticleSystem &particles, BVH &bvh, float dt,
+                                                      const ImpactCallback &on_impact) {
+            using Vec3 = primatives::ParticleSystem::Vec3;
+            impacts.clear();
+            const std::size_t n = particles.size();
+            if (faces.empty() || bvh.empty() || from.size() != n || dt <= 0.f) return 0;
+            threading::ThreadPool &pool = threading::pool();
+
+            to.resize(n);
+            velocity.resize(n);
+            pool.parallel_for(0, n, 1024, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    to[i] = glm::vec3(particles.position(i));
+                    velocity[i] = (to[i] - from[i]) / dt;
+                }
+            });
+
+            std::size_t first_pass = 0;
+            for (int pass = 0; pass < iterations; ++pass) {
+                if (pass > 0) {
+                    pool.parallel_for(0, n, 1024, [&](std::size_t begin, std::size_t end) {
+                        for (std::size_t i = begin; i < end; ++i) to[i] = from[i] + velocity[i] * dt;
+                    });
+                }
+                bvh.refit(from, to);
+
+                //Detection, in parallel over masses and over edges
+                impacts.clear();
+                std::mutex mutex;
+                pool.parallel_for(0, n, grain, [&](std::size_t begin, std::size_t end) {
+                    std::vector<Impact> found;
+                    find_point_triangle(bvh, begin, end, found);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    impacts.insert(impacts.end(), found.begin(), found.end());
+                });
+                pool.parallel_for(0, edges.size(), grain, [&](std::size_t begin, std::size_t end) {
+                    std::vector<Impact> found;
+                    find_edge_edge(bvh, begin, end, found);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    impacts.insert(impacts.end(), found.begin(), found.end());
+                });
+                // Sorted so the result does not depend on the threads; an edge pair is found through both faces
+                auto key = [](const Impact &c) { return std::make_tuple(c.edge_edge, c.first, c.second); };
+                std::sort(impacts.begin(), impacts.end(), [&](const Impact &a, const Impact &b) { return key(a) < key(b); });
+                impacts.erase(std::unique(impacts.begin(), impacts.end(),
+                                          [&](const Impact &a, const Impact &b) { return key(a) == key(b); }),
+                              impacts.end());
+
+                if (pass == 0) first_pass = impacts.size();
+                if (impacts.empty()) break;
+                for (const Impact &impact: impacts) {
+                    float approach_speed = resolve(particles, impact, dt);
+                    if (pass > 0 || !on_impact) continue;
+                    for (std::uint32_t mass: impact.mass) on_impact(mass, approach_speed);
+                }
+            }
+
+            //Masses whose average velocity changed end the step where it takes them, with the same change of velocity
+            pool.parallel_for(0, particles.dynamic_count(), 1024, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    glm::vec3 original = (glm::vec3(particles.position(i)) - from[i]) / dt;
+                    if (velocity[i] == original) continue;
+                    particles.set_position(i, Vec3(from[i] + velocity[i] * dt));
+                    particles.set_velocity(i, particles.velocity(i) + Vec3(velocity[i] - original));
+                }
+            });
+            return first_pass;
+        }
+
+        void ContinuousCollision::find_point_triangle(const BVH &bvh, std::size_t begin, std::size_t end,
+                                                      std::vector<Impact> &found) const {
+            for (std::size_t i = begin; i < end; ++i) {
+                bvh.query(swept_box(&from[i], &to[i], 1, tolerance), [&](std::uint32_t f) {
+                    const primatives::Face &face = faces[f];
+                    if (face.mass_a == i || face.mass_b == i || face.mass_c == i) return;
+                    const std::uint32_t mass[4] = {(std::uint32_t) i, face.mass_a, face.mass_b, face.mass_c};
+                    glm::vec3 x0[4], x1[4];
+                    for (int k = 0; k < 4; ++k) {
+                        x0[k] = from[mass[k]];
+                        x1[k] = to[mass[k]];
+                    }
+                    float t;
+                    glm::vec3 w;
+                    if (!point_triangle_impact(x0, x1, tolerance, t, w)) return;
+
+                    Impact impact{false, (std::uint32_t) i, f, {mass[0], mass[1], mass[2], mass[3]}, {1.f, -w.x, -w.y, -w.z}};
+                    glm::vec3 a = glm::mix(x0[1], x1[1], t), b = glm::mix(x0[2], x1[2], t), c = glm::mix(x0[3], x1[3], t);
+                    impact.normal = glm::cross(b - a, c - a);
+                    if (face_away(impact.normal, x0, x1, impact.weight)) found.push_back(impact);
+                });
+            }
+        }
+
+        void ContinuousCollision::find_edge_edge(const BVH &bvh, std::size_t begin, std::size_t end,
+                                                 std::vector<Impact> &found) const {
+            for (std::size_t e = begin; e < end; ++e) {
+                const glm::uvec2 &edge = edges[e];
+                const glm::vec3 from_e[2] = {from[edge.x], from[edge.y]}, to_e[2] = {to[edge.x], to[edge.y]};
+                const Box box = swept_box(from_e, to_e, 2, tolerance);
+                bvh.query(box, [&](std::uint32_t f) {
+                    for (int side = 0; side < 3; ++side) {
+                        // An edge is in two faces, test it through the first one only
+                        const std::uint32_t o = face_edges[f][side];
+                        const glm::uvec2 &other = edges[o];
+                        if (o <= e || edge_face[o] != f) continue;
+                        if (other.x == edge.x || other.x == edge.y || other.y == edge.x || other.y == edge.y) continue;
+                        const glm::vec3 from_o[2] = {from[other.x], from[other.y]}, to_o[2] = {to[other.x], to[other.y]};
+                        if (!overlaps(box, swept_box(from_o, to_o, 2, 0.f))) continue;
+                        const std::uint32_t mass[4] = {edge.x, edge.y, other.x, other.y};
+                        glm::vec3 x0[4], x1[4];
+                        for (int k = 0; k < 4; ++k) {
+                            x0[k] = from[mass[k]];
+                            x1[k] = to[mass[k]];
+                        }
+                        float t;
+                        glm::vec2 st;
+                        if (!edge_edge_impact(x0, x1, tolerance, t, st)) continue;
+
+                        Impact impact{true, (std::uint32_t) e, o, {mass[0], mass[1], mass[2], mass[3]},
+                                      {1.f - st.x, st.x, st.y - 1.f, -st.y}};
+                        glm::vec3 p0 = glm::mix(x0[0], x1[0], t), p1 = glm::mix(x0[1], x1[1], t);
+                        glm::vec3 q0 = glm::mix(x0[2], x1[2], t), q1 = glm::mix(x0[3], x1[3], t);
+                        impact.normal = glm::cross(p1 - p0, q1 - q0);
+                        // Parallel edges: along the line between them at the start instead
+                        if (glm::dot(impact.normal, impact.normal) <= 1.e-20f) {
+                            impact.normal = glm::mix(x0[0], x0[1], st.x) - glm::mix(x0[2], x0[3], st.y);
+                        }
+                        if (face_away(impact.normal, x0, x1, impact.weight)) found.push_back(impact);
+                    }
+                });
+            }
+        }
+
+        float ContinuousCollision::resolve(const primatives::ParticleSystem &particles, const Impact &impact, float dt) {
+            float inv_mass[4], sum = 0.f, gap = 0.f, approach = 0.f;
+            for (int k = 0; k < 4; ++k) {
+                const std::uint32_t i = impact.mass[k];
+                inv_mass[k] = particles.fixed(i) ? 0.f : (float) particles.inv_mass[i];
+                sum += inv_mass[k] * impact.weight[k] * impact.weight[k];
+                gap += impact.weight[k] * glm::dot(impact.normal, from[i]);
+                approach += impact.weight[k] * glm::dot(impact.normal, velocity[i]);
+            }
+            if (sum <= 0.f) return -approach;
+
+            //Inelastic impulse: the pair's relative velocity along the normal may at most close the gap it started
+            //the step with, down to `separation`
+            const float target = (separation - gap) / dt;
+            if (approach >= target) return -approach;
+            const float impulse = (target - approach) / sum;
+            for (int k = 0; k < 4; ++k) {
+                velocity[impact.mass[k]] += inv_mass[k] * impact.weight[k] * impulse * impact.normal;
+            }
+            return -approach;
+        }
+    } // namespace collision
+} // namespace simulation
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bvh.hpp"
+#include "colliders.hpp"
+#include "particle_system.hpp"
+#include "spring_table.hpp"
+
+namespace simulation {
+    namespace collision {
+        // Roots of k3 t^3 + k2 t^2 + k1 t + k0 in [0, 1], ascending; returns how many
+        int cubic_roots(double k0, double k1, double k2, double k3, double roots[3]);
+
+        // Earliest time t in [0, 1] at which point x[0] lies on triangle x[1] x[2] x[3], every vertex moving
+        // linearly from x0 to x1 over the step (within tolerance); barycentric gets the weights of x[1], x[2], x[3]
+        bool point_triangle_impact(const glm::vec3 x0[4], const glm::vec3 x1[4], float tolerance, float &t,
+                                   glm::vec3 &barycentric);
+        // Earliest time t in [0, 1] at which edges x[0] x[1] and x[2] x[3] touch; st gets the parameters along both
+        bool edge_edge_impact(const glm::vec3 x0[4], const glm::vec3 x1[4], float tolerance, float &t, glm::vec2 &st);
+
+        //Continuous collision detection over a step: the masses move on straight lines from where they were when
+        //begin() was called to where the integrator left them, and impacts anywhere along those lines are found,
+        //so fast masses cannot step over a collider or through a face between two steps.
+        // - Colliders: each swept point is advanced along its segment by its signed distance until it touches.
+        //   Masses that hit move to the impact point, then along the surface for the rest of the step, and lose
+        //   their velocity into it.
+        // - Self (a triangle mesh, the cloth): the BVH is refitted to the swept faces, and point-triangle and
+        //   edge-edge pairs are tested for the times they become coplanar (the roots of a cubic), then for
+        //   contact at those times. Impacts are resolved with inelastic impulses on the step's average
+        //   velocities, and detection repeats up to `iterations` times as the impulses create new ones.
+        //Impacts left after the last iteration stay unresolved (there is no rigid impact zone fallback).
+        class ContinuousCollision {
+        public:
+            // Called for each mass of an impact with the speed it approached at (relative, for the self impacts)
+            using ImpactCallback = std::function<void(std::size_t mass, float approach_speed)>;
+
+            // Topology of the mesh for the self impacts
+            void build(const std::vector<primatives::Face> &faces);
+            // Remembers where the masses start the step, call before the integrator moves them
+            void begin(const primatives::ParticleSystem &particles);
+
+            // Swept masses against colliders; returns how many hit. on_impact may run on several threads at once
+            std::size_t collide(primatives::ParticleSystem &particles, const ColliderSet &colliders,
+                                const ImpactCallback &on_impact = {});
+            // Swept mesh against itself; refits bvh to the swept faces. Returns the impacts of the first pass, which
+            // are the ones reported to on_impact
+            std::size_t collide_self(primatives::ParticleSystem &particles, BVH &bvh, float dt,
+                                     const ImpactCallback &on_impact = {});
+
+            float restitution = 0.f; // of the normal velocity at a collider
+            float separation = 1.e-3f; // gap impacts are resolved to
+            float tolerance = 1.e-4f;  // distance at which swept pairs touch
+            int iterations = 4;
+
+        private:
+            //Impact between a mass and a face (masses p, a, b, c) or two edges (p0, p1 and q0, q1) with the weights
+            //of their relative position, the normal at impact time facing away from the approach
+            struct Impact {
+                bool edge_edge = false;
+                std::uint32_t first = 0, second = 0; // mass and face, or both edges
+                std::uint32_t mass[4] = {0, 0, 0, 0};
+                float weight[4] = {0.f, 0.f, 0.f, 0.f};
+                glm::vec3 normal{0.f};
+            };
+
+            void find_point_triangle(const BVH &bvh, std::size_t begin, std::size_t end, std::vector<Impact> &found) const;
+            void find_edge_edge(const BVH &bvh, std::size_t begin, std::size_t end, std::vector<Impact> &found) const;
+            // Returns the speed the pair approached at before the impulse
+            float resolve(const primatives::ParticleSystem &particles, const Impact &impact, float dt);
+
+            std::vector<primatives::Face> faces;
+            std::vector<glm::uvec2> edges;
+            std::vector<glm::uvec3> face_edges; // per face
+            std::vector<std::uint32_t> edge_face; // per edge, the first face it belongs to
+
+            std::vector<glm::vec3> from;     // per mass, at begin()
+            std::vector<glm::vec3> to;       // per mass, scratch of collide_self()
+            std::vector<glm::vec3> velocity; // per mass, average over the step, scratch of collide_self()
+            std::vector<Impact> impacts;
+        };
+    } // namespace collision
+} // namespace simulation
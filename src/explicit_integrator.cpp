@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#include "explicit_integrator.hpp"
+#include "thread_pool.hpp"
+
+namespace simulation {
+    namespace integrators {
+        namespace {
+            const std::size_t grain = 1024;
+
+            // Calls fn(i) for every dynamic particle, chunked over the shared pool
+            template<typename Fn>
+            void for_each_free(const primatives::ParticleSystem &particles, const Fn &fn) {
+                threading::pool().parallel_for(0, particles.dynamic_count(), grain, [&](std::size_t begin, std::size_t end) {
+                    for (std::size_t i = begin; i < end; ++i) {
+                        fn(i);
+                    }
+                });
+            }
+        }
+
+        bool ExplicitIntegrator::supports(Integrator scheme) {
+            return scheme == Integrator::SemiImplicitEuler || scheme == Integrator::VelocityVerlet ||
+                   scheme == Integrator::RK2 || scheme == Integrator::RK4;
+        }
+
+        int ExplicitIntegrator::force_evaluations(Integrator scheme) {
+            switch (scheme) {
+                case Integrator::RK2:
+                    return 2;
+                case Integrator::RK4:
+                    return 4;
+                default:
+                    return 1;
+            }
+        }
+
+        float ExplicitIntegrator::stable_dt(Integrator scheme, float omega) {
+            if (omega <= 0.f) return std::numeric_limits<float>::infinity();
+            switch (scheme) {
+                case Integrator::SemiImplicitEuler:
+                case Integrator::VelocityVerlet:
+                    return 2.f / omega;
+                case Integrator::RK2:
+                    // The stability region only touches the imaginary axis at 0: stay well inside and rely on damping
+                    return 1.f / omega;
+                case Integrator::RK4:
+                    return 2.8f / omega;
+                default:
+                    return std::numeric_limits<float>::infinity();
+            }
+        }
+
+        void ExplicitIntegrator::step(Integrator scheme, primatives::ParticleSystem &particles, float dt,
+                                      const ForceFunction &compute_forces) {
+            assert(supports(scheme));
+            const std::size_t n = particles.size();
+            if (x0.size() != n) {
+                x0.resize(n);
+                v0.resize(n);
+                sum_x.resize(n);
+                sum_v.resize(n);
+                acceleration.resize(n);
+                acceleration_valid = false;
+            }
+            if (scheme != last_scheme) {
+                // Another scheme moved the particles since the cached acceleration was computed
+                acceleration_valid = false;
+                last_scheme = scheme;
+            }
+
+            switch (scheme) {
+                case Integrator::VelocityVerlet:
+                    step_velocity_verlet(particles, dt, compute_forces);
+                    break;
+                case Integrator::RK2:
+                    save(particles);
+                    compute_forces();
+                    stage(particles, 0.5f * dt, 0.f, false);
+                    compute_forces();
+                    stage(particles, dt, 0.f, false);
+                    break;
+                case Integrator::RK4:
+                    save(particles);
+                    compute_forces();
+                    stage(particles, 0.5f * dt, 1.f, false);
+                    compute_forces();
+                    stage(particles, 0.5f * dt, 2.f, false);
+                    compute_forces();
+                    stage(particles, dt, 2.f, false);
+                    compute_forces();
+                    stage(particles, dt / 6.f, 1.f, true);
+                    break;
+                default:
+                    compute_forces();
+                    threading::pool().parallel_for(0, n, grain, [&](std::size_t begin, std::size_t end) {
+                        particles.integrate(dt, begin, end);
+                    });
+                    break;
+            }
+        }
+
+        void ExplicitIntegrator::save(const primatives::ParticleSystem &particles) {
+            for_each_free(particles, [&](std::size_t i) {
+                x0[i] = particles.position(i);
+                v0[i] = particles.velocity(i);
+                sum_x[i] = Vec3(0);
+                sum_v[i] = Vec3(0);
+            });
+        }
+
+        void ExplicitIntegrator::stage(primatives::ParticleSystem &particles, float h, float weight, bool from_sums) {
+            const primatives::Scalar step = h, w = weight;
+            for_each_free(particles, [&](std::size_t i) {
+                Vec3 v = particles.velocity(i);
+                Vec3 a = Vec3(particles.force(i)) * particles.inv_mass[i];
+                if (weight != 0.f) {
+                    sum_x[i] += w * v;
+                    sum_v[i] += w * a;
+                }
+                particles.set_position(i, x0[i] + step * (from_sums ? sum_x[i] : v));
+                particles.set_velocity(i, v0[i] + step * (from_sums ? sum_v[i] : a));
+            });
+        }
+
+        void ExplicitIntegrator::step_velocity_verlet(primatives::ParticleSystem &particles, float dt,
+                                                      const ForceFunction &compute_forces) {
+            const primatives::Scalar h = dt, half_h = 0.5f * dt;
+            if (!acceleration_valid) {
+                compute_forces();
+                for_each_free(particles, [&](std::size_t i) {
+                    acceleration[i] = Vec3(particles.force(i)) * particles.inv_mass[i];
+                });
+            }
+            // Kick half a step, drift, then kick with the acceleration at the new positions.
+            // Velocity dependent forces (damping, drag) see the half-step velocity.
+            for_each_free(particles, [&](std::size_t i) {
+                Vec3 v = particles.velocity(i) + half_h * acceleration[i];
+                particles.set_velocity(i, v);
+                particles.set_position(i, particles.position(i) + h * v);
+            });
+            compute_forces();
+            for_each_free(particles, [&](std::size_t i) {
+                acceleration[i] = Vec3(particles.force(i)) * particles.inv_mass[i];
+                particles.set_velocity(i, particles.velocity(i) + half_h * acceleration[i]);
+            });
+            acceleration_valid = true;
+        }
+
+        float max_angular_frequency(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles,
+                                    float extra_stiffness) {
+            std::vector<float> stiffness(particles.size(), extra_stiffness);
+            for (const primatives::Spring &spring: springs) {
+                stiffness[spring.mass_a] += 2.f * spring.k_s;
+                stiffness[spring.mass_b] += 2.f * spring.k_s;
+            }
+            float omega_squared = 0.f;
+            for (std::size_t i = 0; i < particles.dynamic_count(); ++i) {
+                omega_squared = std::max(omega_squared, stiffness[i] * (float) particles.inv_mass[i]);
+            }
+            return std::sqrt(omega_squared);
+        }
+    } // namespace integrators
+} // namespace simulation
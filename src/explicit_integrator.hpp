@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "integrators.hpp"
+#include "particle_system.hpp"
+#include "spring_table.hpp"
+
+namespace simulation {
+    namespace integrators {
+        //Explicit schemes that only need the forces at a given state: semi-implicit Euler, velocity Verlet,
+        //RK2 (midpoint) and RK4. A model hands in one force callback and the scheme calls it once per stage,
+        //so every scheme shares the model's force pipeline. Scratch state is sized once per particle count.
+        class ExplicitIntegrator {
+        public:
+            // Must overwrite particles.f with the total force at the current positions and velocities
+            using ForceFunction = std::function<void()>;
+
+            // Advances the non-fixed particles by dt. Only the explicit schemes are accepted.
+            void step(Integrator scheme, primatives::ParticleSystem &particles, float dt, const ForceFunction &compute_forces);
+
+            // Velocity Verlet reuses the acceleration of the previous step; call after the state is changed externally
+            void invalidate() { acceleration_valid = false; }
+
+            static bool supports(Integrator scheme);
+            static int force_evaluations(Integrator scheme);   // per step
+            // Largest dt the scheme stays stable at for a highest natural frequency omega (rad/s)
+            static float stable_dt(Integrator scheme, float omega);
+
+        private:
+            void save(const primatives::ParticleSystem &particles);
+            // sums += weight * (v, a) of the current state, then (x, v) = (x0, v0) + h * (sums or (v, a))
+            void stage(primatives::ParticleSystem &particles, float h, float weight, bool from_sums);
+            void step_velocity_verlet(primatives::ParticleSystem &particles, float dt, const ForceFunction &compute_forces);
+
+            using Vec3 = primatives::ParticleSystem::Vec3;
+
+            std::vector<Vec3> x0, v0;             // per mass, state at the start of the step
+            std::vector<Vec3> sum_x, sum_v;       // per mass, RK4 weighted derivative sums
+            std::vector<Vec3> acceleration;       // per mass, velocity Verlet a(t)
+            bool acceleration_valid = false;
+            Integrator last_scheme = Integrator::SemiImplicitEuler;
+        };
+
+        //Upper bound on the highest natural frequency of the springs, sqrt(max_i sum 2 k_s / m_i) over non-fixed
+        //masses (Gershgorin on M^-1 K). extra_stiffness is added at every mass, e.g. a penalty contact.
+        float max_angular_frequency(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles,
+                                    float extra_stiffness = 0.f);
+    } // namespace integrators
+} // namespace simulation
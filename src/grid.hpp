@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+namespace simulation {
+    namespace primatives {
+        //Regular lattice of particles stored contiguously in one ParticleSystem.
+        //Layout is x-major: (x, y, z) -> (x * height + y) * depth + z, so a 2D grid is just depth == 1.
+        struct Grid {
+            int width = 0, height = 0, depth = 1;
+
+            Grid() = default;
+            Grid(int width, int height, int depth = 1) : width(width), height(height), depth(depth) {}
+
+            std::size_t size() const { return (std::size_t) width * height * depth; }
+
+            std::size_t index(int x, int y, int z = 0) const {
+                return ((std::size_t) x * height + y) * depth + z;
+            }
+
+            glm::ivec3 coords(std::size_t i) const {
+                int z = (int) (i % depth);
+                std::size_t xy = i / depth;
+                return {(int) (xy / height), (int) (xy % height), z};
+            }
+
+            bool contains(int x, int y, int z = 0) const {
+                return x >= 0 && x < width && y >= 0 && y < height && z >= 0 && z < depth;
+            }
+        };
+    } // namespace primatives
+} // namespace simulation
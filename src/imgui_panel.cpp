@@ -1,5 +1,9 @@
 #include "imgui_panel.hpp"
 
+#include <algorithm>
+#include <iterator>
+#include <thread>
+
 namespace imgui_panel {
 	// default values
 	bool showPanel = true;
@@ -8,6 +12,7 @@ namespace imgui_panel {
 	int number_of_iterations_per_frame = 1;
 
     float gravity = 9.81f;
+	int thread_count = (int) std::max(std::thread::hardware_concurrency(), 1u);
 
 	//Simulation settings
 	ModelType selected_model_type = ModelType::MassOnSpring;
@@ -19,12 +24,158 @@ namespace imgui_panel {
 	};
 
 
+	const char *time_stepping_name(TimeStepping time_stepping) {
+		switch (time_stepping) {
+		case TimeStepping::RealTime:
+			return "Real Time (accumulator)";
+		case TimeStepping::Adaptive:
+			return "Adaptive dt";
+		default:
+			return "Iterations Per Frame";
+		}
+	}
+
+	ModelSettings settings_per_model[4];
+	ModelSettings &model_settings(ModelType type) {
+		return settings_per_model[(int) type];
+	}
+
+	void draw_prop_settings() {
+		ImGui::InputText("Prop OBJ", prop_file, sizeof(prop_file));
+		ImGui::SliderFloat("Prop Scale", &prop_scale, 0.1f, 20.f);
+		ImGui::SliderFloat("Prop SDF Cell", &prop_cell, 0.02f, 1.f);
+		if (!prop_status.empty()) {
+			ImGui::TextUnformatted(prop_status.c_str());
+		}
+	}
+
+	void draw_model_settings(ModelSettings &settings) {
+		using simulation::forces::Accumulation;
+		if (ImGui::BeginCombo("Force Accumulation", simulation::forces::accumulation_name(settings.force_accumulation))) {
+			for (Accumulation accumulation: {Accumulation::ColouredScatter, Accumulation::GatherCached, Accumulation::GatherRecompute}) {
+				if (ImGui::Selectable(simulation::forces::accumulation_name(accumulation), accumulation == settings.force_accumulation))
+					settings.force_accumulation = accumulation;
+			}
+			ImGui::EndCombo();
+		}
+
+		using simulation::integrators::Integrator;
+		if (ImGui::BeginCombo("Integrator", simulation::integrators::integrator_name(settings.integrator))) {
+			for (Integrator integrator: {Integrator::SemiImplicitEuler, Integrator::VelocityVerlet, Integrator::RK2, Integrator::RK4,
+										 Integrator::MultiRate, Integrator::ImplicitEuler, Integrator::ProjectiveDynamics,
+										 Integrator::XPBD}) {
+				if (ImGui::Selectable(simulation::integrators::integrator_name(integrator), integrator == settings.integrator))
+					settings.integrator = integrator;
+			}
+			ImGui::EndCombo();
+		}
+		if (settings.integrator == Integrator::ImplicitEuler) {
+			ImGui::SliderInt("CG Max Iterations", &settings.cg_max_iterations, 1, 500);
+			ImGui::DragFloat("CG Tolerance", &settings.cg_tolerance, 1.e-6f, 1.e-7f, 1.e-1f, "%.1e");
+		}
+		if (settings.integrator == Integrator::MultiRate) {
+			ImGui::SliderInt("Gravity Rate", &settings.rate_gravity, 1, 50);
+			ImGui::SliderInt("Spring Rate", &settings.rate_springs, 1, 50);
+			if (selected_model_type == ModelType::CubeOfJelly) {
+				ImGui::SliderInt("Collider Contact Rate", &settings.rate_ground, 1, 50);
+			} else {
+				ImGui::SliderInt("Drag Rate", &settings.rate_drag, 1, 50);
+			}
+		}
+		if (settings.integrator == Integrator::ProjectiveDynamics) {
+			ImGui::SliderInt("PD Iterations", &settings.pd_iterations, 1, 50);
+		}
+		if (selected_model_type != ModelType::CubeOfJelly) {
+			ImGui::SliderFloat("Anchor Sway", &settings.anchor_amplitude, 0.f, 10.f);
+			ImGui::SliderFloat("Anchor Sway Frequency", &settings.anchor_frequency, 0.f, 2.f, "%.2f Hz");
+		}
+		if (selected_model_type == ModelType::CubeOfJelly || selected_model_type == ModelType::HangingCloth) {
+			ImGui::Checkbox("Continuous Collision", &settings.continuous_collision);
+		}
+		if (settings.integrator == Integrator::XPBD) {
+			using simulation::integrators::ConstraintSolver;
+			if (ImGui::BeginCombo("XPBD Solver", simulation::integrators::constraint_solver_name(settings.xpbd_solver))) {
+				for (ConstraintSolver solver: {ConstraintSolver::ColouredGaussSeidel, ConstraintSolver::Jacobi}) {
+					if (ImGui::Selectable(simulation::integrators::constraint_solver_name(solver), solver == settings.xpbd_solver))
+						settings.xpbd_solver = solver;
+				}
+				ImGui::EndCombo();
+			}
+			ImGui::SliderInt("XPBD Substeps", &settings.xpbd_substeps, 1, 100);
+			ImGui::SliderInt("XPBD Iterations", &settings.xpbd_iterations, 1, 50);
+			if (settings.xpbd_solver == ConstraintSolver::Jacobi) {
+				ImGui::SliderFloat("Jacobi Relaxation", &settings.xpbd_jacobi_relaxation, 1.f, 4.f);
+			}
+		}
+	}
+
 	bool play_simulation = false;
 	bool reset_simulation = false;
 	bool step_simulation = false;
 	float dt_simulation = 0.001f;
+	TimeStepping time_stepping = TimeStepping::IterationsPerFrame;
+	int max_steps_per_frame = 200;
+	int real_time_steps = 0;
+	float dt_min = 1.e-5f, dt_max = 0.01f;
+	float dt_tolerance = 1.e-3f;
+	float adaptive_dt_current = 0.f;
+	int adaptive_rejected_steps = 0;
+	float sim_seconds_per_second = 0.f;
+	bool sleep_enabled = true;
+	float sleep_threshold = 1.e-3f;
+	float sleep_delay = 0.5f;
+	bool wake_simulation = false;
+	int active_masses = 0, sleeping_masses = 0;
+	int jelly_obstacles = 0;
+	int cloth_resolution[2] = {30, 40};
+	bool cloth_self_collision = false;
+	float cloth_collision_thickness = 0.2f;
+	char prop_file[256] = "";
+	float prop_scale = 1.f;
+	float prop_cell = 0.1f;
+	std::string prop_status;
+	int contacts = 0;
+	float bvh_rebuild_ratio = 1.5f;
+	int bvh_nodes = 0, bvh_rebuilds = 0;
+	float bvh_quality = 1.f;
+	bool rebuild_model = false;
+
+	SimulationSettings current_settings() {
+		SimulationSettings settings;
+		settings.gravity = gravity;
+		std::copy(std::begin(settings_per_model), std::end(settings_per_model), std::begin(settings.models));
+		settings.play_simulation = play_simulation;
+		settings.dt_simulation = dt_simulation;
+		settings.time_stepping = time_stepping;
+		settings.number_of_iterations_per_frame = number_of_iterations_per_frame;
+		settings.max_steps_per_frame = max_steps_per_frame;
+		settings.dt_min = dt_min;
+		settings.dt_max = dt_max;
+		settings.dt_tolerance = dt_tolerance;
+		settings.sleep_enabled = sleep_enabled;
+		settings.sleep_threshold = sleep_threshold;
+		settings.sleep_delay = sleep_delay;
+		settings.cloth_self_collision = cloth_self_collision;
+		settings.cloth_collision_thickness = cloth_collision_thickness;
+		settings.bvh_rebuild_ratio = bvh_rebuild_ratio;
+		return settings;
+	}
+	SimulationSettings published_settings = current_settings();
+	const SimulationSettings &simulation_settings() {
+		return published_settings;
+	}
+	void publish_settings() {
+		published_settings = current_settings();
+	}
+
+	bool run_benchmark = false;
+	bool run_integrator_benchmark = false;
+	bool run_precision_benchmark = false;
+	bool benchmark_running = false;
+	std::string benchmark_report;
 
 	std::function<void(void)> draw = [](void) {
+		wake_simulation = false;
 		if (showPanel && ImGui::Begin("Panel", &showPanel, ImGuiWindowFlags_MenuBar)) {
 			ImGui::Spacing();
 			ImGui::Separator();
@@ -33,6 +184,7 @@ namespace imgui_panel {
 			reset_view = ImGui::Button("Reset View");
 			ImGui::SliderInt("Iterations Per Frame", &number_of_iterations_per_frame, 1, 100);
             ImGui::SliderFloat("Gravity Acceleration", &gravity, 0.0f, 20.0f);
+			ImGui::SliderInt("Threads", &thread_count, 1, (int) std::max(std::thread::hardware_concurrency(), 1u));
 
 			ImGui::Spacing();
 			ImGui::Separator();
@@ -54,29 +206,93 @@ namespace imgui_panel {
 				step_simulation = ImGui::Button("Step Simulation");
 			}
 			ImGui::DragFloat("Simulation dt", &dt_simulation, 1.e-5f, 1.e-5f, 1.f, "%.6e");
+			if (ImGui::BeginCombo("Time Stepping", time_stepping_name(time_stepping))) {
+				for (TimeStepping mode: {TimeStepping::IterationsPerFrame, TimeStepping::RealTime, TimeStepping::Adaptive}) {
+					if (ImGui::Selectable(time_stepping_name(mode), mode == time_stepping))
+						time_stepping = mode;
+				}
+				ImGui::EndCombo();
+			}
+			if (time_stepping == TimeStepping::RealTime) {
+				ImGui::SliderInt("Max Steps Per Frame", &max_steps_per_frame, 1, 2000);
+				ImGui::Text("%d steps last frame%s", real_time_steps,
+					real_time_steps >= max_steps_per_frame ? " (capped, slower than real time)" : "");
+			}
+			if (time_stepping == TimeStepping::Adaptive) {
+				ImGui::DragFloatRange2("dt Limits", &dt_min, &dt_max, 1.e-5f, 1.e-6f, 0.1f, "%.1e", "%.1e");
+				ImGui::DragFloat("Error Tolerance", &dt_tolerance, 1.e-5f, 1.e-6f, 1.f, "%.1e");
+				ImGui::Text("dt %.2e, %d rejected steps, %.2f sim s / wall s",
+					adaptive_dt_current, adaptive_rejected_steps, sim_seconds_per_second);
+			}
+			ImGui::Checkbox("Sleep Resting Islands", &sleep_enabled);
+			if (sleep_enabled) {
+				ImGui::DragFloat("Sleep Threshold", &sleep_threshold, 1.e-5f, 1.e-7f, 1.f, "%.1e");
+				ImGui::SliderFloat("Sleep Delay", &sleep_delay, 0.f, 5.f, "%.2f s");
+			}
+			ImGui::Text("%d active masses, %d sleeping", active_masses, sleeping_masses);
+			if (bvh_nodes > 0) {
+				ImGui::SliderFloat("BVH Rebuild Ratio", &bvh_rebuild_ratio, 1.05f, 4.f);
+				ImGui::Text("Face BVH: %d nodes, SAH cost %.2fx of build, %d rebuilds", bvh_nodes, bvh_quality, bvh_rebuilds);
+			}
 
 			ImGui::Spacing();
 			ImGui::Separator();
 
 			// Any simulation specific functions/IO
+			rebuild_model = false;
 			switch (selected_model_type) {
 			case ModelType::MassOnSpring: {
 				// Maybe mass or spring constents (or gravity is funky)
 			} break;
 			case ModelType::ChainPendulum: {
-				// ...
+				draw_model_settings(model_settings(selected_model_type));
 			} break;
 			case ModelType::CubeOfJelly: {
-				// ...
+				draw_model_settings(model_settings(selected_model_type));
+				ImGui::SliderInt("Obstacles", &jelly_obstacles, 0, 48);
+				draw_prop_settings();
+				rebuild_model = ImGui::Button("Rebuild Jelly");
+				if (model_settings(selected_model_type).continuous_collision) {
+					ImGui::Text("%d impacts", contacts);
+				}
 			} break;
 			case ModelType::HangingCloth: {
-				// ...
+				draw_model_settings(model_settings(selected_model_type));
+				ImGui::SliderInt2("Cloth Resolution", cloth_resolution, 2, 256);
+				draw_prop_settings();
+				rebuild_model = ImGui::Button("Rebuild Cloth");
+				ImGui::Checkbox("Self Collision", &cloth_self_collision);
+				if (cloth_self_collision) {
+					ImGui::SliderFloat("Collision Thickness", &cloth_collision_thickness, 0.01f, 0.5f, "%.2f x spacing");
+				}
+				if (cloth_self_collision || model_settings(selected_model_type).continuous_collision || prop_file[0] != '\0') {
+					ImGui::Text("%d contacts", contacts);
+				}
 			} break;
 			}
 
 			ImGui::Spacing();
 			ImGui::Separator();
 
+			run_benchmark = false;
+			run_integrator_benchmark = false;
+			run_precision_benchmark = false;
+			if (ImGui::CollapsingHeader("Benchmark")) {
+				if (benchmark_running) {
+					ImGui::TextUnformatted("Running...");
+				} else {
+					run_benchmark = ImGui::Button("Benchmark Spring Kernels");
+					ImGui::SameLine();
+					run_integrator_benchmark = ImGui::Button("Benchmark Integrators");
+					ImGui::SameLine();
+					run_precision_benchmark = ImGui::Button("Benchmark Precision");
+					ImGui::TextUnformatted(benchmark_report.c_str());
+				}
+			}
+
+			ImGui::Spacing();
+			ImGui::Separator();
+
 			float frame_rate = ImGui::GetIO().Framerate;
 			ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
 				1000.0f / frame_rate, frame_rate);
@@ -84,6 +300,7 @@ namespace imgui_panel {
 			ImGui::Spacing();
 			ImGui::Separator();
 
+			wake_simulation = ImGui::IsAnyItemActive();
 			ImGui::End();
 		}
 	};
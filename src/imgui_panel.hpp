@@ -4,6 +4,12 @@
 #include <givr.h>
 #include <imgui/imgui.h>
 
+#include <string>
+
+#include "integrators.hpp"
+#include "spring_forces.hpp"
+#include "xpbd.hpp"
+
 namespace imgui_panel {
 	extern bool showPanel;
 	extern ImVec4 clear_color;
@@ -12,6 +18,8 @@ namespace imgui_panel {
 
     extern float gravity;
 
+	extern int thread_count; // threads stepping the simulation, including the main thread
+
 	//Selection Definition
 	enum class ModelType {
 		MassOnSpring,	//Part 1
@@ -20,12 +28,103 @@ namespace imgui_panel {
 		HangingCloth	//Part 4
 	};
 
+	//Per-model solver settings, read by the models every step
+	struct ModelSettings {
+		simulation::forces::Accumulation force_accumulation = simulation::forces::Accumulation::ColouredScatter;
+		simulation::integrators::Integrator integrator = simulation::integrators::Integrator::SemiImplicitEuler;
+		int cg_max_iterations = 100;
+		float cg_tolerance = 1.e-4f;
+		int pd_iterations = 5;
+		simulation::integrators::ConstraintSolver xpbd_solver = simulation::integrators::ConstraintSolver::ColouredGaussSeidel;
+		int xpbd_substeps = 10;
+		int xpbd_iterations = 1;
+		float xpbd_jacobi_relaxation = 2.f;
+		// Multi-rate: evaluations per step of each force type (the highest one sets the number of sub-steps)
+		int rate_gravity = 1;
+		int rate_drag = 1;      // chain and cloth
+		int rate_springs = 10;
+		int rate_ground = 10;   // jelly collider penalty
+		// Scripted anchor motion (chain anchor, cloth corners): sway along x
+		float anchor_amplitude = 0.f;
+		float anchor_frequency = 0.5f; // Hz
+		// Swept collision tests over each step instead of contact at the step's end (jelly and cloth)
+		bool continuous_collision = false;
+	};
+	ModelSettings &model_settings(ModelType type);
+
 	//Simulation settings
 	extern ModelType selected_model_type;
 	extern bool play_simulation;
 	extern bool reset_simulation;
 	extern bool step_simulation;
 	extern float dt_simulation;
+	//How playing advances the simulation every frame
+	enum class TimeStepping {
+		IterationsPerFrame, // number_of_iterations_per_frame steps of dt_simulation
+		RealTime,           // as many dt_simulation steps as real time has passed, rendering interpolated between the last two
+		Adaptive            // number_of_iterations_per_frame * dt_simulation simulated seconds in adaptive steps
+	};
+	const char *time_stepping_name(TimeStepping time_stepping);
+	extern TimeStepping time_stepping;
+	extern int max_steps_per_frame;   // real time: cap against the spiral of death, the sim slows down instead
+	extern int real_time_steps;       // real time: steps taken in the last frame
+	extern float dt_min, dt_max;
+	extern float dt_tolerance;        // position error per step
+	extern float adaptive_dt_current; // reported back by the step controller
+	extern int adaptive_rejected_steps;
+	extern float sim_seconds_per_second;
+	//Rest-state sleeping of quiescent islands
+	extern bool sleep_enabled;
+	extern float sleep_threshold;     // kinetic energy per unit mass below which an island counts as resting
+	extern float sleep_delay;         // seconds an island has to rest before it sleeps
+	extern bool wake_simulation;      // a panel widget is being used this frame
+	extern int active_masses, sleeping_masses;
+	extern int jelly_obstacles;             // colliders scattered under the jelly, besides the ground
+	extern int cloth_resolution[2];
+	extern bool cloth_self_collision;
+	extern float cloth_collision_thickness; // fraction of the cloth's mass spacing
+	//Static OBJ prop the jelly and the cloth collide with, through its baked signed distance field
+	extern char prop_file[256];             // none if empty, loaded when the model is (re)built
+	extern float prop_scale;
+	extern float prop_cell;                 // sample spacing of the distance field
+	extern std::string prop_status;         // size of the loaded field, or why it failed
+	extern int contacts;                    // collision contacts of the last step
+	//Face hierarchy of the jelly and the cloth
+	extern float bvh_rebuild_ratio;         // SAH cost growth over the built tree that triggers a rebuild
+	extern int bvh_nodes, bvh_rebuilds;     // bvh_nodes is 0 for models without faces
+	extern float bvh_quality;
+	extern bool rebuild_model;
+
+	//What the simulation reads of the settings above. The panel is drawn without the simulation lock, so the
+	//simulation works on a copy that the UI thread refreshes with publish_settings() while it holds the lock.
+	struct SimulationSettings {
+		float gravity;
+		ModelSettings models[4];
+		bool play_simulation;
+		float dt_simulation;
+		TimeStepping time_stepping;
+		int number_of_iterations_per_frame;
+		int max_steps_per_frame;
+		float dt_min, dt_max;
+		float dt_tolerance;
+		bool sleep_enabled;
+		float sleep_threshold;
+		float sleep_delay;
+		bool cloth_self_collision;
+		float cloth_collision_thickness;
+		float bvh_rebuild_ratio;
+
+		const ModelSettings &model(ModelType type) const { return models[(int) type]; }
+	};
+	const SimulationSettings &simulation_settings(); // only with the simulation lock held, or on the simulation thread
+	void publish_settings();                          // UI thread, with the simulation lock held
+
+	//Benchmarking
+	extern bool run_benchmark;
+	extern bool run_integrator_benchmark;
+	extern bool run_precision_benchmark;
+	extern bool benchmark_running;          // on the simulation thread, which is paused meanwhile
+	extern std::string benchmark_report;
 
 	// lambda function
 	extern std::function<void(void)> draw;
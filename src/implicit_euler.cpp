@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <cmath>
+
+#include "implicit_euler.hpp"
+#include "thread_pool.hpp"
+
+namespace simulation {
+    namespace integrators {
+        namespace {
+            double dot(const std::vector<glm::vec4> &a, const std::vector<glm::vec4> &b) {
+                double sum = 0.0;
+                for (std::size_t i = 0; i < a.size(); ++i) {
+                    sum += (double) glm::dot(a[i], b[i]);
+                }
+                return sum;
+            }
+
+            glm::mat3 diagonal(const glm::vec3 &d) {
+                return glm::mat3(d.x, 0.f, 0.f, 0.f, d.y, 0.f, 0.f, 0.f, d.z);
+            }
+
+            glm::vec4 apply(const glm::mat3 &m, const glm::vec4 &v) {
+                return glm::vec4(m * glm::vec3(v), 0.f);
+            }
+        }
+
+        void ImplicitEuler::build(const primatives::SpringTable &springs, std::size_t mass_count) {
+            matrix.build(springs, mass_count);
+            preconditioner.assign(mass_count, glm::mat3(1.f));
+            diagonal_stiffness.assign(mass_count, glm::vec3(0.f));
+            diagonal_damping.assign(mass_count, glm::vec3(0.f));
+            rhs.assign(mass_count, glm::vec4(0.f));
+            dv.assign(mass_count, glm::vec4(0.f));
+            r.assign(mass_count, glm::vec4(0.f));
+            z.assign(mass_count, glm::vec4(0.f));
+            p.assign(mass_count, glm::vec4(0.f));
+            q.assign(mass_count, glm::vec4(0.f));
+        }
+
+        void ImplicitEuler::assemble_springs(const primatives::SpringTable &springs,
+                                             const primatives::ParticleSystem &particles, float h,
+                                             std::size_t begin, std::size_t end) {
+            // df_a/dx_a = -K, df_a/dx_b = K and df_a/dv_a = -k_d I, df_a/dv_b = k_d I
+            for (std::size_t s = begin; s < end; ++s) {
+                const primatives::Spring &spring = springs[s];
+                const std::uint32_t a = spring.mass_a, b = spring.mass_b;
+                const bool fixed_a = particles.fixed(a), fixed_b = particles.fixed(b);
+                if (fixed_a && fixed_b) continue;
+
+                glm::vec3 d = particles.position(b) - particles.position(a);
+                float l = glm::length(d);
+                glm::mat3 K(0.f);
+                if (l > 0.f) {
+                    glm::vec3 n = d / l;
+                    glm::mat3 nn = glm::outerProduct(n, n);
+                    float transverse = std::max(0.f, 1.f - spring.rest_l / l);
+                    K = spring.k_s * (nn + transverse * (glm::mat3(1.f) - nn));
+                }
+                glm::mat3 block = h * h * K + glm::mat3(h * spring.k_d);
+
+                glm::vec4 h2_kv = glm::vec4(h * h * (K * (particles.velocity(a) - particles.velocity(b))), 0.f);
+                const SpringSystemMatrix::SpringSlots &slots = matrix.spring_slots(s);
+                if (!fixed_a) {
+                    matrix.add_block(slots.aa, block);
+                    rhs[a] -= h2_kv;
+                }
+                if (!fixed_b) {
+                    matrix.add_block(slots.bb, block);
+                    rhs[b] += h2_kv;
+                }
+                if (!fixed_a && !fixed_b) {
+                    matrix.add_block(slots.ab, -block);
+                    matrix.add_block(slots.ba, -block);
+                }
+            }
+        }
+
+        void ImplicitEuler::assemble(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles,
+                                     float h) {
+            threading::ThreadPool &pool = threading::pool();
+            matrix.set_zero();
+
+            // Mass and penalty terms, rhs = h f - h^2 K_pen v (the penalty's h^2 df/dx v, as the springs add below)
+            pool.parallel_for(0, particles.size(), 1024, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    if (particles.fixed(i)) {
+                        matrix.set_block(matrix.diagonal_slot(i), glm::mat3((float) particles.mass(i)));
+                        rhs[i] = glm::vec4(0.f);
+                        continue;
+                    }
+                    matrix.set_block(matrix.diagonal_slot(i), glm::mat3((float) particles.mass(i))
+                                     + diagonal(h * h * diagonal_stiffness[i] + h * diagonal_damping[i]));
+                    rhs[i] = glm::vec4(h * glm::vec3(particles.force(i))
+                                       - h * h * diagonal_stiffness[i] * glm::vec3(particles.velocity(i)), 0.f);
+                }
+            });
+
+            // Springs; within a colour batch no two springs share a mass, so their blocks and rhs rows are disjoint
+            if (springs.coloured()) {
+                for (std::size_t c = 0; c < springs.colour_count(); ++c) {
+                    pool.parallel_for(springs.colour_begin(c), springs.colour_end(c), 2048,
+                                      [&](std::size_t begin, std::size_t end) {
+                                          assemble_springs(springs, particles, h, begin, end);
+                                      });
+                }
+            } else {
+                assemble_springs(springs, particles, h, 0, springs.size());
+            }
+
+            pool.parallel_for(0, particles.size(), 1024, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    preconditioner[i] = glm::inverse(matrix.block(matrix.diagonal_slot(i)));
+                }
+            });
+        }
+
+        void ImplicitEuler::solve() {
+            const std::size_t n = rhs.size();
+            iterations = 0;
+            residual = 0.f;
+
+            double rhs_norm = std::sqrt(dot(rhs, rhs));
+            if (rhs_norm == 0.0) {
+                std::fill(dv.begin(), dv.end(), glm::vec4(0.f));
+                return;
+            }
+
+            // Warm start from the previous dv
+            matrix.multiply(dv, q);
+            for (std::size_t i = 0; i < n; ++i) {
+                r[i] = rhs[i] - q[i];
+                z[i] = apply(preconditioner[i], r[i]);
+                p[i] = z[i];
+            }
+            double rz = dot(r, z);
+            double threshold = (double) tolerance * rhs_norm;
+
+            for (; iterations < max_iterations; ++iterations) {
+                double r_norm = std::sqrt(dot(r, r));
+                residual = (float) (r_norm / rhs_norm);
+                if (r_norm <= threshold) break;
+
+                matrix.multiply(p, q);
+                double pq = dot(p, q);
+                if (pq <= 0.0) break;
+                float alpha = (float) (rz / pq);
+                for (std::size_t i = 0; i < n; ++i) {
+                    dv[i] += alpha * p[i];
+                    r[i] -= alpha * q[i];
+                    z[i] = apply(preconditioner[i], r[i]);
+                }
+                double rz_next = dot(r, z);
+                float beta = (float) (rz_next / rz);
+                rz = rz_next;
+                for (std::size_t i = 0; i < n; ++i) {
+                    p[i] = z[i] + beta * p[i];
+                }
+            }
+        }
+
+        void ImplicitEuler::step(const primatives::SpringTable &springs, primatives::ParticleSystem &particles, float dt) {
+            if (matrix.rows() != particles.size()) build(springs, particles.size());
+
+            assemble(springs, particles, dt);
+            solve();
+
+            std::fill(diagonal_stiffness.begin(), diagonal_stiffness.end(), glm::vec3(0.f));
+            std::fill(diagonal_damping.begin(), diagonal_damping.end(), glm::vec3(0.f));
+            for (std::size_t i = 0; i < particles.dynamic_count(); ++i) {
+                particles.vx[i] += dv[i].x;
+                particles.vy[i] += dv[i].y;
+                particles.vz[i] += dv[i].z;
+                particles.px[i] += particles.vx[i] * dt;
+                particles.py[i] += particles.vy[i] * dt;
+                particles.pz[i] += particles.vz[i] * dt;
+            }
+        }
+    } // namespace integrators
+} // namespace simulation
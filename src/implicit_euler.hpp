@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "particle_system.hpp"
+#include "spring_system_matrix.hpp"
+#include "spring_table.hpp"
+
+namespace simulation {
+    namespace integrators {
+        //Linearised backward Euler for spring networks (Baraff & Witkin, "Large Steps in Cloth Simulation").
+        //Each step solves
+        //      (M - h df/dv - h^2 df/dx) dv = h (f + h df/dx v)
+        //for the velocity change dv with block-Jacobi preconditioned conjugate gradients, warm-started from
+        //the previous step's dv, then sets v += dv and x += h v. The spring Jacobian is refilled in place into
+        //a SpringSystemMatrix (per colour batch in parallel when the table is coloured); its transverse term is
+        //clamped for compressed springs so the system stays positive definite. Fixed particles are constrained
+        //to dv = 0. Once built, a step allocates nothing.
+        class ImplicitEuler {
+        public:
+            // Computes the matrix pattern and resets the warm start; must be called again when the springs change
+            void build(const primatives::SpringTable &springs, std::size_t mass_count);
+
+            // Stiffness -df/dx and damping -df/dv (per axis) of a penalty force on mass i, e.g. ground contact.
+            // Only used by the next step(). Calls for different masses may come from different threads.
+            void add_diagonal(std::size_t i, const glm::vec3 &stiffness, const glm::vec3 &damping) {
+                diagonal_stiffness[i] += stiffness;
+                diagonal_damping[i] += damping;
+            }
+
+            // particles.f must hold the total force (springs and external) at the current state
+            void step(const primatives::SpringTable &springs, primatives::ParticleSystem &particles, float dt);
+
+            int max_iterations = 100;
+            float tolerance = 1e-4f;    // on |residual| / |rhs|
+
+            int last_iterations() const { return iterations; }
+            float last_residual() const { return residual; }
+
+        private:
+            void assemble(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles, float h);
+            void assemble_springs(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles,
+                                  float h, std::size_t begin, std::size_t end);
+            void solve();
+
+            SpringSystemMatrix matrix;
+            std::vector<glm::mat3> preconditioner;  // inverse diagonal blocks
+
+            std::vector<glm::vec3> diagonal_stiffness, diagonal_damping;
+            std::vector<glm::vec4> rhs, dv, r, z, p, q;    // w = 0
+
+            int iterations = 0;
+            float residual = 0.f;
+        };
+    } // namespace integrators
+} // namespace simulation
@@ -0,0 +1,26 @@
+#include "integrators.hpp"
+
+namespace simulation {
+    namespace integrators {
+        const char *integrator_name(Integrator integrator) {
+            switch (integrator) {
+                case Integrator::ImplicitEuler:
+                    return "Implicit Euler (CG)";
+                case Integrator::ProjectiveDynamics:
+                    return "Projective Dynamics";
+                case Integrator::XPBD:
+                    return "XPBD";
+                case Integrator::VelocityVerlet:
+                    return "Velocity Verlet";
+                case Integrator::RK2:
+                    return "RK2 (midpoint)";
+                case Integrator::RK4:
+                    return "RK4";
+                case Integrator::MultiRate:
+                    return "Multi-rate (sub-stepped)";
+                default:
+                    return "Semi-implicit Euler";
+            }
+        }
+    } // namespace integrators
+} // namespace simulation
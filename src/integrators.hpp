@@ -0,0 +1,18 @@
+#pragma once
+
+namespace simulation {
+    namespace integrators {
+        //Time integration schemes a spring model can be stepped with
+        enum class Integrator {
+            SemiImplicitEuler,  // explicit forces, v then x (ParticleSystem::integrate)
+            ImplicitEuler,      // linearised backward Euler, see ImplicitEuler
+            ProjectiveDynamics, // local/global spring projection, see ProjectiveDynamics
+            XPBD,               // compliant distance constraints with sub-stepping, see XPBD
+            VelocityVerlet,     // explicit, second order, one force evaluation per step, see ExplicitIntegrator
+            RK2,                // explicit midpoint, two force evaluations per step
+            RK4,                // classic Runge-Kutta, four force evaluations per step
+            MultiRate           // semi-implicit Euler sub-steps, each force type at its own rate, see MultiRate
+        };
+        const char *integrator_name(Integrator integrator);
+    } // namespace integrators
+} // namespace simulation
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <numeric>
+
+#include "island_sleep.hpp"
+
+namespace simulation {
+    namespace integrators {
+        namespace {
+            // Union-find root with path halving
+            std::uint32_t find(std::vector<std::uint32_t> &parent, std::uint32_t i) {
+                while (parent[i] != i) {
+                    parent[i] = parent[parent[i]];
+                    i = parent[i];
+                }
+                return i;
+            }
+        }
+
+        void IslandSleep::build(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles) {
+            const std::size_t n = particles.size();
+            std::vector<std::uint32_t> parent(n), size(n, 1);
+            std::iota(parent.begin(), parent.end(), 0u);
+            for (const primatives::Spring &spring: springs) {
+                if (particles.fixed(spring.mass_a) || particles.fixed(spring.mass_b)) continue;
+                std::uint32_t a = find(parent, spring.mass_a), b = find(parent, spring.mass_b);
+                if (a == b) continue;
+                if (size[a] < size[b]) std::swap(a, b);
+                parent[b] = a;
+                size[a] += size[b];
+            }
+
+            // Number the roots densely
+            island_of.assign(n, none);
+            island_size.clear();
+            dynamic_mass_count = 0;
+            std::vector<std::uint32_t> island_of_root(n, none);
+            for (std::size_t i = 0; i < n; ++i) {
+                if (particles.fixed(i)) continue;
+                std::uint32_t root = find(parent, (std::uint32_t) i);
+                if (island_of_root[root] == none) {
+                    island_of_root[root] = (std::uint32_t) island_size.size();
+                    island_size.push_back(0);
+                }
+                island_of[i] = island_of_root[root];
+                island_size[island_of[i]]++;
+                dynamic_mass_count++;
+            }
+
+            rest.assign(n, primatives::ParticleSystem::Vec3(0));
+            peak_energy.assign(island_size.size(), 0.f);
+            woken = std::vector<std::atomic<char>>(island_size.size());
+            wake_all();
+        }
+
+        void IslandSleep::update(primatives::ParticleSystem &particles, float dt) {
+            if (island_of.size() != particles.size()) return;
+            if (!enabled) {
+                if (sleeping_island_count != 0) wake_all();
+                return;
+            }
+
+            // Contacts of this step first, so a woken island keeps where the step took it
+            for (std::uint32_t island = 0; island < island_size.size(); ++island) {
+                if (woken[island].exchange(0, std::memory_order_relaxed)) wake_island(island);
+            }
+
+            std::fill(peak_energy.begin(), peak_energy.end(), 0.f);
+            for (std::size_t i = 0; i < particles.size(); ++i) {
+                std::uint32_t island = island_of[i];
+                if (island == none) continue;
+                if (asleep[island]) {
+                    particles.set_position(i, rest[i]);
+                    particles.set_velocity(i, primatives::ParticleSystem::Vec3(0));
+                    continue;
+                }
+                float v2 = (float) (particles.vx[i] * particles.vx[i] + particles.vy[i] * particles.vy[i] +
+                                    particles.vz[i] * particles.vz[i]);
+                peak_energy[island] = std::max(peak_energy[island], 0.5f * v2);
+            }
+
+            for (std::uint32_t island = 0; island < island_size.size(); ++island) {
+                if (asleep[island]) continue;
+                quiet_time[island] = peak_energy[island] < threshold ? quiet_time[island] + dt : 0.f;
+                if (quiet_time[island] >= delay) fall_asleep(island, particles);
+            }
+        }
+
+        void IslandSleep::fall_asleep(std::uint32_t island, primatives::ParticleSystem &particles) {
+            asleep[island] = 1;
+            sleeping_island_count++;
+            sleeping_mass_count += island_size[island];
+            for (std::size_t i = 0; i < particles.size(); ++i) {
+                if (island_of[i] != island) continue;
+                rest[i] = particles.position(i);
+                particles.set_velocity(i, primatives::ParticleSystem::Vec3(0));
+            }
+        }
+
+        void IslandSleep::wake_all() {
+            quiet_time.assign(island_size.size(), 0.f);
+            asleep.assign(island_size.size(), 0);
+            sleeping_mass_count = 0;
+            sleeping_island_count = 0;
+            for (std::atomic<char> &flag: woken) flag.store(0, std::memory_order_relaxed);
+        }
+
+        void IslandSleep::wake_on_contact(std::size_t mass, float approach_speed) {
+            if (!enabled || approach_speed <= 0.f || 0.5f * approach_speed * approach_speed <= threshold) return;
+            if (mass >= island_of.size() || island_of[mass] == none) return;
+            woken[island_of[mass]].store(1, std::memory_order_relaxed);
+        }
+
+        void IslandSleep::wake_island(std::uint32_t island) {
+            quiet_time[island] = 0.f;
+            if (!asleep[island]) return;
+            asleep[island] = 0;
+            sleeping_island_count--;
+            sleeping_mass_count -= island_size[island];
+        }
+    } // namespace integrators
+} // namespace simulation
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "particle_system.hpp"
+#include "spring_table.hpp"
+
+namespace simulation {
+    namespace integrators {
+        //Rest-state deactivation. Islands are the connected components of the spring graph over the non-fixed
+        //masses (a pinned mass never moves, so it does not join the islands hanging off it).
+        //An island whose largest kinetic energy per unit mass stays below `threshold` for `delay` simulated seconds
+        //falls asleep: its velocities are zeroed and it is held at its rest positions until woken.
+        //Models skip their step entirely while every island sleeps. An island asleep next to awake ones still goes
+        //through the force and integration passes and is put back at rest after the step, so sleep only saves
+        //work once the whole model rests.
+        //Contact passes wake an island when a contact hits it harder than the sleep threshold; resting contact
+        //(the ground under a settled jelly) carries no approach speed and leaves it asleep.
+        class IslandSleep {
+        public:
+            void build(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles);
+
+            // False once every island sleeps, i.e. stepping the model would not move anything
+            bool any_awake() const { return !enabled || sleeping_island_count < island_size.size(); }
+            // After a step: holds the sleeping islands in place and advances the rest timers of the awake ones
+            void update(primatives::ParticleSystem &particles, float dt);
+
+            void wake_all();
+            // Wakes the island of mass at the next update() if the contact's kinetic energy per unit mass,
+            // 0.5 approach_speed^2, is above threshold (no-op for fixed masses). Safe from parallel contact passes
+            void wake_on_contact(std::size_t mass, float approach_speed);
+
+            std::size_t island_count() const { return island_size.size(); }
+            std::size_t sleeping_islands() const { return sleeping_island_count; }
+            std::size_t sleeping_masses() const { return sleeping_mass_count; }
+            std::size_t active_masses() const { return dynamic_mass_count - sleeping_mass_count; }
+
+            bool enabled = true;
+            float threshold = 1.e-3f; // 0.5 |v|^2, kinetic energy per unit mass
+            float delay = 0.5f;       // seconds an island has to stay below threshold
+
+        private:
+            static constexpr std::uint32_t none = ~0u;
+
+            void fall_asleep(std::uint32_t island, primatives::ParticleSystem &particles);
+            void wake_island(std::uint32_t island);
+
+            std::vector<std::uint32_t> island_of;   // per mass, none for fixed masses
+            std::vector<std::uint32_t> island_size; // per island, masses
+            std::vector<float> quiet_time;          // per island, seconds spent below threshold
+            std::vector<float> peak_energy;         // per island, scratch of update()
+            std::vector<char> asleep;               // per island
+            std::vector<std::atomic<char>> woken;   // per island, hit by a contact since the last update()
+            std::vector<primatives::ParticleSystem::Vec3> rest; // per mass, where a sleeping island is held
+            std::size_t dynamic_mass_count = 0, sleeping_mass_count = 0, sleeping_island_count = 0;
+        };
+    } // namespace integrators
+} // namespace simulation
@@ -0,0 +1,48 @@
+#include <cassert>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "kinematic_constraints.hpp"
+
+namespace simulation {
+    namespace primatives {
+        std::size_t KinematicConstraints::add_frame(Motion motion) {
+            motions.push_back(std::move(motion));
+            return motions.size() - 1;
+        }
+
+        void KinematicConstraints::attach(std::size_t mass, std::size_t frame, const glm::vec3 &offset) {
+            assert(frame < motions.size());
+            masses.push_back((std::uint32_t) mass);
+            frames.push_back((std::uint32_t) frame);
+            offsets.push_back(offset);
+        }
+
+        void KinematicConstraints::animate(std::size_t mass, const std::function<glm::vec3(float t)> &path) {
+            attach(mass, add_frame([path](float t) { return glm::translate(glm::mat4(1.f), path(t)); }), glm::vec3(0.f));
+        }
+
+        bool KinematicConstraints::update(ParticleSystem &particles, float t, float dt) {
+            // Every frame once, then every mass against its frame
+            current.resize(motions.size());
+            next.resize(motions.size());
+            for (std::size_t f = 0; f < motions.size(); ++f) {
+                current[f] = motions[f] ? motions[f](t) : glm::mat4(1.f);
+                next[f] = motions[f] ? motions[f](t + dt) : current[f];
+            }
+
+            bool moved = false;
+            const float inv_dt = dt > 0.f ? 1.f / dt : 0.f;
+            for (std::size_t k = 0; k < masses.size(); ++k) {
+                const std::uint32_t i = masses[k];
+                glm::vec3 target = glm::vec3(current[frames[k]] * glm::vec4(offsets[k], 1.f));
+                glm::vec3 ahead = glm::vec3(next[frames[k]] * glm::vec4(offsets[k], 1.f));
+                moved = moved || target != glm::vec3(particles.position(i));
+                particles.set_position(i, ParticleSystem::Vec3(target));
+                particles.set_velocity(i, ParticleSystem::Vec3((ahead - target) * inv_dt));
+                particles.set_force(i, ParticleSystem::ForceVec3(0));
+            }
+            return moved;
+        }
+    } // namespace primatives
+} // namespace simulation
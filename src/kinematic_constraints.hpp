@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "particle_system.hpp"
+
+namespace simulation {
+    namespace primatives {
+        //Masses moved by script instead of by forces: pinned in place, following a path, or rigidly attached to a
+        //moving frame. They belong in the constrained tail of the ParticleSystem (see ParticleSystem::partition)
+        //so the force and integration passes skip them without a per-particle test; update() places all of them
+        //in one pass per step.
+        class KinematicConstraints {
+        public:
+            //Rigid motion of a frame, local to world at time t
+            using Motion = std::function<glm::mat4(float t)>;
+            static constexpr std::size_t world = 0; // static frame every constraint set starts with
+
+            KinematicConstraints() : motions(1) {}
+
+            // New frame; masses attached to the same frame move as one rigid body
+            std::size_t add_frame(Motion motion);
+            // Constrains mass to sit at offset in frame
+            void attach(std::size_t mass, std::size_t frame, const glm::vec3 &offset);
+            void pin(std::size_t mass, const glm::vec3 &position) { attach(mass, world, position); }
+            // Moves mass along path(t), in a frame of its own
+            void animate(std::size_t mass, const std::function<glm::vec3(float t)> &path);
+
+            // Places every constrained mass at its target for time t, gives it the velocity that reaches the target
+            // for t + dt and clears its force (the springs scatter their reaction into it during the step).
+            // Returns true if any constrained mass moved.
+            bool update(ParticleSystem &particles, float t, float dt);
+
+            std::size_t size() const { return masses.size(); }
+
+        private:
+            std::vector<Motion> motions;             // per frame, empty for static frames
+            std::vector<glm::mat4> current, next;    // per frame, scratch of update()
+            std::vector<std::uint32_t> masses, frames;
+            std::vector<glm::vec3> offsets;
+        };
+    } // namespace primatives
+} // namespace simulation
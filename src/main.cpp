@@ -1,6 +1,19 @@
 ﻿#include "givio.h"
 #include "givr.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include <glm/gtc/matrix_transform.hpp>
 
 #define GLM_ENABLE_EXPERIMENTAL
@@ -12,6 +25,10 @@
 
 #include "models.hpp"
 #include "imgui_panel.hpp"
+#include "simulation_thread.hpp"
+#include "step_controller.hpp"
+#include "thread_pool.hpp"
+#include "triple_buffer.hpp"
 
 using namespace giv;
 using namespace giv::io;
@@ -20,8 +37,101 @@ using namespace givr::camera;
 using namespace givr::geometry;
 using namespace givr::style;
 
+using Clock = std::chrono::steady_clock;
+
+// State handed from the simulation thread to the renderer
+struct RenderSnapshot {
+	std::vector<glm::vec3> current;
+	std::vector<glm::vec3> previous;  // before the last step, real time only
+	bool interpolate = false;
+	Clock::time_point due;            // wall time the current state belongs to (real time)
+	float dt = 0.f;
+	std::uint64_t generation = 0;     // model_generation the positions were taken from
+};
+
+// Step statistics handed from the simulation thread to the panel
+struct StepStats {
+	int real_time_steps = 0;
+	float adaptive_dt = 0.f;
+	int rejected_steps = 0;
+	float sim_seconds_per_second = 0.f;
+};
+
+// One line summary of a prop's distance field
+std::string describe_prop(const simulation::models::Prop &prop) {
+	char text[160];
+	std::snprintf(text, sizeof(text), "%zu triangles, %zu of %zu bricks, %.1f MB (%s)", prop.mesh.triangles.size(),
+		prop.sdf->brick_count(), prop.sdf->total_bricks(), (double) prop.sdf->memory() / (1024.0 * 1024.0),
+		!prop.baked ? "cached" : prop.saved ? "baked" : "baked, could not write the cache");
+	return text;
+}
+
+// The prop set in the panel, loaded on a background thread since baking its distance field can take seconds.
+// UI thread only.
+class PanelProp {
+public:
+	// True once the prop for the panel's current settings is loaded, starts loading it otherwise
+	bool ready() {
+		if (job.valid()) {
+			if (job.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+			loaded = job.get();
+			imgui_panel::prop_status = loaded ? describe_prop(*loaded) : "No triangles in " + file;
+		}
+		if (file == imgui_panel::prop_file && scale == imgui_panel::prop_scale && cell == imgui_panel::prop_cell) return true;
+
+		file = imgui_panel::prop_file;
+		scale = imgui_panel::prop_scale;
+		cell = imgui_panel::prop_cell;
+		loaded = nullptr;
+		imgui_panel::prop_status.clear();
+		if (file.empty()) return true;
+		imgui_panel::prop_status = "Loading " + file + "...";
+		job = std::async(std::launch::async, simulation::models::load_prop, file, scale, cell);
+		return false;
+	}
+	bool loading() const { return job.valid(); }
+	// nullptr if there is none or it failed to load
+	std::shared_ptr<const simulation::models::Prop> get() const { return loaded; }
+
+private:
+	std::string file;
+	float scale = 0.f, cell = 0.f;
+	std::shared_ptr<const simulation::models::Prop> loaded;
+	std::future<std::shared_ptr<const simulation::models::Prop>> job;
+};
+
 // program entry point
-int main(void) {
+int main(int argc, char *argv[]) {
+	// command line: --threads N (or -t N) sets the simulation thread count,
+	// --bake-sdf OBJ [SCALE [CELL]] bakes the prop's distance field into OBJ.sdf and exits
+	std::string bake_file;
+	float bake_scale = 1.f, bake_cell = imgui_panel::prop_cell;
+	for (int i = 1; i + 1 < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--threads" || arg == "-t") {
+			imgui_panel::thread_count = std::max(std::atoi(argv[++i]), 1);
+		} else if (arg == "--bake-sdf") {
+			bake_file = argv[++i];
+			if (i + 1 < argc && argv[i + 1][0] != '-') bake_scale = (float) std::atof(argv[++i]);
+			if (i + 1 < argc && argv[i + 1][0] != '-') bake_cell = std::max((float) std::atof(argv[++i]), 1.e-3f);
+		}
+	}
+	simulation::threading::pool().resize((unsigned) imgui_panel::thread_count);
+
+	if (!bake_file.empty()) {
+		auto prop = simulation::models::load_prop(bake_file, bake_scale, bake_cell);
+		if (!prop) {
+			std::cerr << "No triangles in " << bake_file << '\n';
+			return EXIT_FAILURE;
+		}
+		std::cout << prop->cache_path << ": " << describe_prop(*prop) << '\n';
+		if (!prop->saved) {
+			std::cerr << "Could not write " << prop->cache_path << '\n';
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
 	// initialize OpenGL and window
 	GLFWContext glContext;
 	glContext.glMajorVesion(3)
@@ -37,9 +147,6 @@ int main(void) {
 		.size(dimensions{ 1000, 1000 })
 		.title("Mass Spring Systems")
 		.glslVersionString("#version 330 core"));
-	// set our imgui update function
-	panel::update_lambda_function = imgui_panel::draw;
-
 	ViewContext view = View(TurnTable(), Perspective());
 	TurnTableControls controls(window, view.camera);
 
@@ -56,57 +163,261 @@ int main(void) {
 		| Key(GLFW_KEY_ESCAPE, close_window_routine);
 
 	// Models
+	// Everything below up to the snapshots is owned by the simulation thread while it runs a step:
+	// the render thread only touches it with simulation_thread.lock() held. The panel's settings reach the
+	// simulation through imgui_panel::publish_settings(), its statistics go back through `stats`.
 	imgui_panel::ModelType model_type = imgui_panel::ModelType::MassOnSpring;
 	std::unique_ptr<simulation::models::GenericModel> model
 		= std::make_unique<simulation::models::MassOnSpringModel>();
+	std::uint64_t model_generation = 1; // bumped whenever the particles jump (new model, rebuild, reset)
+	simulation::integrators::StepController step_controller;
+	int pending_steps = 0;              // "Step Simulation" presses not yet simulated
+	int steps_since_publish = 0;
+	// Real time stepping: the simulated clock is anchored at `origin` and runs behind the wall clock by less than a step
+	bool restart_clock = true;
+	Clock::time_point origin;
+	double simulated_time = 0.0;
+	int real_time_batch = 0;
+	std::vector<glm::vec3> previous_positions;
+	StepStats stats;
+	// A benchmark runs as one (long) unit of simulation work; the render thread skips the lock meanwhile
+	std::function<std::string()> benchmark;
+	std::string benchmark_result;
+	std::atomic<bool> benchmarking{false}; // set by the render thread with the lock held, cleared once done
+
+	simulation::threading::TripleBuffer<RenderSnapshot> snapshots;
+	auto publish = [&](bool interpolate, float dt) {
+		RenderSnapshot &snapshot = snapshots.back();
+		model->particle_state().copy_positions(snapshot.current);
+		if (interpolate) {
+			snapshot.previous = previous_positions;
+		}
+		snapshot.interpolate = interpolate;
+		snapshot.due = origin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(simulated_time));
+		snapshot.dt = dt;
+		snapshot.generation = model_generation;
+		snapshots.publish();
+		steps_since_publish = 0;
+	};
+
+	// One unit of simulation work (about one step), run on the simulation thread. Returns false when idle.
+	auto simulate = [&]() -> bool {
+		if (benchmark) {
+			benchmark_result = benchmark();
+			benchmark = nullptr;
+			benchmarking.store(false);
+			return true;
+		}
+
+		const imgui_panel::SimulationSettings &settings = imgui_panel::simulation_settings();
+		float dt = settings.dt_simulation;
+		if (settings.play_simulation && settings.time_stepping == imgui_panel::TimeStepping::RealTime) {
+			// Free the physics: step while the simulated clock is a full step behind the wall clock, at most
+			// max_steps_per_frame steps between snapshots; time beyond that is dropped so the sim slows down instead
+			Clock::time_point now = Clock::now();
+			if (restart_clock) {
+				origin = now;
+				simulated_time = 0.0;
+				real_time_batch = 0;
+				restart_clock = false;
+			}
+			double owed = std::chrono::duration<double>(now - origin).count() - simulated_time;
+			double cap = (double) dt * settings.max_steps_per_frame;
+			if (owed > cap) {
+				origin += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(owed - cap));
+				owed = cap;
+			}
+			if (owed < dt) return false;
+			bool last = owed < 2.0 * dt || real_time_batch + 1 >= settings.max_steps_per_frame;
+			if (last) {
+				model->particle_state().copy_positions(previous_positions);
+			}
+			model->step(dt);
+			simulated_time += dt;
+			++real_time_batch;
+			if (last) {
+				stats.real_time_steps = real_time_batch;
+				real_time_batch = 0;
+				publish(true, dt);
+			}
+			return true;
+		}
+
+		restart_clock = true;
+		if (settings.time_stepping == imgui_panel::TimeStepping::Adaptive) {
+			// dt_simulation of simulated time per chunk, covered by as many adaptive steps as it takes, one per unit
+			if (step_controller.idle()) {
+				if (!settings.play_simulation && pending_steps == 0) return false;
+				step_controller.dt_min = settings.dt_min;
+				step_controller.dt_max = settings.dt_max;
+				step_controller.tolerance = settings.dt_tolerance;
+				step_controller.stable_dt = model->stable_dt();
+				step_controller.schedule(dt);
+				if (!settings.play_simulation) {
+					--pending_steps;
+				}
+			}
+			step_controller.attempt(model->particle_state(),
+				[&](float h) { model->step(h); }, [&] { model->state_restored(); });
+			stats.adaptive_dt = step_controller.dt();
+			stats.rejected_steps = step_controller.rejected_steps();
+			stats.sim_seconds_per_second = (float) step_controller.sim_seconds_per_second();
+			if (!step_controller.idle()) return true;
+		} else {
+			if (!settings.play_simulation && pending_steps == 0) return false;
+			model->step(dt);
+			if (!settings.play_simulation) {
+				--pending_steps;
+			}
+		}
+		// Playing: publish every number_of_iterations_per_frame steps (or adaptive chunks)
+		if (!settings.play_simulation || ++steps_since_publish >= settings.number_of_iterations_per_frame) {
+			publish(false, dt);
+		}
+		return true;
+	};
+	simulation::threading::SimulationThread simulation_thread(simulate);
+
+	// set our imgui update function (drawn without the simulation lock, the simulation reads published settings)
+	panel::update_lambda_function = imgui_panel::draw;
+
+	PanelProp panel_prop;
+	bool rebuild_pending = false; // "Rebuild" pressed, waiting for the prop to load
+	auto takes_prop = [](imgui_panel::ModelType type) {
+		return type == imgui_panel::ModelType::CubeOfJelly || type == imgui_panel::ModelType::HangingCloth;
+	};
+
+	const RenderSnapshot *snapshot = nullptr;
+	std::vector<glm::vec3> fallback_positions, render_positions;
 
 	// main loop
-	mainloop(std::move(window), [&](float /*dt - Time since last frame. You should start by using imgui_panel::dt and only use this under the "Free the Physics" time step scheme */) {
+	mainloop(std::move(window), [&](float /*dt - Time since last frame, the simulation thread keeps its own clock*/) {
 		// updates from panel
 		if (imgui_panel::reset_view) {
 			view.camera.reset();
 		}
 
-		// Change simulation model
-		if (model_type != imgui_panel::selected_model_type) {
-			model_type = imgui_panel::selected_model_type;
-			imgui_panel::play_simulation = false; //For safety reasons, stop simulation
-			switch (model_type) {
-			case imgui_panel::ModelType::MassOnSpring: {
-				model = std::make_unique<simulation::models::MassOnSpringModel>();
-				imgui_panel::dt_simulation = 0.001f; //Good idea to hard-code a good dt for each simulation
-			}break;
-			case imgui_panel::ModelType::ChainPendulum: {
-				model = std::make_unique<simulation::models::ChainPendulumModel>();
-				imgui_panel::dt_simulation = 0.001f; //Good idea to hard-code a good dt for each simulation
-			}break;
-			case imgui_panel::ModelType::CubeOfJelly: {
-				//TO-DO: Fill
-                model = std::make_unique<simulation::models::CubeOfJellyModel>();
-                imgui_panel::dt_simulation = 0.001f;
-			}break;
-			case imgui_panel::ModelType::HangingCloth: {
-				//TO-DO: Fill
-                model = std::make_unique<simulation::models::HangingClothModel>();
-                imgui_panel::dt_simulation = 0.002f;
-			}break;
+		// A running benchmark holds the simulation until it is done: keep drawing the last state meanwhile
+		imgui_panel::benchmark_running = benchmarking.load();
+		if (!imgui_panel::benchmark_running) {
+			std::unique_lock<std::mutex> lock = simulation_thread.lock();
+			imgui_panel::publish_settings();
+
+			// Change simulation model; jelly and cloth wait for their prop to load, the current model runs meanwhile
+			rebuild_pending = rebuild_pending || imgui_panel::rebuild_model;
+			bool switching = model_type != imgui_panel::selected_model_type;
+			bool waiting_for_prop = ((rebuild_pending && takes_prop(model_type)) ||
+									 (switching && takes_prop(imgui_panel::selected_model_type))) && !panel_prop.ready();
+			if (!waiting_for_prop && rebuild_pending && model_type == imgui_panel::ModelType::HangingCloth) {
+				model = std::make_unique<simulation::models::HangingClothModel>(imgui_panel::cloth_resolution[0],
+																				imgui_panel::cloth_resolution[1], panel_prop.get());
+				step_controller.reset();
+				++model_generation;
+			}
+			if (!waiting_for_prop && rebuild_pending && model_type == imgui_panel::ModelType::CubeOfJelly) {
+				model = std::make_unique<simulation::models::CubeOfJellyModel>(imgui_panel::jelly_obstacles, panel_prop.get());
+				step_controller.reset();
+				++model_generation;
+			}
+			if (!waiting_for_prop) {
+				rebuild_pending = false;
+			}
+			if (!waiting_for_prop && switching) {
+				model_type = imgui_panel::selected_model_type;
+				step_controller.reset();
+				++model_generation;
+				imgui_panel::play_simulation = false; //For safety reasons, stop simulation
+				switch (model_type) {
+				case imgui_panel::ModelType::MassOnSpring: {
+					model = std::make_unique<simulation::models::MassOnSpringModel>();
+					imgui_panel::dt_simulation = 0.001f; //Good idea to hard-code a good dt for each simulation
+				}break;
+				case imgui_panel::ModelType::ChainPendulum: {
+					model = std::make_unique<simulation::models::ChainPendulumModel>();
+					imgui_panel::dt_simulation = 0.001f; //Good idea to hard-code a good dt for each simulation
+				}break;
+				case imgui_panel::ModelType::CubeOfJelly: {
+					//TO-DO: Fill
+					model = std::make_unique<simulation::models::CubeOfJellyModel>(imgui_panel::jelly_obstacles, panel_prop.get());
+					imgui_panel::dt_simulation = 0.001f;
+				}break;
+				case imgui_panel::ModelType::HangingCloth: {
+					//TO-DO: Fill
+					model = std::make_unique<simulation::models::HangingClothModel>(imgui_panel::cloth_resolution[0],
+																					imgui_panel::cloth_resolution[1], panel_prop.get());
+					imgui_panel::dt_simulation = 0.002f;
+				}break;
+				}
+				imgui_panel::publish_settings();
 			}
-		}
 
-		//Simulation updates
-		if (imgui_panel::reset_simulation) {
-			model->reset();
-		}
+			// Safe here: no simulation work is in flight while the lock is held, and no prop is baking
+			if ((unsigned) imgui_panel::thread_count != simulation::threading::pool().size() && !panel_prop.loading()) {
+				simulation::threading::pool().resize((unsigned) imgui_panel::thread_count);
+			}
 
-		if (imgui_panel::step_simulation) {
-			model->step(imgui_panel::dt_simulation);
-		}
+			//Simulation updates
+			if (imgui_panel::reset_simulation) {
+				model->reset();
+				step_controller.reset();
+				restart_clock = true;
+				++model_generation;
+			}
 
-		if (imgui_panel::play_simulation) {
-			for (size_t i = 0; i < imgui_panel::number_of_iterations_per_frame; i++) {
-				model->step(imgui_panel::dt_simulation);
+			// Edited parameters can break a resting state, so touching the panel wakes the model
+			if (imgui_panel::wake_simulation) {
+				model->wake();
+			}
+			imgui_panel::real_time_steps = stats.real_time_steps;
+			imgui_panel::adaptive_dt_current = stats.adaptive_dt;
+			imgui_panel::adaptive_rejected_steps = stats.rejected_steps;
+			imgui_panel::sim_seconds_per_second = stats.sim_seconds_per_second;
+			if (const simulation::integrators::IslandSleep *sleep = model->sleep_state()) {
+				imgui_panel::active_masses = (int) sleep->active_masses();
+				imgui_panel::sleeping_masses = (int) sleep->sleeping_masses();
+			} else {
+				imgui_panel::active_masses = (int) model->particle_state().size();
+				imgui_panel::sleeping_masses = 0;
+			}
+			imgui_panel::contacts = (int) model->contact_count();
+			if (const simulation::collision::BVH *bvh = model->face_bvh()) {
+				imgui_panel::bvh_nodes = (int) bvh->node_count();
+				imgui_panel::bvh_rebuilds = (int) bvh->rebuild_count();
+				imgui_panel::bvh_quality = bvh->quality();
+			} else {
+				imgui_panel::bvh_nodes = 0;
+			}
+
+			if (!benchmark_result.empty()) {
+				imgui_panel::benchmark_report = std::move(benchmark_result);
+				benchmark_result.clear();
+			}
+			if (imgui_panel::run_benchmark) {
+				benchmark = [&] { return model->benchmark_spring_forces(); };
+			}
+			if (imgui_panel::run_integrator_benchmark) {
+				benchmark = [&] { return model->benchmark_integrators(); };
+			}
+			if (imgui_panel::run_precision_benchmark) {
+				benchmark = [&] { return model->benchmark_precision(); };
+			}
+			if (benchmark) {
+				benchmarking.store(true);
+			}
+
+			if (imgui_panel::step_simulation) {
+				++pending_steps;
+			}
+
+			// Latest complete state; until the simulation thread has published one for this model, copy it directly
+			snapshots.update();
+			snapshot = &snapshots.front();
+			if (snapshot->generation != model_generation) {
+				model->particle_state().copy_positions(fallback_positions);
+				snapshot = nullptr;
 			}
 		}
+		simulation_thread.wake();
 
 		// render
 		auto color = imgui_panel::clear_color;
@@ -115,7 +426,20 @@ int main(void) {
 
 		view.projection.updateAspectRatio(window.width(), window.height());
 
-		model->render(view);
+		if (snapshot == nullptr) {
+			model->render(view, fallback_positions);
+		} else if (snapshot->interpolate && snapshot->previous.size() == snapshot->current.size()) {
+			// Real time: draw the state at the current wall time, between the last two steps
+			float alpha = std::chrono::duration<float>(Clock::now() - snapshot->due).count() / snapshot->dt;
+			alpha = std::min(std::max(alpha, 0.f), 1.f);
+			render_positions.resize(snapshot->current.size());
+			for (std::size_t i = 0; i < snapshot->current.size(); ++i) {
+				render_positions[i] = glm::lerp(snapshot->previous[i], snapshot->current[i], alpha);
+			}
+			model->render(view, render_positions);
+		} else {
+			model->render(view, snapshot->current);
+		}
 		});
 
 	return EXIT_SUCCESS;
@@ -1,8 +1,12 @@
+#include <atomic>
 #include <cstdlib>
 #include <cmath>
 
 #include "models.hpp"
 #include "imgui_panel.hpp"
+#include "benchmark.hpp"
+#include "spring_forces.hpp"
+#include "thread_pool.hpp"
 
 namespace simulation {
     namespace primatives {
@@ -10,6 +14,135 @@ namespace simulation {
     }// namespace primatives
 
     namespace models {
+        namespace {
+            // Sleep settings are shared by all models
+            void configure_sleep(integrators::IslandSleep &sleep) {
+                const imgui_panel::SimulationSettings &settings = imgui_panel::simulation_settings();
+                sleep.enabled = settings.sleep_enabled;
+                sleep.threshold = settings.sleep_threshold;
+                sleep.delay = settings.sleep_delay;
+            }
+
+            // Triangles between neighbouring samples point(row, column) of a closed-around surface (columns wrap)
+            template<typename Point>
+            void add_surface(givr::geometry::TriangleSoup &soup, int rows, int columns, Point point) {
+                for (int i = 0; i < rows; ++i) {
+                    for (int j = 0; j < columns; ++j) {
+                        glm::vec3 p00 = point(i, j), p01 = point(i, (j + 1) % columns);
+                        glm::vec3 p10 = point(i + 1, j), p11 = point(i + 1, (j + 1) % columns);
+                        soup.push_back(givr::geometry::Triangle(givr::geometry::Point1(p00), givr::geometry::Point2(p10),
+                                                                givr::geometry::Point3(p11)));
+                        soup.push_back(givr::geometry::Triangle(givr::geometry::Point1(p00), givr::geometry::Point2(p11),
+                                                                givr::geometry::Point3(p01)));
+                    }
+                }
+            }
+
+            // Render mesh of a sphere, capsule or box collider
+            void add_collider_triangles(givr::geometry::TriangleSoup &soup, const collision::Collider &collider) {
+                const float pi = glm::pi<float>();
+                if (collider.shape == collision::Shape::Sphere || collider.shape == collision::Shape::Capsule) {
+                    // Swept sphere: the upper half of the rings around the end, the lower half around the start
+                    glm::vec3 end = collider.shape == collision::Shape::Capsule ? collider.b : collider.a;
+                    glm::vec3 axis = end - collider.a;
+                    axis = glm::dot(axis, axis) > 0.f ? glm::normalize(axis) : glm::vec3(0.f, 1.f, 0.f);
+                    glm::vec3 u = glm::normalize(glm::cross(axis, std::abs(axis.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f)
+                                                                                         : glm::vec3(0.f, 1.f, 0.f)));
+                    glm::vec3 v = glm::cross(axis, u);
+                    const int half = 6, columns = 16;
+                    add_surface(soup, 2 * half + 1, columns, [&](int i, int j) {
+                        float theta = pi * (float) (i <= half ? i : i - 1) / (float) (2 * half);
+                        float phi = 2.f * pi * (float) j / (float) columns;
+                        glm::vec3 center = i <= half ? end : collider.a;
+                        return center + collider.radius * (std::cos(theta) * axis +
+                                                           std::sin(theta) * (std::cos(phi) * u + std::sin(phi) * v));
+                    });
+                } else if (collider.shape == collision::Shape::Box) {
+                    auto corner = [&](int x, int y, int z) {
+                        return collider.a + collider.rotation * (collider.b * glm::vec3(x ? 1.f : -1.f, y ? 1.f : -1.f, z ? 1.f : -1.f));
+                    };
+                    for (int axis = 0; axis < 3; ++axis) {
+                        for (int side = 0; side < 2; ++side) {
+                            // Corners of the face, counter-clockwise seen from outside
+                            glm::ivec3 c[4];
+                            for (int k = 0; k < 4; ++k) {
+                                int a = (k == 1 || k == 2) ? 1 : 0, b = k >= 2 ? 1 : 0;
+                                if (side == 0) std::swap(a, b);
+                                c[k][axis] = side;
+                                c[k][(axis + 1) % 3] = a;
+                                c[k][(axis + 2) % 3] = b;
+                            }
+                            glm::vec3 p[4];
+                            for (int k = 0; k < 4; ++k) p[k] = corner(c[k].x, c[k].y, c[k].z);
+                            soup.push_back(givr::geometry::Triangle(givr::geometry::Point1(p[0]), givr::geometry::Point2(p[1]),
+                                                                    givr::geometry::Point3(p[2])));
+                            soup.push_back(givr::geometry::Triangle(givr::geometry::Point1(p[0]), givr::geometry::Point2(p[2]),
+                                                                    givr::geometry::Point3(p[3])));
+                        }
+                    }
+                }
+            }
+
+            // Render mesh of a brick map collider's source mesh, placed like the collider
+            void add_mesh_triangles(givr::geometry::TriangleSoup &soup, const collision::TriangleMesh &mesh,
+                                    const collision::Collider &collider) {
+                auto point = [&](std::uint32_t v) { return collider.a + collider.rotation * mesh.vertices[v]; };
+                for (const glm::uvec3 &t: mesh.triangles) {
+                    soup.push_back(givr::geometry::Triangle(givr::geometry::Point1(point(t.x)), givr::geometry::Point2(point(t.y)),
+                                                            givr::geometry::Point3(point(t.z))));
+                }
+            }
+
+            // Anchor frame swaying along x as set in the panel (the identity while the amplitude is 0)
+            primatives::KinematicConstraints::Motion anchor_sway(imgui_panel::ModelType type) {
+                return [type](float t) {
+                    const imgui_panel::ModelSettings &settings = imgui_panel::simulation_settings().model(type);
+                    float x = settings.anchor_amplitude * std::sin(2.f * glm::pi<float>() * settings.anchor_frequency * t);
+                    return glm::translate(glm::mat4(1.f), glm::vec3(x, 0.f, 0.f));
+                };
+            }
+        }
+
+        //////////////////////////////////////////////////
+        ////                   Prop                   ////----------------------------------------------------------
+        //////////////////////////////////////////////////
+
+        std::shared_ptr<const Prop> load_prop(const std::string &file, float scale, float cell) {
+            // Straight from tinyobj rather than givr's loader, which keeps the first shape only and splits vertices
+            // along normal and uv seams (the field needs them shared to know its inside)
+            tinyobj::attrib_t attrib;
+            std::vector<tinyobj::shape_t> shapes;
+            std::vector<tinyobj::material_t> materials;
+            std::string errors;
+            if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &errors, file.c_str())) return nullptr;
+
+            auto prop = std::make_shared<Prop>();
+            collision::TriangleMesh &mesh = prop->mesh;
+            for (std::size_t k = 0; k + 2 < attrib.vertices.size(); k += 3) {
+                mesh.vertices.push_back(scale * glm::vec3(attrib.vertices[k], attrib.vertices[k + 1], attrib.vertices[k + 2]));
+            }
+            for (const tinyobj::shape_t &shape: shapes) {
+                // Triangulated on load, every face has three indices
+                const std::vector<tinyobj::index_t> &indices = shape.mesh.indices;
+                for (std::size_t k = 0; k + 2 < indices.size(); k += 3) {
+                    glm::ivec3 t(indices[k].vertex_index, indices[k + 1].vertex_index, indices[k + 2].vertex_index);
+                    if (glm::any(glm::lessThan(t, glm::ivec3(0))) ||
+                        glm::any(glm::greaterThanEqual(t, glm::ivec3((int) mesh.vertices.size())))) {
+                        continue;
+                    }
+                    mesh.triangles.push_back(glm::uvec3(t));
+                }
+            }
+            if (mesh.triangles.empty()) return nullptr;
+
+            prop->bounds = {mesh.vertices[0], mesh.vertices[0]};
+            for (const glm::vec3 &v: mesh.vertices) prop->bounds = collision::merge(prop->bounds, {v, v});
+            prop->cache_path = file + ".sdf";
+            prop->sdf = collision::cached_brick_map(mesh, cell, Prop::band_cells * cell, prop->cache_path, &prop->baked,
+                                                    &prop->saved);
+            return prop;
+        }
+
         //////////////////////////////////////////////////
         ////            MassOnSpringModel             ////----------------------------------------------------------
         //////////////////////////////////////////////////
@@ -18,11 +151,14 @@ namespace simulation {
                 : mass_geometry(givr::geometry::Radius(0.2f)),
                   mass_style(givr::style::Colour(1.f, 0.f, 1.f), givr::style::LightPosition(100.f, 100.f, 100.f)),
                   spring_geometry(), spring_style(givr::style::Colour(1.f, 0.f, 1.f)) {
-            // Link up (Static elements)
-            mass_a.fixed = true;
-            mass_b.fixed = false;
-            spring.mass_a = &mass_a;
-            spring.mass_b = &mass_b;
+            // Link up (Static elements): the bob is mass 0, the anchor is the constrained tail
+            particles.resize(2);
+            primatives::FlagBits anchor;
+            anchor.resize(2);
+            anchor.set(1, true);
+            particles.partition(anchor);
+            spring.mass_a = 1;
+            spring.mass_b = 0;
             spring.rest_l = 5.f;
             spring.k_s = 2.f;
             spring.k_d = 0.1f;
@@ -35,33 +171,35 @@ namespace simulation {
         }
 
         void MassOnSpringModel::reset() {
-            mass_a.p = {0.f, 0.f, 0.f};
-            mass_a.v = {0.f, 0.f, 0.f};
-            mass_b.p = {0.f, -5.f, 0.f};
-            mass_b.v = {0.f, -3.f, 0.f};
+            particles.set_position(1, {0.f, 0.f, 0.f});
+            particles.set_velocity(1, {0.f, 0.f, 0.f});
+            particles.set_position(0, {0.f, -5.f, 0.f});
+            particles.set_velocity(0, {0.f, -3.f, 0.f});
         }
 
 
         void MassOnSpringModel::step(float dt) {
-            g = glm::vec3(0.f, -1.f * imgui_panel::gravity, 0.f);
+            g = glm::vec3(0.f, -1.f * imgui_panel::simulation_settings().gravity, 0.f);
 
-            mass_b.f = spring.force_b() + mass_b.m * g;
-            mass_b.integrate(dt);
+            particles.set_force(1, glm::vec3(0.f));
+            particles.set_force(0, spring.force_b(particles) + (float) particles.mass(0) * g);
+            particles.integrate(dt);
         }
 
 
-        void MassOnSpringModel::render(const ModelViewContext &view) {
+        void MassOnSpringModel::render(const ModelViewContext &view, const std::vector<glm::vec3> &positions) {
 
             //Add Mass render
-            givr::addInstance(mass_render, glm::translate(glm::mat4(1.f), mass_a.p));
-            givr::addInstance(mass_render, glm::translate(glm::mat4(1.f), mass_b.p));
+            for (std::size_t i = 0; i < positions.size(); ++i) {
+                givr::addInstance(mass_render, glm::translate(glm::mat4(1.f), positions[i]));
+            }
 
             //Clear and add springs
             spring_geometry.segments().clear();
             spring_geometry.push_back(
                     givr::geometry::Line(
-                            givr::geometry::Point1(spring.mass_a->p),
-                            givr::geometry::Point2(spring.mass_b->p)
+                            givr::geometry::Point1(positions[spring.mass_a]),
+                            givr::geometry::Point2(positions[spring.mass_b])
                     )
             );
             givr::updateRenderable(spring_geometry, spring_style, spring_render);
@@ -82,20 +220,29 @@ namespace simulation {
 
             int number_of_masses = 20, number_of_springs = number_of_masses - 1;
             //Link up (Static elements)
-            masses.resize(number_of_masses);
-            masses[0].fixed = true;
+            particles.resize(number_of_masses);
             for (int i = 0; i < number_of_masses; ++i) {
-                masses[i].air_resistance = true;
+                particles.set_air_resistance(i, true);
             }
-
-            springs.resize(number_of_springs);
+            // The anchor moves to the constrained tail and follows its frame
+            primatives::FlagBits anchor;
+            anchor.resize(number_of_masses);
+            anchor.set(0, true);
+            link = particles.partition(anchor);
+            constraints.attach(link[0], constraints.add_frame(anchor_sway(imgui_panel::ModelType::ChainPendulum)),
+                               glm::vec3(0.f));
+
+            springs.reserve(number_of_springs);
             for (int i = 0; i < number_of_springs; ++i) {
-                springs[i].mass_a = &masses[i];
-                springs[i].mass_b = &masses[i + 1];
-                springs[i].k_s = 1000.f;
-                springs[i].k_d = 5.f;
-                springs[i].rest_l = 1.f;
+                springs.add(link[i], link[i + 1], 1.f, 1000.f, 5.f);
             }
+            springs.colour();
+            spring_forces.build(springs, particles.size());
+            implicit_euler.build(springs, particles.size());
+            projective_dynamics.build(springs, particles);
+            xpbd.build(springs, particles.size());
+            max_frequency = integrators::max_angular_frequency(springs, particles);
+            island_sleep.build(springs, particles);
             //Reset Dynamic elements
             reset();
 
@@ -105,42 +252,82 @@ namespace simulation {
         }
 
         void ChainPendulumModel::reset() {
-            for (int i = 0; i < masses.size(); ++i) {
-                masses[i].p = {(float) i * 1.f, 0.f, 0.f};
-                masses[i].v = {0.f, 0.f, 0.f};
+            for (std::size_t i = 0; i < particles.size(); ++i) {
+                particles.set_position(link[i], {(float) i * 1.f, 0.f, 0.f});
+                particles.set_velocity(link[i], {0.f, 0.f, 0.f});
             }
+            time = step_start_time = 0.f;
+            explicit_integrator.invalidate();
+            island_sleep.wake_all();
+        }
+
+        void ChainPendulumModel::compute_forces(forces::Accumulation accumulation) {
+            particles.apply_gravity(g);
+            spring_forces.accumulate(springs, particles, accumulation);
+            particles.apply_air_resistance(c_d);
         }
 
         void ChainPendulumModel::step(float dt) {
+            configure_sleep(island_sleep);
+            // Scripted anchors first, the rest cannot sleep while they move
+            step_start_time = time;
+            time += dt;
+            if (constraints.update(particles, step_start_time, dt)) island_sleep.wake_all();
+            // Nothing moves while every island sleeps
+            if (!island_sleep.any_awake()) return;
+            advance(dt);
+            island_sleep.update(particles, dt);
+        }
+
+        void ChainPendulumModel::advance(float dt) {
             //Calculating the forces
-            g = glm::vec3(0.f, -1.f * imgui_panel::gravity, 0.f);
+            g = glm::vec3(0.f, -1.f * imgui_panel::simulation_settings().gravity, 0.f);
 
-            for (int i = 0; i < masses.size(); ++i) {
-                masses[i].f = masses[i].m * g;
+            const imgui_panel::ModelSettings &settings =
+                    imgui_panel::simulation_settings().model(imgui_panel::ModelType::ChainPendulum);
+            if (integrators::ExplicitIntegrator::supports(settings.integrator)) {
+                explicit_integrator.step(settings.integrator, particles, dt, [&] { compute_forces(settings.force_accumulation); });
+                return;
             }
-            for (int i = 0; i < springs.size(); ++i) {
-                springs[i].mass_a->f += springs[i].force_a();
-                springs[i].mass_b->f += springs[i].force_b();
+            if (settings.integrator == integrators::Integrator::MultiRate) {
+                multi_rate.step(particles, dt, {
+                        {settings.rate_gravity, [&] { particles.apply_gravity(g); }},
+                        {settings.rate_springs, [&] { spring_forces.accumulate(springs, particles, settings.force_accumulation); }},
+                        {settings.rate_drag, [&] { particles.apply_air_resistance(c_d); }}
+                });
+                return;
             }
-            for (int i = 0; i < masses.size(); ++i) {
-                if (masses[i].air_resistance) {
-                    if (glm::length(masses[i].v) > 0.f) {
-                        masses[i].f += -1.f * glm::dot(masses[i].v, masses[i].v) * c_d * glm::normalize(masses[i].v);
-                    }
-                }
+            bool constrained = settings.integrator == integrators::Integrator::ProjectiveDynamics ||
+                               settings.integrator == integrators::Integrator::XPBD;
+            if (constrained) {
+                particles.apply_gravity(g);
+                particles.apply_air_resistance(c_d);
+            } else {
+                compute_forces(settings.force_accumulation);
             }
 
             //Integration
-            for (int i = 0; i < masses.size(); ++i) {
-                masses[i].integrate(dt);
+            if (settings.integrator == integrators::Integrator::XPBD) {
+                xpbd.solver = settings.xpbd_solver;
+                xpbd.substeps = settings.xpbd_substeps;
+                xpbd.iterations = settings.xpbd_iterations;
+                xpbd.jacobi_relaxation = settings.xpbd_jacobi_relaxation;
+                xpbd.step(springs, particles, dt);
+            } else if (settings.integrator == integrators::Integrator::ProjectiveDynamics) {
+                projective_dynamics.iterations = settings.pd_iterations;
+                projective_dynamics.step(springs, particles, dt);
+            } else {
+                implicit_euler.max_iterations = settings.cg_max_iterations;
+                implicit_euler.tolerance = settings.cg_tolerance;
+                implicit_euler.step(springs, particles, dt);
             }
         }
 
-        void ChainPendulumModel::render(const ModelViewContext &view) {
+        void ChainPendulumModel::render(const ModelViewContext &view, const std::vector<glm::vec3> &positions) {
 
             //Add Mass render
-            for (const primatives::Mass &mass: masses) {
-                givr::addInstance(mass_render, glm::translate(glm::mat4(1.f), mass.p));
+            for (std::size_t i = 0; i < positions.size(); ++i) {
+                givr::addInstance(mass_render, glm::translate(glm::mat4(1.f), positions[i]));
             }
 
             //Clear and add springs
@@ -148,8 +335,8 @@ namespace simulation {
             for (const primatives::Spring &spring: springs) {
                 spring_geometry.push_back(
                         givr::geometry::Line(
-                                givr::geometry::Point1(spring.mass_a->p),
-                                givr::geometry::Point2(spring.mass_b->p)
+                                givr::geometry::Point1(positions[spring.mass_a]),
+                                givr::geometry::Point2(positions[spring.mass_b])
                         )
                 );
             }
@@ -160,11 +347,40 @@ namespace simulation {
             givr::style::draw(spring_render, view);
         }
 
+        float ChainPendulumModel::stable_dt() {
+            const imgui_panel::ModelSettings &settings =
+                    imgui_panel::simulation_settings().model(imgui_panel::ModelType::ChainPendulum);
+            if (settings.integrator == integrators::Integrator::MultiRate) {
+                // The stiff forces are semi-implicit Euler at dt / rate
+                return integrators::ExplicitIntegrator::stable_dt(integrators::Integrator::SemiImplicitEuler, max_frequency) *
+                       (float) settings.rate_springs;
+            }
+            return integrators::ExplicitIntegrator::stable_dt(settings.integrator, max_frequency);
+        }
+
+        std::string ChainPendulumModel::benchmark_spring_forces() {
+            return benchmark::spring_kernels(springs, particles);
+        }
+
+        std::string ChainPendulumModel::benchmark_precision() {
+            const imgui_panel::SimulationSettings &settings = imgui_panel::simulation_settings();
+            return benchmark::precision(springs, particles, glm::vec3(0.f, -1.f * settings.gravity, 0.f), c_d,
+                                        settings.dt_simulation, 1000);
+        }
+
+        std::string ChainPendulumModel::benchmark_integrators() {
+            g = glm::vec3(0.f, -1.f * imgui_panel::simulation_settings().gravity, 0.f);
+            forces::Accumulation accumulation =
+                    imgui_panel::simulation_settings().model(imgui_panel::ModelType::ChainPendulum).force_accumulation;
+            return benchmark::explicit_integrators(particles, [&] { compute_forces(accumulation); },
+                                                   imgui_panel::simulation_settings().dt_simulation, 1.f);
+        }
+
         //////////////////////////////////////////////////
         ////           CubeOfJellyModel             ////----------------------------------------------------------
         //////////////////////////////////////////////////
 
-        CubeOfJellyModel::CubeOfJellyModel()
+        CubeOfJellyModel::CubeOfJellyModel(int obstacles, std::shared_ptr<const Prop> prop)
                 : triangle_geometry(),
                   triangle_style(givr::style::Colour(1.f, 0.f, 1.f), givr::style::LightPosition(100.f, 100.f, 100.f),
                                  givr::style::AmbientFactor(0.3f)),
@@ -172,160 +388,98 @@ namespace simulation {
                                   givr::geometry::Point2(glm::vec3(-100.f, ground_height, 100.f)),
                                   givr::geometry::Point3(glm::vec3(100.f, ground_height, 100.f)),
                                   givr::geometry::Point4(glm::vec3(100.f, ground_height, -100.f))),
-                  ground_style(givr::style::Colour(0.25f, 0.25f, 1.f), givr::style::LightPosition(0.f, 100.f, 0.f)) {
+                  ground_style(givr::style::Colour(0.25f, 0.25f, 1.f), givr::style::LightPosition(0.f, 100.f, 0.f)),
+                  obstacle_style(givr::style::Colour(0.8f, 0.6f, 0.2f), givr::style::LightPosition(100.f, 100.f, 100.f)) {
 
             //Initializing masses and springs
-            int number_of_springs = 0;
             float k_d = 0.05f, k_s = 250.f;
-            bool processed_masses[cube_width][cube_height][cube_depth];
-            for (int x = 0; x < cube_width; ++x) {
-                for (int y = 0; y < cube_height; ++y) {
-                    for (int z = 0; z < cube_depth; ++z) {
-                        processed_masses[x][y][z] = false;
+            grid = primatives::Grid(cube_width, cube_height, cube_depth);
+            particles.resize(grid.size());
+
+            // Connect every pair of masses closer than two lattice steps, plus the pairs spanning a full edge.
+            // Visiting j > i in linear order yields every pair exactly once.
+            auto is_connected = [&](float distance) {
+                return distance < min_mass_distance * 2.f ||
+                       (distance >= min_mass_distance * (cube_width - 1) - 0.01f &&
+                        distance < min_mass_distance * (cube_width - 1) + 0.01f) ||
+                       (distance >= min_mass_distance * (cube_height - 1) - 0.01f &&
+                        distance < min_mass_distance * (cube_height - 1) + 0.01f) ||
+                       (distance >= min_mass_distance * (cube_depth - 1) - 0.01f &&
+                        distance < min_mass_distance * (cube_depth - 1) + 0.01f);
+            };
+            for (std::size_t i = 0; i < grid.size(); ++i) {
+                particles.set_air_resistance(i, true);
+                glm::ivec3 c = grid.coords(i);
+                for (std::size_t j = i + 1; j < grid.size(); ++j) {
+                    glm::ivec3 d = grid.coords(j) - c;
+                    float distance = sqrtf((float) (d.x * d.x + d.y * d.y + d.z * d.z) * min_mass_distance);
+                    if (is_connected(distance)) {
+                        springs.add(i, j, min_mass_distance * distance, k_s, k_d);
                     }
                 }
             }
-
-            masses.resize(cube_width);
-            for (int x = 0; x < cube_width; ++x) {
-                masses[x].resize(cube_height);
-                for (int y = 0; y < cube_height; ++y) {
-                    masses[x][y].resize(cube_depth);
-                    for (int z = 0; z < cube_depth; ++z) {
-                        masses[x][y][z].air_resistance = true;
-                        for (int nx = 0; nx < cube_width; ++nx) {
-                            for (int ny = 0; ny < cube_height; ++ny) {
-                                for (int nz = 0; nz < cube_depth; ++nz) {
-                                    if (!(nx == x && ny == y && nz == z) && !processed_masses[nx][ny][nz]) {
-                                        float distance = sqrtf((float) ((nx - x) * (nx - x) + (ny - y) * (ny - y) +
-                                                                        (nz - z) * (nz - z)) * min_mass_distance);
-                                        if (distance < min_mass_distance * 2.f ||
-                                            (distance >= min_mass_distance * (cube_width - 1) - 0.01f &&
-                                             distance < min_mass_distance * (cube_width - 1) + 0.01f) ||
-                                            (distance >= min_mass_distance * (cube_height - 1) - 0.01f &&
-                                             distance < min_mass_distance * (cube_height - 1) + 0.01f) ||
-                                            (distance >= min_mass_distance * (cube_depth - 1) - 0.01f &&
-                                             distance < min_mass_distance * (cube_depth - 1) + 0.01f)) {
-                                            number_of_springs++;
-                                        }
-                                    }
-                                }
-                            }
-                        }
-
-                        processed_masses[x][y][z] = true;
-                    }
-                }
+            springs.sort_by_first_endpoint();
+            springs.colour();
+            spring_forces.build(springs, particles.size());
+            implicit_euler.build(springs, particles.size());
+            projective_dynamics.build(springs, particles);
+            xpbd.build(springs, particles.size());
+            collision::Collider ground = collision::Collider::plane(glm::vec3(0.f, 1.f, 0.f), ground_height);
+            ground.k_s = ground_k_s;
+            ground.k_d = ground_k_d;
+            colliders.add(ground);
+            if (prop) place_prop(*prop);
+            place_obstacles(obstacles);
+            max_frequency = integrators::max_angular_frequency(springs, particles, colliders.max_stiffness());
+            spring_frequency = integrators::max_angular_frequency(springs, particles);
+            island_sleep.build(springs, particles);
+            add_force_phases(force_graph);
+            auto chunked = [this](std::function<void(std::size_t, std::size_t)> fn) {
+                return [this, fn] { threading::pool().parallel_for(0, particles.size(), 1024, fn); };
+            };
+            force_groups = {
+                    {1, chunked([this](std::size_t begin, std::size_t end) { particles.apply_gravity(g, begin, end); })},
+                    {1, [this] { spring_forces.accumulate(springs, particles, accumulation); }},
+                    {1, chunked([this](std::size_t begin, std::size_t end) { apply_contacts(begin, end); })}
+            };
+            for (integrators::Integrator mode: {integrators::Integrator::SemiImplicitEuler, integrators::Integrator::ImplicitEuler,
+                                                integrators::Integrator::ProjectiveDynamics, integrators::Integrator::XPBD}) {
+                build_step_graph(mode);
             }
 
-            springs.resize(number_of_springs);
-            int spring_index = 0;
-            for (int x = 0; x < cube_width; ++x) {
-                for (int y = 0; y < cube_height; ++y) {
-                    for (int z = 0; z < cube_depth; ++z) {
-                        processed_masses[x][y][z] = false;
+            triangle_render = givr::createRenderable(triangle_geometry, triangle_style);
+
+            // Two triangles per lattice cell on each of the six sides
+            auto add_quad = [&](std::size_t p00, std::size_t p10, std::size_t p01, std::size_t p11) {
+                faces.push_back({(std::uint32_t) p00, (std::uint32_t) p10, (std::uint32_t) p01});
+                faces.push_back({(std::uint32_t) p11, (std::uint32_t) p01, (std::uint32_t) p10});
+            };
+            faces.reserve((cube_width - 1) * (cube_height - 1) * 4 + (cube_height - 1) * (cube_depth - 1) * 4 +
+                          (cube_width - 1) * (cube_depth - 1) * 4);
+            for (int side = 0; side < 2; ++side) {
+                int x = side == 0 ? 0 : cube_width - 1;
+                for (int j = 0; j < cube_height - 1; ++j) {
+                    for (int k = 0; k < cube_depth - 1; ++k) {
+                        add_quad(grid.index(x, j, k), grid.index(x, j + 1, k),
+                                 grid.index(x, j, k + 1), grid.index(x, j + 1, k + 1));
                     }
                 }
             }
-
-            for (int x = 0; x < cube_width; ++x) {
-                for (int y = 0; y < cube_height; ++y) {
-                    for (int z = 0; z < cube_depth; ++z) {
-                        for (int nx = 0; nx < cube_width; ++nx) {
-                            for (int ny = 0; ny < cube_height; ++ny) {
-                                for (int nz = 0; nz < cube_depth; ++nz) {
-                                    if (!(nx == x && ny == y && nz == z) && !processed_masses[nx][ny][nz]) {
-                                        float distance = sqrtf((float) ((nx - x) * (nx - x) + (ny - y) * (ny - y) +
-                                                                        (nz - z) * (nz - z)) * min_mass_distance);
-                                        if (distance < min_mass_distance * 2.f ||
-                                            (distance >= min_mass_distance * (cube_width - 1) - 0.01f &&
-                                             distance < min_mass_distance * (cube_width - 1) + 0.01f) ||
-                                            (distance >= min_mass_distance * (cube_height - 1) - 0.01f &&
-                                             distance < min_mass_distance * (cube_height - 1) + 0.01f) ||
-                                            (distance >= min_mass_distance * (cube_depth - 1) - 0.01f &&
-                                             distance < min_mass_distance * (cube_depth - 1) + 0.01f)) {
-                                            springs[spring_index].mass_a = &masses[x][y][z];
-                                            springs[spring_index].mass_b = &masses[nx][ny][nz];
-                                            // Set spring constants, rest length, etc. as needed
-                                            springs[spring_index].rest_l = min_mass_distance * distance;
-                                            springs[spring_index].k_s = k_s; // Example spring constant
-                                            springs[spring_index].k_d = k_d; // Example damping constant
-                                            spring_index++;
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                        processed_masses[x][y][z] = true;
+            for (int side = 0; side < 2; ++side) {
+                int y = side == 0 ? 0 : cube_height - 1;
+                for (int j = 0; j < cube_width - 1; ++j) {
+                    for (int k = 0; k < cube_depth - 1; ++k) {
+                        add_quad(grid.index(j, y, k), grid.index(j + 1, y, k),
+                                 grid.index(j, y, k + 1), grid.index(j + 1, y, k + 1));
                     }
                 }
             }
-
-            triangle_render = givr::createRenderable(triangle_geometry, triangle_style);
-
-            faces.resize((cube_width - 1) * (cube_height - 1) * 4 + (cube_height - 1) * (cube_depth - 1) * 4 +
-                         (cube_width - 1) * (cube_depth - 1) * 4);
-            int face_index = 0;
-            for (int i = 0; i < 6; ++i) {
-                int x_bound = (i < 2 ? cube_height : cube_width) - 1;
-                int y_bound = (i > 3 ? cube_height : cube_depth) - 1;
-                for (int j = 0; j < x_bound; ++j) {
-                    for (int k = 0; k < y_bound; ++k) {
-                        if (i == 0) {
-                            faces[face_index].mass_a = &masses[0][j][k];
-                            faces[face_index].mass_b = &masses[0][j + 1][k];
-                            faces[face_index].mass_c = &masses[0][j][k + 1];
-                            face_index++;
-                            faces[face_index].mass_a = &masses[0][j + 1][k + 1];
-                            faces[face_index].mass_b = &masses[0][j][k + 1];
-                            faces[face_index].mass_c = &masses[0][j + 1][k];
-                            face_index++;
-                        } else if (i == 1) {
-                            faces[face_index].mass_a = &masses[cube_width - 1][j][k];
-                            faces[face_index].mass_b = &masses[cube_width - 1][j + 1][k];
-                            faces[face_index].mass_c = &masses[cube_width - 1][j][k + 1];
-                            face_index++;
-                            faces[face_index].mass_a = &masses[cube_width - 1][j + 1][k + 1];
-                            faces[face_index].mass_b = &masses[cube_width - 1][j][k + 1];
-                            faces[face_index].mass_c = &masses[cube_width - 1][j + 1][k];
-                            face_index++;
-                        } else if (i == 2) {
-                            faces[face_index].mass_a = &masses[j][0][k];
-                            faces[face_index].mass_b = &masses[j + 1][0][k];
-                            faces[face_index].mass_c = &masses[j][0][k + 1];
-                            face_index++;
-                            faces[face_index].mass_a = &masses[j + 1][0][k + 1];
-                            faces[face_index].mass_b = &masses[j][0][k + 1];
-                            faces[face_index].mass_c = &masses[j + 1][0][k];
-                            face_index++;
-                        } else if (i == 3) {
-                            faces[face_index].mass_a = &masses[j][cube_height - 1][k];
-                            faces[face_index].mass_b = &masses[j + 1][cube_height - 1][k];
-                            faces[face_index].mass_c = &masses[j][cube_height - 1][k + 1];
-                            face_index++;
-                            faces[face_index].mass_a = &masses[j + 1][cube_height - 1][k + 1];
-                            faces[face_index].mass_b = &masses[j][cube_height - 1][k + 1];
-                            faces[face_index].mass_c = &masses[j + 1][cube_height - 1][k];
-                            face_index++;
-                        } else if (i == 4) {
-                            faces[face_index].mass_a = &masses[j][k][0];
-                            faces[face_index].mass_b = &masses[j + 1][k][0];
-                            faces[face_index].mass_c = &masses[j][k + 1][0];
-                            face_index++;
-                            faces[face_index].mass_a = &masses[j + 1][k + 1][0];
-                            faces[face_index].mass_b = &masses[j][k + 1][0];
-                            faces[face_index].mass_c = &masses[j + 1][k][0];
-                            face_index++;
-                        } else if (i == 5) {
-                            faces[face_index].mass_a = &masses[j][k][cube_depth - 1];
-                            faces[face_index].mass_b = &masses[j + 1][k][cube_depth - 1];
-                            faces[face_index].mass_c = &masses[j][k + 1][cube_depth - 1];
-                            face_index++;
-                            faces[face_index].mass_a = &masses[j + 1][k + 1][cube_depth - 1];
-                            faces[face_index].mass_b = &masses[j][k + 1][cube_depth - 1];
-                            faces[face_index].mass_c = &masses[j + 1][k][cube_depth - 1];
-                            face_index++;
-                        }
+            for (int side = 0; side < 2; ++side) {
+                int z = side == 0 ? 0 : cube_depth - 1;
+                for (int j = 0; j < cube_width - 1; ++j) {
+                    for (int k = 0; k < cube_height - 1; ++k) {
+                        add_quad(grid.index(j, k, z), grid.index(j + 1, k, z),
+                                 grid.index(j, k + 1, z), grid.index(j + 1, k + 1, z));
                     }
                 }
             }
@@ -340,75 +494,209 @@ namespace simulation {
         void CubeOfJellyModel::reset() {
             glm::vec3 center_of_jelly =
                     glm::vec3((cube_width - 1) / 2.f, (cube_height - 1) / 2.f, (cube_depth - 1) / 2.f) + offset;
-            for (int x = 0; x < masses.size(); ++x) {
-                for (int y = 0; y < masses[x].size(); ++y) {
-                    for (int z = 0; z < masses[x][y].size(); ++z) {
-                        // Initialize each mass in the cubeOfJelly
-                        masses[x][y][z].p = glm::vec3(x, y, z) * min_mass_distance + offset;
-                        // Adding torque to the jelly
-                        glm::vec3 vector = masses[x][y][z].p - center_of_jelly;
-                        masses[x][y][z].v =
-                                glm::cross(glm::normalize(vector), glm::normalize(glm::vec3(1.f, 0.7f, 0.5f))) *
-                                torque_intensity;
-                    }
-                }
+            for (std::size_t i = 0; i < grid.size(); ++i) {
+                // Initialize each mass in the cubeOfJelly
+                particles.set_position(i, glm::vec3(grid.coords(i)) * min_mass_distance + offset);
+                // Adding torque to the jelly
+                glm::vec3 vector = glm::vec3(particles.position(i)) - center_of_jelly;
+                particles.set_velocity(i,
+                        glm::cross(glm::normalize(vector), glm::normalize(glm::vec3(1.f, 0.7f, 0.5f))) *
+                        torque_intensity);
             }
+            explicit_integrator.invalidate();
+            island_sleep.wake_all();
         }
 
-        void CubeOfJellyModel::step(float dt) {
-            g = glm::vec3(0.f, -1.f * imgui_panel::gravity, 0.f);
+        threading::TaskGraph::NodeId CubeOfJellyModel::add_force_phases(threading::TaskGraph &graph) {
+            const std::size_t grain = 1024;
+            // Gravity and collider contact only touch each mass's own force, so they overlap with spring evaluation
+            auto external = graph.add_parallel_for(0, particles.size(), grain, [this](std::size_t begin, std::size_t end) {
+                particles.apply_gravity(g, begin, end);
+                apply_contacts(begin, end);
+            });
+            auto evaluate = graph.add([this] { spring_forces.evaluate(springs, particles, accumulation); });
+            return graph.add([this] { spring_forces.apply(springs, particles, accumulation); }, {external, evaluate});
+        }
 
-            for (int x = 0; x < masses.size(); ++x) {
-                for (int y = 0; y < masses[x].size(); ++y) {
-                    for (int z = 0; z < masses[x][y].size(); ++z) {
-                        masses[x][y][z].f = masses[x][y][z].m * g;
-                    }
+        void CubeOfJellyModel::build_step_graph(integrators::Integrator mode) {
+            const std::size_t grain = 1024;
+            threading::TaskGraph &graph = step_graphs[mode];
+            if (mode == integrators::Integrator::ProjectiveDynamics || mode == integrators::Integrator::XPBD) {
+                // Spring forces are replaced by constraints, only external forces go into the solve
+                auto external = graph.add_parallel_for(0, particles.size(), grain, [this](std::size_t begin, std::size_t end) {
+                    particles.apply_gravity(g, begin, end);
+                });
+                if (mode == integrators::Integrator::XPBD) {
+                    graph.add([this] {
+                        xpbd.step(springs, particles, step_dt, [this](std::size_t begin, std::size_t end) {
+                            project_out_of_colliders(begin, end);
+                        });
+                    }, {external});
+                    return;
                 }
+                auto solve = graph.add([this] { projective_dynamics.step(springs, particles, step_dt); }, {external});
+                graph.add_parallel_for(0, particles.size(), grain, [this](std::size_t begin, std::size_t end) {
+                    project_out_of_colliders(begin, end);
+                }, {solve});
+                return;
             }
 
-            for (int i = 0; i < springs.size(); ++i) {
-                springs[i].mass_a->f += springs[i].force_a();
-                springs[i].mass_b->f += springs[i].force_b();
-            }
-
-            // Handling collisions
-            float ground_k_s = 100000.f, ground_k_d = 0.4f;
-            for (int x = 0; x < masses.size(); ++x) {
-                for (int y = 0; y < masses[x].size(); ++y) {
-                    for (int z = 0; z < masses[x][y].size(); ++z) {
-                        if (masses[x][y][z].p[1] < ground_height) {
-                            float s_f = (ground_height - masses[x][y][z].p[1]) * ground_k_s;
-                            float d_f = -1.f * masses[x][y][z].v[1] * ground_k_d;
-                            masses[x][y][z].f += glm::vec3(0.f, s_f + d_f, 0.f);
-                            if (masses[x][y][z].air_resistance) {
-                                if (glm::length(masses[x][y][z].v) > 0.f) {
-                                    masses[x][y][z].f += -1.f * glm::dot(masses[x][y][z].v, masses[x][y][z].v) * c_d *
-                                                         glm::normalize(masses[x][y][z].v);
-                                }
-                            }
-                        }
-                    }
+            auto apply = add_force_phases(graph);
+            //Integration
+            if (mode == integrators::Integrator::ImplicitEuler) {
+                graph.add([this] { implicit_euler.step(springs, particles, step_dt); }, {apply});
+            } else {
+                graph.add_parallel_for(0, particles.size(), grain, [this](std::size_t begin, std::size_t end) {
+                    particles.integrate(step_dt, begin, end);
+                }, {apply});
+            }
+        }
+
+        void CubeOfJellyModel::place_obstacles(int count) {
+            // Spheres, capsules, boxes and tori (signed distance grids) lying on the ground around the drop point
+            const float pi = glm::pi<float>(), spacing = 3.f;
+            const int columns = (int) std::ceil(std::sqrt((float) count));
+            glm::vec3 drop = glm::vec3((cube_width - 1) / 2.f, ground_height, (cube_depth - 1) / 2.f);
+            std::vector<collision::Collider> obstacles;
+            obstacles.reserve(count);
+            for (int k = 0; k < count; ++k) {
+                glm::vec3 at = drop + spacing * glm::vec3((float) (k % columns) - 0.5f * (float) (columns - 1), 0.f,
+                                                          (float) (k / columns) - 0.5f * (float) (columns - 1));
+                glm::mat3 turn = glm::mat3(glm::rotate(glm::mat4(1.f), 0.7f * (float) k, glm::vec3(0.f, 1.f, 0.f)));
+                collision::Collider collider;
+                switch (k % 4) {
+                case 0:
+                    collider = collision::Collider::sphere(at + glm::vec3(0.f, 0.4f, 0.f), 1.f);
+                    break;
+                case 1:
+                    collider = collision::Collider::capsule(at + turn * glm::vec3(-1.2f, 0.3f, 0.f),
+                                                            at + turn * glm::vec3(1.2f, 0.3f, 0.f), 0.5f);
+                    break;
+                case 2:
+                    collider = collision::Collider::box(at + glm::vec3(0.f, 0.3f, 0.f), glm::vec3(0.8f, 0.5f, 0.8f), turn);
+                    break;
+                default: {
+                    const float major = 1.f, minor = 0.35f;
+                    glm::vec3 center = at + glm::vec3(0.f, minor, 0.f);
+                    auto torus = [=](const glm::vec3 &p) {
+                        glm::vec3 q = p - center;
+                        return glm::length(glm::vec2(glm::length(glm::vec2(q.x, q.z)) - major, q.y)) - minor;
+                    };
+                    glm::vec3 extent(major + minor + 0.3f, minor + 0.3f, major + minor + 0.3f);
+                    collider = collision::Collider::sdf_grid(
+                            std::make_shared<collision::SdfGrid>(collision::Box{center - extent, center + extent}, 0.1f, torus));
+                    add_surface(obstacle_geometry, 12, 24, [&](int i, int j) {
+                        float u = 2.f * pi * (float) j / 24.f, v = 2.f * pi * (float) i / 12.f;
+                        return center + glm::vec3((major + minor * std::cos(v)) * std::cos(u), minor * std::sin(v),
+                                                  (major + minor * std::cos(v)) * std::sin(u));
+                    });
+                } break;
                 }
+                collider.k_s = ground_k_s;
+                collider.k_d = ground_k_d;
+                obstacles.push_back(collider);
+                add_collider_triangles(obstacle_geometry, collider);
+            }
+            colliders.add(obstacles);
+            if (colliders.colliders().size() > 1) {
+                obstacle_render = givr::createRenderable(obstacle_geometry, obstacle_style);
             }
+        }
 
-            //Integration
-            for (int x = 0; x < masses.size(); ++x) {
-                for (int y = 0; y < masses[x].size(); ++y) {
-                    for (int z = 0; z < masses[x][y].size(); ++z) {
-                        masses[x][y][z].integrate(dt);
+        void CubeOfJellyModel::place_prop(const Prop &prop) {
+            // On the ground under the drop point
+            glm::vec3 drop = glm::vec3((cube_width - 1) / 2.f, ground_height, (cube_depth - 1) / 2.f);
+            glm::vec3 base = glm::vec3(0.5f * (prop.bounds.min.x + prop.bounds.max.x), prop.bounds.min.y,
+                                       0.5f * (prop.bounds.min.z + prop.bounds.max.z));
+            collision::Collider collider = collision::Collider::brick_map(prop.sdf, drop - base);
+            collider.k_s = ground_k_s;
+            collider.k_d = ground_k_d;
+            colliders.add(collider);
+            add_mesh_triangles(obstacle_geometry, prop.mesh, collider);
+        }
+
+        void CubeOfJellyModel::apply_contacts(std::size_t begin, std::size_t end) {
+            if (continuous) return;
+            // Penalty springs against every collider the mass is inside of
+            colliders.apply_penalty(particles, begin, end, [this](std::size_t i, const collision::Collider &collider,
+                                                                   const glm::vec3 &normal) {
+                island_sleep.wake_on_contact(i, -glm::dot(glm::vec3(particles.velocity(i)), normal));
+                if (integrator == integrators::Integrator::ImplicitEuler) {
+                    implicit_euler.add_diagonal(i, collider.k_s * normal * normal, collider.k_d * normal * normal);
+                }
+                if (particles.air_resistance(i)) {
+                    glm::vec3 v = particles.velocity(i);
+                    if (glm::length(v) > 0.f) {
+                        particles.add_force(i, -1.f * glm::dot(v, v) * c_d * glm::normalize(v));
                     }
                 }
+            });
+        }
+
+        void CubeOfJellyModel::project_out_of_colliders(std::size_t begin, std::size_t end) {
+            // Colliders as position constraints for the position based integrators
+            colliders.project(particles, begin, end, [this](std::size_t i, const collision::Collider &, const glm::vec3 &normal) {
+                island_sleep.wake_on_contact(i, -glm::dot(glm::vec3(particles.velocity(i)), normal));
+            });
+        }
+
+        void CubeOfJellyModel::step(float dt) {
+            // Nothing moves while every island sleeps
+            configure_sleep(island_sleep);
+            impacts = 0;
+            if (!island_sleep.any_awake()) return;
+            // Swept from where the step starts to where the integrator ends it, instead of the penalty springs
+            continuous = imgui_panel::simulation_settings().model(imgui_panel::ModelType::CubeOfJelly).continuous_collision;
+            auto wake_on_impact = [this](std::size_t mass, float approach_speed) {
+                island_sleep.wake_on_contact(mass, approach_speed);
+            };
+            if (continuous) continuous_collision.begin(particles);
+            advance(dt);
+            if (continuous) {
+                impacts = continuous_collision.collide(particles, colliders, wake_on_impact);
+                if (impacts != 0) explicit_integrator.invalidate();
+            }
+            island_sleep.update(particles, dt);
+        }
+
+        void CubeOfJellyModel::advance(float dt) {
+            g = glm::vec3(0.f, -1.f * imgui_panel::simulation_settings().gravity, 0.f);
+            step_dt = dt;
+            const imgui_panel::ModelSettings &settings =
+                    imgui_panel::simulation_settings().model(imgui_panel::ModelType::CubeOfJelly);
+            accumulation = settings.force_accumulation;
+            integrator = settings.integrator;
+            implicit_euler.max_iterations = settings.cg_max_iterations;
+            implicit_euler.tolerance = settings.cg_tolerance;
+            projective_dynamics.iterations = settings.pd_iterations;
+            xpbd.solver = settings.xpbd_solver;
+            xpbd.substeps = settings.xpbd_substeps;
+            xpbd.iterations = settings.xpbd_iterations;
+            xpbd.jacobi_relaxation = settings.xpbd_jacobi_relaxation;
+
+            if (integrator == integrators::Integrator::MultiRate) {
+                force_groups[0].rate = settings.rate_gravity;
+                force_groups[1].rate = settings.rate_springs;
+                force_groups[2].rate = settings.rate_ground;
+                multi_rate.step(particles, dt, force_groups);
+                return;
+            }
+            // Schemes that evaluate forces more than once per step drive the force phases themselves
+            if (step_graphs.count(integrator) == 0) {
+                explicit_integrator.step(integrator, particles, dt, [this] { force_graph.run(threading::pool()); });
+                return;
             }
+            step_graphs[integrator].run(threading::pool());
         }
 
-        void CubeOfJellyModel::render(const ModelViewContext &view) {
+        void CubeOfJellyModel::render(const ModelViewContext &view, const std::vector<glm::vec3> &positions) {
             triangle_geometry.triangles().clear();
 
             for (auto face: faces) {
                 triangle_geometry.push_back(
-                        givr::geometry::Triangle(givr::geometry::Point1(face.mass_a->p),
-                                                 givr::geometry::Point2(face.mass_b->p),
-                                                 givr::geometry::Point3(face.mass_c->p))
+                        givr::geometry::Triangle(givr::geometry::Point1(positions[face.mass_a]),
+                                                 givr::geometry::Point2(positions[face.mass_b]),
+                                                 givr::geometry::Point3(positions[face.mass_c]))
                 );
             }
 
@@ -416,37 +704,85 @@ namespace simulation {
 
             givr::style::draw(triangle_render, view);
             givr::style::draw(ground_render, view);
+            if (colliders.colliders().size() > 1) {
+                givr::style::draw(obstacle_render, view);
+            }
+        }
+
+        float CubeOfJellyModel::stable_dt() {
+            const imgui_panel::ModelSettings &settings =
+                    imgui_panel::simulation_settings().model(imgui_panel::ModelType::CubeOfJelly);
+            // Continuous collision has no contact springs, only the jelly's own stiffness limits the step
+            if (settings.continuous_collision) {
+                if (settings.integrator == integrators::Integrator::MultiRate) {
+                    return integrators::ExplicitIntegrator::stable_dt(integrators::Integrator::SemiImplicitEuler, spring_frequency) *
+                           (float) settings.rate_springs;
+                }
+                return integrators::ExplicitIntegrator::stable_dt(settings.integrator, spring_frequency);
+            }
+            if (settings.integrator == integrators::Integrator::MultiRate) {
+                // The stiff forces are semi-implicit Euler at dt / rate
+                return integrators::ExplicitIntegrator::stable_dt(integrators::Integrator::SemiImplicitEuler, max_frequency) *
+                       (float) std::min(settings.rate_springs, settings.rate_ground);
+            }
+            return integrators::ExplicitIntegrator::stable_dt(settings.integrator, max_frequency);
+        }
+
+        std::string CubeOfJellyModel::benchmark_spring_forces() {
+            return benchmark::spring_kernels(springs, particles);
+        }
+
+        std::string CubeOfJellyModel::benchmark_precision() {
+            const imgui_panel::SimulationSettings &settings = imgui_panel::simulation_settings();
+            return benchmark::precision(springs, particles, glm::vec3(0.f, -1.f * settings.gravity, 0.f), c_d,
+                                        settings.dt_simulation, 1000);
+        }
+
+        std::string CubeOfJellyModel::benchmark_integrators() {
+            g = glm::vec3(0.f, -1.f * imgui_panel::simulation_settings().gravity, 0.f);
+            accumulation =
+                    imgui_panel::simulation_settings().model(imgui_panel::ModelType::CubeOfJelly).force_accumulation;
+            integrator = integrators::Integrator::SemiImplicitEuler; // plain forces, no ground stiffness for the implicit solve
+            return benchmark::explicit_integrators(particles, [this] { force_graph.run(threading::pool()); },
+                                                   imgui_panel::simulation_settings().dt_simulation, 0.5f);
         }
 
         //////////////////////////////////////////////////
         ////           HangingClothModel             ////----------------------------------------------------------
         //////////////////////////////////////////////////
 
-        HangingClothModel::HangingClothModel()
-                : triangle_geometry(),
-                  triangle_style(givr::style::Colour(1.f, 0.f, 1.f), givr::style::LightPosition(100.f, 100.f, 100.f)) {
+        HangingClothModel::HangingClothModel(int width, int height, std::shared_ptr<const Prop> prop)
+                : width(width), height(height), min_mass_distance(30.f / (float) width),
+                  triangle_geometry(),
+                  triangle_style(givr::style::Colour(1.f, 0.f, 1.f), givr::style::LightPosition(100.f, 100.f, 100.f)),
+                  prop_style(givr::style::Colour(0.8f, 0.6f, 0.2f), givr::style::LightPosition(100.f, 100.f, 100.f)) {
 
             //Initializing masses and springs
             int number_of_springs;
             float k_d = 0.5f, k_s = 5000.f;
 
-            masses.resize(width + 1);
-            for (int x = 0; x <= width; ++x) {
-                masses[x].resize(height + 1);
-                for (int y = 0; y <= height; ++y) {
-                    masses[x][y].air_resistance = true;
-                }
+            grid = primatives::Grid(width + 1, height + 1);
+            particles.resize(grid.size());
+            for (std::size_t i = 0; i < grid.size(); ++i) {
+                particles.set_air_resistance(i, true);
             }
-            masses[0][0].fixed = true;
-            masses[width][0].fixed = true;
+            // The two top corners move to the constrained tail, rigidly attached to one frame
+            primatives::FlagBits corners;
+            corners.resize(grid.size());
+            corners.set(grid.index(0, 0), true);
+            corners.set(grid.index(width, 0), true);
+            slot = particles.partition(corners);
 
             //Reset Dynamic elements
             reset();
+            std::size_t bar = constraints.add_frame(anchor_sway(imgui_panel::ModelType::HangingCloth));
+            for (std::size_t corner: {grid.index(0, 0), grid.index(width, 0)}) {
+                constraints.attach(slot[corner], bar, particles.position(slot[corner]));
+            }
 
             //Setting springs
             number_of_springs = width * height * 4 + width + height;
-            springs.resize(number_of_springs);
-            int spring_index = 0;
+            springs.reserve(number_of_springs);
             for (int x = 0; x <= width; ++x) {
                 for (int y = 0; y <= height; ++y) {
                     for (int dx = 0; dx <= 1; ++dx) {
@@ -464,93 +800,255 @@ namespace simulation {
                                 yb = y + dy;
                             }
                             if (xa <= width && xb <= width && ya <= height && yb <= height) {
-                                springs[spring_index].mass_a = &masses[xa][ya];
-                                springs[spring_index].mass_b = &masses[xb][yb];
-                                springs[spring_index].rest_l = glm::distance(springs[spring_index].mass_a->p,
-                                                                             springs[spring_index].mass_b->p);
-                                springs[spring_index].k_s = k_s;
-                                springs[spring_index].k_d = k_d;
-                                spring_index++;
+                                std::uint32_t a = slot[grid.index(xa, ya)], b = slot[grid.index(xb, yb)];
+                                springs.add(a, b, glm::distance(particles.position(a), particles.position(b)), k_s, k_d);
                             }
                         }
                     }
                 }
             }
+            springs.sort_by_first_endpoint();
+            springs.colour();
+            spring_forces.build(springs, particles.size());
+            implicit_euler.build(springs, particles.size());
+            projective_dynamics.build(springs, particles);
+            xpbd.build(springs, particles.size());
+            max_frequency = integrators::max_angular_frequency(springs, particles);
+            island_sleep.build(springs, particles);
+            add_force_phases(force_graph);
+            auto chunked = [this](std::function<void(std::size_t, std::size_t)> fn) {
+                return [this, fn] { threading::pool().parallel_for(0, particles.dynamic_count(), 1024, fn); };
+            };
+            force_groups = {
+                    {1, chunked([this](std::size_t begin, std::size_t end) { particles.apply_gravity(g, begin, end); })},
+                    {1, chunked([this](std::size_t begin, std::size_t end) { particles.apply_air_resistance(c_d, begin, end); })},
+                    {1, [this] { spring_forces.accumulate(springs, particles, accumulation); }}
+            };
+            for (integrators::Integrator mode: {integrators::Integrator::SemiImplicitEuler, integrators::Integrator::ImplicitEuler,
+                                                integrators::Integrator::ProjectiveDynamics, integrators::Integrator::XPBD}) {
+                build_step_graph(mode);
+            }
 
             // Render
             triangle_render = givr::createRenderable(triangle_geometry, triangle_style);
 
-            faces.resize(width * height * 2);
-            int face_index = 0;
+            faces.reserve(width * height * 2);
             for (int x = 0; x < width; ++x) {
                 for (int y = 0; y < height; ++y) {
                     for (int d = 0; d < 2; ++d) {
-                        faces[face_index].mass_a = &masses[x + d][y + d];
-                        faces[face_index].mass_b = &masses[x + 1 - d][y + d];
-                        faces[face_index].mass_c = &masses[x + d][y + 1 - d];
-                        face_index++;
+                        faces.push_back({slot[grid.index(x + d, y + d)],
+                                         slot[grid.index(x + 1 - d, y + d)],
+                                         slot[grid.index(x + d, y + 1 - d)]});
                     }
                 }
             }
+            self_collision.build(faces, min_mass_distance);
+            continuous_collision.build(faces);
+            bvh.build(faces, particles);
+
+            if (prop) {
+                // Centred under the cloth, its top a third of the cloth's length below the anchors. The skin keeps
+                // the faces between the masses from cutting into it
+                glm::vec3 top = glm::vec3(0.5f * (prop->bounds.min.x + prop->bounds.max.x), prop->bounds.max.y,
+                                          0.5f * (prop->bounds.min.z + prop->bounds.max.z));
+                glm::vec3 at(0.f, -(float) height * min_mass_distance / 3.f, 0.f);
+                collision::Collider collider = collision::Collider::brick_map(prop->sdf, at - top, glm::mat3(1.f),
+                                                                              0.1f * min_mass_distance);
+                colliders.add(collider);
+                add_mesh_triangles(prop_geometry, prop->mesh, collider);
+                prop_render = givr::createRenderable(prop_geometry, prop_style);
+            }
         }
 
         void HangingClothModel::reset() {
-            for (int x = 0; x <= width; ++x) {
-                for (int y = 0; y <= height; ++y) {
-                    masses[x][y].p = glm::vec3(((width * -0.5f) + x) * min_mass_distance, 0.f,
-                                               ((height * -0.5f) + y) * min_mass_distance);
-                    masses[x][y].v = glm::vec3(0.f);
-                }
+            for (std::size_t i = 0; i < grid.size(); ++i) {
+                glm::ivec3 c = grid.coords(i);
+                particles.set_position(slot[i], glm::vec3(((width * -0.5f) + c.x) * min_mass_distance, 0.f,
+                                                          ((height * -0.5f) + c.y) * min_mass_distance));
+                particles.set_velocity(slot[i], glm::vec3(0.f));
             }
+            time = step_start_time = 0.f;
+            explicit_integrator.invalidate();
+            island_sleep.wake_all();
+            bvh.update(particles);
         }
 
-        void HangingClothModel::step(float dt) {
-            g = glm::vec3(0.f, -1.f * imgui_panel::gravity, 0.f);
-
-            for (int x = 0; x < masses.size(); ++x) {
-                for (int y = 0; y < masses[x].size(); ++y) {
-                    masses[x][y].f = masses[x][y].m * g;
-                    if (masses[x][y].air_resistance) {
-                        if (glm::length(masses[x][y].v) > 0.f) {
-                            masses[x][y].f += -1.f * glm::dot(masses[x][y].v, masses[x][y].v) * c_d *
-                                              glm::normalize(masses[x][y].v);
-                        }
-                    }
+        threading::TaskGraph::NodeId HangingClothModel::add_force_phases(threading::TaskGraph &graph) {
+            const std::size_t grain = 1024;
+            // Gravity and drag only touch each mass's own force, so they overlap with spring evaluation
+            auto external = graph.add_parallel_for(0, particles.dynamic_count(), grain, [this](std::size_t begin, std::size_t end) {
+                particles.apply_gravity(g, begin, end);
+                particles.apply_air_resistance(c_d, begin, end);
+            });
+            auto evaluate = graph.add([this] { spring_forces.evaluate(springs, particles, accumulation); });
+            return graph.add([this] { spring_forces.apply(springs, particles, accumulation); }, {external, evaluate});
+        }
+
+        void HangingClothModel::build_step_graph(integrators::Integrator mode) {
+            const std::size_t grain = 1024;
+            threading::TaskGraph &graph = step_graphs[mode];
+            if (mode == integrators::Integrator::ProjectiveDynamics || mode == integrators::Integrator::XPBD) {
+                // Spring forces are replaced by constraints, only external forces go into the solve
+                auto external = graph.add_parallel_for(0, particles.dynamic_count(), grain, [this](std::size_t begin, std::size_t end) {
+                    particles.apply_gravity(g, begin, end);
+                    particles.apply_air_resistance(c_d, begin, end);
+                });
+                if (mode == integrators::Integrator::XPBD) {
+                    graph.add([this] { xpbd.step(springs, particles, step_dt); }, {external});
+                } else {
+                    graph.add([this] { projective_dynamics.step(springs, particles, step_dt); }, {external});
                 }
+                return;
             }
 
-            for (int i = 0; i < springs.size(); ++i) {
-                springs[i].mass_a->f += springs[i].force_a();
-                springs[i].mass_b->f += springs[i].force_b();
+            auto apply = add_force_phases(graph);
+            //Integration
+            if (mode == integrators::Integrator::ImplicitEuler) {
+                graph.add([this] { implicit_euler.step(springs, particles, step_dt); }, {apply});
+            } else {
+                graph.add_parallel_for(0, particles.dynamic_count(), grain, [this](std::size_t begin, std::size_t end) {
+                    particles.integrate(step_dt, begin, end);
+                }, {apply});
             }
+        }
 
-            //Integration
-            for (int x = 0; x < masses.size(); ++x) {
-                for (int y = 0; y < masses[x].size(); ++y) {
-                    masses[x][y].integrate(dt);
+        void HangingClothModel::step(float dt) {
+            configure_sleep(island_sleep);
+            impacts = 0;
+            // Swept from the start of the step, the anchors' scripted motion included
+            const bool continuous =
+                    imgui_panel::simulation_settings().model(imgui_panel::ModelType::HangingCloth).continuous_collision;
+            auto wake_on_impact = [this](std::size_t mass, float approach_speed) {
+                island_sleep.wake_on_contact(mass, approach_speed);
+            };
+            if (continuous) continuous_collision.begin(particles);
+            // Scripted anchors first, the rest cannot sleep while they move
+            step_start_time = time;
+            time += dt;
+            if (constraints.update(particles, step_start_time, dt)) island_sleep.wake_all();
+            // Nothing moves while every island sleeps
+            if (!island_sleep.any_awake()) return;
+            advance(dt);
+            // Impacts along the step first, so the proximity contacts below only see what is left
+            if (continuous) {
+                impacts = continuous_collision.collide_self(particles, bvh, dt, wake_on_impact);
+                if (impacts != 0) explicit_integrator.invalidate();
+            }
+            // Contacts are resolved on the integrated state, whatever the integrator
+            if (imgui_panel::simulation_settings().cloth_self_collision) {
+                self_collision.thickness = imgui_panel::simulation_settings().cloth_collision_thickness * min_mass_distance;
+                self_collision.solve(particles);
+                if (self_collision.contact_count() != 0) explicit_integrator.invalidate();
+            }
+            // The prop last, nothing pushes the masses back into it
+            if (!colliders.empty()) {
+                std::size_t hits = 0;
+                if (continuous) {
+                    hits = continuous_collision.collide(particles, colliders, wake_on_impact);
+                } else {
+                    std::atomic<std::size_t> moved{0};
+                    threading::pool().parallel_for(0, particles.dynamic_count(), 1024, [&](std::size_t begin, std::size_t end) {
+                        moved += colliders.project(particles, begin, end, [this](std::size_t i, const collision::Collider &,
+                                                                                 const glm::vec3 &normal) {
+                            island_sleep.wake_on_contact(i, -glm::dot(glm::vec3(particles.velocity(i)), normal));
+                        });
+                    });
+                    hits = moved;
                 }
+                impacts += hits;
+                if (hits != 0) explicit_integrator.invalidate();
+            }
+            island_sleep.update(particles, dt);
+            // Only the swept self impacts query the tree; kept fitted (and rebuilt once degraded) while they run
+            if (continuous) {
+                bvh.rebuild_ratio = imgui_panel::simulation_settings().bvh_rebuild_ratio;
+                bvh.update(particles);
+            }
+        }
+
+        void HangingClothModel::advance(float dt) {
+            g = glm::vec3(0.f, -1.f * imgui_panel::simulation_settings().gravity, 0.f);
+            step_dt = dt;
+            const imgui_panel::ModelSettings &settings =
+                    imgui_panel::simulation_settings().model(imgui_panel::ModelType::HangingCloth);
+            accumulation = settings.force_accumulation;
+            integrator = settings.integrator;
+            implicit_euler.max_iterations = settings.cg_max_iterations;
+            implicit_euler.tolerance = settings.cg_tolerance;
+            projective_dynamics.iterations = settings.pd_iterations;
+            xpbd.solver = settings.xpbd_solver;
+            xpbd.substeps = settings.xpbd_substeps;
+            xpbd.iterations = settings.xpbd_iterations;
+            xpbd.jacobi_relaxation = settings.xpbd_jacobi_relaxation;
+
+            if (integrator == integrators::Integrator::MultiRate) {
+                force_groups[0].rate = settings.rate_gravity;
+                force_groups[1].rate = settings.rate_drag;
+                force_groups[2].rate = settings.rate_springs;
+                multi_rate.step(particles, dt, force_groups);
+                return;
+            }
+            // Schemes that evaluate forces more than once per step drive the force phases themselves
+            if (step_graphs.count(integrator) == 0) {
+                explicit_integrator.step(integrator, particles, dt, [this] { force_graph.run(threading::pool()); });
+                return;
             }
+            step_graphs[integrator].run(threading::pool());
         }
 
         // Calculate normals for each vertex of the cloth
         // Assuming you have a function to calculate normals, replace this with your actual normal calculation method
-        glm::vec3 calculateNormal(primatives::Face face) {
-            return glm::normalize(glm::cross(face.mass_b->p - face.mass_a->p, face.mass_c->p - face.mass_a->p));
+        glm::vec3 calculateNormal(const primatives::ParticleSystem &particles, primatives::Face face) {
+            glm::vec3 p_a = particles.position(face.mass_a);
+            return glm::normalize(glm::cross(glm::vec3(particles.position(face.mass_b)) - p_a,
+                                             glm::vec3(particles.position(face.mass_c)) - p_a));
         }
 
-        void HangingClothModel::render(const ModelViewContext &view) {
+        void HangingClothModel::render(const ModelViewContext &view, const std::vector<glm::vec3> &positions) {
             triangle_geometry.triangles().clear();
 
             for (auto face: faces) {
                 triangle_geometry.push_back(
-                        givr::geometry::Triangle(givr::geometry::Point1(face.mass_a->p),
-                                                 givr::geometry::Point2(face.mass_b->p),
-                                                 givr::geometry::Point3(face.mass_c->p))
+                        givr::geometry::Triangle(givr::geometry::Point1(positions[face.mass_a]),
+                                                 givr::geometry::Point2(positions[face.mass_b]),
+                                                 givr::geometry::Point3(positions[face.mass_c]))
                 );
             }
 
             givr::updateRenderable(triangle_geometry, triangle_style, triangle_render);
             givr::style::draw(triangle_render, view);
+            if (!colliders.empty()) {
+                givr::style::draw(prop_render, view);
+            }
+        }
+
+        float HangingClothModel::stable_dt() {
+            const imgui_panel::ModelSettings &settings =
+                    imgui_panel::simulation_settings().model(imgui_panel::ModelType::HangingCloth);
+            if (settings.integrator == integrators::Integrator::MultiRate) {
+                // The stiff forces are semi-implicit Euler at dt / rate
+                return integrators::ExplicitIntegrator::stable_dt(integrators::Integrator::SemiImplicitEuler, max_frequency) *
+                       (float) settings.rate_springs;
+            }
+            return integrators::ExplicitIntegrator::stable_dt(settings.integrator, max_frequency);
+        }
+
+        std::string HangingClothModel::benchmark_spring_forces() {
+            return benchmark::spring_kernels(springs, particles);
+        }
+
+        std::string HangingClothModel::benchmark_precision() {
+            const imgui_panel::SimulationSettings &settings = imgui_panel::simulation_settings();
+            return benchmark::precision(springs, particles, glm::vec3(0.f, -1.f * settings.gravity, 0.f), c_d,
+                                        settings.dt_simulation, 1000);
+        }
+
+        std::string HangingClothModel::benchmark_integrators() {
+            g = glm::vec3(0.f, -1.f * imgui_panel::simulation_settings().gravity, 0.f);
+            accumulation =
+                    imgui_panel::simulation_settings().model(imgui_panel::ModelType::HangingCloth).force_accumulation;
+            return benchmark::explicit_integrators(particles, [this] { force_graph.run(threading::pool()); },
+                                                   imgui_panel::simulation_settings().dt_simulation, 0.5f);
         }
     } // namespace models
 } // namespace simulation
\ No newline at end of file
@@ -1,84 +1,38 @@
 #pragma once
 
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
 #include <vector>
 #include <givr.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "imgui_panel.hpp"
+#include "brick_map.hpp"
+#include "bvh.hpp"
+#include "colliders.hpp"
+#include "continuous_collision.hpp"
+#include "grid.hpp"
+#include "explicit_integrator.hpp"
+#include "implicit_euler.hpp"
+#include "integrators.hpp"
+#include "island_sleep.hpp"
+#include "kinematic_constraints.hpp"
+#include "multi_rate.hpp"
+#include "particle_system.hpp"
+#include "projective_dynamics.hpp"
+#include "self_collision.hpp"
+#include "spring_forces.hpp"
+#include "spring_table.hpp"
+#include "thread_pool.hpp"
+#include "xpbd.hpp"
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/compatibility.hpp> // lerp
 
 namespace simulation {
-	namespace primatives {
-		//Mass points used in all simulations
-		struct Mass {
-			bool fixed = false;
-            bool air_resistance = false;
-			glm::vec3 p = glm::vec3(0.f);
-			glm::vec3 v = glm::vec3(0.f);
-            glm::vec3 f = glm::vec3(0.f);
-            float m = 1.f;
-
-            // Integration function
-            void integrate(float dt) {
-                if (!fixed) {
-                    glm::vec3 a = f / m;
-                    v += a * dt;
-                    p += v * dt;
-                }
-            }
-
-            // Verlet Integration (For using when necessary)
-//            void integrate(float dt) {
-//                if (!fixed) {
-//                    glm::vec3 a = f / m;
-//                    glm::vec3 prevP = p;
-//                    p += (v + a * dt * 0.5f) * dt;
-//                    v = (p - prevP) / dt;
-//                }
-//            }
-
-        };
-
-		//Spring connections used in all simulations
-		struct Spring {
-			Mass* mass_a = nullptr;
-			Mass* mass_b = nullptr;
-            float rest_l = 0.f;
-            float k_s = 0.f;
-            float k_d = 0.f;
-
-            // Function to calculate spring length
-            float length() const {
-                return glm::length(mass_b->p - mass_a->p);
-            }
-
-            // Function to calculate spring force (applied on mass a)
-            glm::vec3 force_a() const {
-                glm::vec3 delta_p = mass_b->p - mass_a->p;
-                float current_l = glm::length(delta_p);
-                float displacement = current_l - rest_l;
-                glm::vec3 force = k_s * displacement * glm::normalize(delta_p);
-                glm::vec3 damping_force = k_d * (mass_a->v - mass_b->v);
-                return force - damping_force;
-            }
-
-            // Function to calculate spring force (applied on mass b)
-            glm::vec3 force_b() const {
-                return force_a() * -1.f;
-            }
-		};
-
-		//Face connections used (can just be a render primative or a simulation primatives for the bonus)
-		struct Face {
-			Mass* mass_a = nullptr;
-			Mass* mass_b = nullptr;
-			Mass* mass_c = nullptr;
-		};
-	} // namespace primatives
-
 	namespace models {
 		//If you want to use a different view, change this and the one in main
 		using ModelViewContext = givr::camera::ViewContext<givr::camera::TurnTableCamera, givr::camera::PerspectiveProjection>;
@@ -87,7 +41,28 @@ namespace simulation {
 		public:
 			virtual void reset() = 0;
 			virtual void step(float dt) = 0;
-			virtual void render(const ModelViewContext& view) = 0;
+			// Draws the model at the given positions (one per particle, e.g. interpolated between two steps)
+			virtual void render(const ModelViewContext& view, const std::vector<glm::vec3>& positions) = 0;
+			// Particles advanced by step(), saved and rolled back by integrators::StepController
+			virtual primatives::ParticleSystem& particle_state() = 0;
+			// Largest dt the current integrator stays stable at for this model's stiffness
+			virtual float stable_dt() { return std::numeric_limits<float>::infinity(); }
+			// Called after particle_state() was rolled back, drops anything integrators cached from the discarded step
+			virtual void state_restored() {}
+			// Report from benchmark::spring_kernels on the current state (empty if the model has no spring table)
+			virtual std::string benchmark_spring_forces() { return ""; }
+			// Report from benchmark::explicit_integrators on the current state (empty if not supported)
+			virtual std::string benchmark_integrators() { return ""; }
+			// Report from benchmark::precision on the current state (empty if the model has no spring table)
+			virtual std::string benchmark_precision() { return ""; }
+			// Wakes every sleeping island (parameters changed or the user interacted)
+			virtual void wake() {}
+			// Rest-state tracking of the model, nullptr if it never sleeps
+			virtual const integrators::IslandSleep* sleep_state() { return nullptr; }
+			// Collision contacts resolved in the last step
+			virtual std::size_t contact_count() { return 0; }
+			// Hierarchy over the model's faces at the last step, nullptr if it keeps none up to date
+			virtual const collision::BVH* face_bvh() { return nullptr; }
 		};
 
 		//Model constructing a single spring
@@ -96,7 +71,8 @@ namespace simulation {
 			MassOnSpringModel();
 			void reset();
 			void step(float dt);
-			void render(const ModelViewContext& view);
+			void render(const ModelViewContext& view, const std::vector<glm::vec3>& positions);
+			primatives::ParticleSystem& particle_state() { return particles; }
 
 			//Simulation Constants (you can re-assign values here from imgui)
 			glm::vec3 g = { 0.f, -9.81f, 0.f };
@@ -104,8 +80,7 @@ namespace simulation {
 
 		private:
 			//Simulation Parts
-			primatives::Mass mass_a;
-			primatives::Mass mass_b;
+			primatives::ParticleSystem particles;
 			primatives::Spring spring;
 
 			//Render
@@ -124,17 +99,38 @@ namespace simulation {
 			ChainPendulumModel();
 			void reset();
 			void step(float dt);
-			void render(const ModelViewContext& view);
+			void render(const ModelViewContext& view, const std::vector<glm::vec3>& positions);
+			primatives::ParticleSystem& particle_state() { return particles; }
+			float stable_dt();
+			void state_restored() { explicit_integrator.invalidate(); time = step_start_time; }
+			std::string benchmark_spring_forces();
+			std::string benchmark_integrators();
+			std::string benchmark_precision();
+			void wake() { island_sleep.wake_all(); explicit_integrator.invalidate(); }
+			const integrators::IslandSleep* sleep_state() { return &island_sleep; }
 
 			//Simulation Constants (you can re-assign values here from imgui)
 			glm::vec3 g = { 0.f, -9.81f, 0.f };
             float c_d = 0.005f;
 
 		private:
+			void advance(float dt);
+			void compute_forces(forces::Accumulation accumulation);
 
 			//Simulation Parts
-			std::vector<primatives::Mass> masses;
-			std::vector<primatives::Spring> springs;
+			primatives::ParticleSystem particles;
+			std::vector<std::uint32_t> link; // particle of each chain link (the anchor is partitioned to the tail)
+			primatives::KinematicConstraints constraints;
+			float time = 0.f, step_start_time = 0.f;
+			primatives::SpringTable springs;
+			forces::SpringForces spring_forces;
+			integrators::ExplicitIntegrator explicit_integrator;
+			integrators::ImplicitEuler implicit_euler;
+			integrators::ProjectiveDynamics projective_dynamics;
+			integrators::XPBD xpbd;
+			integrators::MultiRate multi_rate;
+			integrators::IslandSleep island_sleep;
+			float max_frequency = 0.f; // integrators::max_angular_frequency of the springs
 
 			//Render
 			givr::geometry::Sphere mass_geometry;
@@ -146,12 +142,36 @@ namespace simulation {
 			givr::RenderContext<givr::geometry::MultiLine, givr::style::LineStyle> spring_render;
 		};
 
+        //Static triangle mesh from an OBJ file, collided with through its signed distance field
+        struct Prop {
+            static constexpr float band_cells = 4.f; // narrow band of the field, in cells
+
+            collision::TriangleMesh mesh;
+            collision::Box bounds;
+            std::shared_ptr<const collision::BrickMap> sdf;
+            bool baked = false; // false if the field came from the cache
+            bool saved = false; // the cache holds the field, false if it was baked and could not be written
+            std::string cache_path;
+        };
+        // Loads every shape of file, scaled by scale, with its field of `cell` spacing from the cache file + ".sdf"
+        // (baked and written there if missing or stale); nullptr if the file has no triangles
+        std::shared_ptr<const Prop> load_prop(const std::string &file, float scale, float cell);
+
         class CubeOfJellyModel : public GenericModel {
         public:
-            CubeOfJellyModel();
+            CubeOfJellyModel(int obstacles = 0, std::shared_ptr<const Prop> prop = nullptr);
             void reset();
             void step(float dt);
-            void render(const ModelViewContext& view);
+            void render(const ModelViewContext& view, const std::vector<glm::vec3>& positions);
+            primatives::ParticleSystem& particle_state() { return particles; }
+            float stable_dt();
+            void state_restored() { explicit_integrator.invalidate(); }
+            std::string benchmark_spring_forces();
+            std::string benchmark_integrators();
+            std::string benchmark_precision();
+            void wake() { island_sleep.wake_all(); explicit_integrator.invalidate(); }
+            const integrators::IslandSleep* sleep_state() { return &island_sleep; }
+            std::size_t contact_count() { return impacts; }
 
             //Simulation Constants (you can re-assign values here from imgui)
             glm::vec3 g = { 0.f, -9.81f, 0.f };
@@ -159,13 +179,44 @@ namespace simulation {
             glm::vec3 offset = { 0.f,  10.f, 0.f };
             int cube_width = 7, cube_height = 6, cube_depth = 5;
             float min_mass_distance = 1.f, torque_intensity = 15.f, ground_height = -1.5f;
+            float ground_k_s = 100000.f, ground_k_d = 0.4f;
             std::vector<primatives::Face> faces;
 
         private:
+            void advance(float dt);
+            threading::TaskGraph::NodeId add_force_phases(threading::TaskGraph &graph);
+            void build_step_graph(integrators::Integrator mode);
+            void place_obstacles(int count);
+            void place_prop(const Prop &prop);
+            void apply_contacts(std::size_t begin, std::size_t end);
+            void project_out_of_colliders(std::size_t begin, std::size_t end);
 
             //Simulation Parts
-            std::vector<std::vector<std::vector<primatives::Mass>>> masses;
-            std::vector<primatives::Spring> springs;
+            primatives::Grid grid;
+            primatives::ParticleSystem particles;
+            primatives::SpringTable springs;
+            forces::SpringForces spring_forces;
+            integrators::ExplicitIntegrator explicit_integrator;
+            integrators::ImplicitEuler implicit_euler;
+            integrators::ProjectiveDynamics projective_dynamics;
+            integrators::XPBD xpbd;
+            integrators::MultiRate multi_rate;
+            integrators::IslandSleep island_sleep;
+            collision::ColliderSet colliders; // the ground plane, then the obstacles
+            collision::ContinuousCollision continuous_collision;
+            bool continuous = false;   // swept collider tests replace the penalty contact this step
+            std::size_t impacts = 0;   // masses that hit a collider in the last step
+            std::vector<integrators::MultiRate::ForceGroup> force_groups; // gravity, springs, collider contact
+            float max_frequency = 0.f; // integrators::max_angular_frequency of the springs (and collider contact)
+            float spring_frequency = 0.f; // of the springs alone, without penalty contact
+
+            //Step pipelines (phases as chunked tasks, built once), one per integrator that owns its step,
+            //plus the force phases alone for the explicit schemes that evaluate forces several times per step
+            std::map<integrators::Integrator, threading::TaskGraph> step_graphs;
+            threading::TaskGraph force_graph;
+            float step_dt = 0.f;
+            forces::Accumulation accumulation = forces::Accumulation::ColouredScatter;
+            integrators::Integrator integrator = integrators::Integrator::SemiImplicitEuler;
 
             //Render
             givr::geometry::TriangleSoup triangle_geometry;
@@ -175,14 +226,32 @@ namespace simulation {
             givr::geometry::Quad ground_geometry;
             givr::style::Phong ground_style;
             givr::RenderContext<givr::geometry::Quad, givr::style::Phong> ground_render;
+
+            givr::geometry::TriangleSoup obstacle_geometry;
+            givr::style::Phong obstacle_style;
+            givr::RenderContext<givr::geometry::TriangleSoup, givr::style::Phong> obstacle_render;
         };
 
         class HangingClothModel : public GenericModel {
         public:
-            HangingClothModel();
+            HangingClothModel(int width = 30, int height = 40, std::shared_ptr<const Prop> prop = nullptr);
             void reset();
             void step(float dt);
-            void render(const ModelViewContext& view);
+            void render(const ModelViewContext& view, const std::vector<glm::vec3>& positions);
+            primatives::ParticleSystem& particle_state() { return particles; }
+            float stable_dt();
+            void state_restored() { explicit_integrator.invalidate(); time = step_start_time; }
+            std::string benchmark_spring_forces();
+            std::string benchmark_integrators();
+            std::string benchmark_precision();
+            void wake() { island_sleep.wake_all(); explicit_integrator.invalidate(); }
+            const integrators::IslandSleep* sleep_state() { return &island_sleep; }
+            std::size_t contact_count() {
+                return (imgui_panel::simulation_settings().cloth_self_collision ? self_collision.contact_count() : 0) + impacts;
+            }
+            const collision::BVH* face_bvh() {
+                return imgui_panel::simulation_settings().model(imgui_panel::ModelType::HangingCloth).continuous_collision ? &bvh : nullptr;
+            }
 
             //Simulation Constants (you can re-assign values here from imgui)
             glm::vec3 g = { 0.f, -9.81f, 0.f };
@@ -192,15 +261,48 @@ namespace simulation {
             std::vector<primatives::Face> faces;
 
         private:
+            void advance(float dt);
+            threading::TaskGraph::NodeId add_force_phases(threading::TaskGraph &graph);
+            void build_step_graph(integrators::Integrator mode);
 
             //Simulation Parts
-            std::vector<std::vector<primatives::Mass>> masses;
-            std::vector<primatives::Spring> springs;
+            primatives::Grid grid;
+            primatives::ParticleSystem particles;
+            std::vector<std::uint32_t> slot; // particle of each grid point (the corners are partitioned to the tail)
+            primatives::KinematicConstraints constraints;
+            float time = 0.f, step_start_time = 0.f;
+            primatives::SpringTable springs;
+            forces::SpringForces spring_forces;
+            integrators::ExplicitIntegrator explicit_integrator;
+            integrators::ImplicitEuler implicit_euler;
+            integrators::ProjectiveDynamics projective_dynamics;
+            integrators::XPBD xpbd;
+            integrators::MultiRate multi_rate;
+            integrators::IslandSleep island_sleep;
+            collision::SelfCollision self_collision;
+            collision::ContinuousCollision continuous_collision;
+            std::size_t impacts = 0; // swept self impacts and prop contacts of the last step
+            collision::BVH bvh;
+            collision::ColliderSet colliders; // the prop, if any
+            std::vector<integrators::MultiRate::ForceGroup> force_groups; // gravity, drag, springs
+            float max_frequency = 0.f; // integrators::max_angular_frequency of the springs
+
+            //Step pipelines (phases as chunked tasks, built once), one per integrator that owns its step,
+            //plus the force phases alone for the explicit schemes that evaluate forces several times per step
+            std::map<integrators::Integrator, threading::TaskGraph> step_graphs;
+            threading::TaskGraph force_graph;
+            float step_dt = 0.f;
+            forces::Accumulation accumulation = forces::Accumulation::ColouredScatter;
+            integrators::Integrator integrator = integrators::Integrator::SemiImplicitEuler;
 
             //Render
             givr::geometry::TriangleSoup triangle_geometry;
             givr::style::Phong triangle_style;
             givr::RenderContext<givr::geometry::TriangleSoup, givr::style::Phong> triangle_render;
+
+            givr::geometry::TriangleSoup prop_geometry;
+            givr::style::Phong prop_style;
+            givr::RenderContext<givr::geometry::TriangleSoup, givr::style::Phong> prop_render;
         };
     } // namespace models
 } // namespace simulation
\ No newline at end of file
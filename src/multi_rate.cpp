@@ -0,0 +1,63 @@
+#include <algorithm>
+
+#include "multi_rate.hpp"
+#include "thread_pool.hpp"
+
+namespace simulation {
+    namespace integrators {
+        namespace {
+            const std::size_t grain = 1024;
+        }
+
+        int MultiRate::substeps(const std::vector<ForceGroup> &groups) {
+            int count = 1;
+            for (const ForceGroup &group: groups) {
+                count = std::max(count, group.rate);
+            }
+            return count;
+        }
+
+        void MultiRate::step(primatives::ParticleSystem &particles, float dt, const std::vector<ForceGroup> &groups) {
+            const std::size_t n = particles.size();
+            held.resize(groups.size());
+            for (Forces &forces: held) {
+                forces.resize(n);
+            }
+
+            const int count = substeps(groups);
+            const float h = dt / (float) count;
+            threading::ThreadPool &pool = threading::pool();
+            for (int s = 0; s < count; ++s) {
+                for (std::size_t g = 0; g < groups.size(); ++g) {
+                    // Due whenever floor(s * rate / count) advances: exactly `rate` times per step
+                    int rate = std::min(std::max(groups[g].rate, 1), count);
+                    if (s != 0 && (s * rate) / count == ((s - 1) * rate) / count) continue;
+                    pool.parallel_for(0, n, grain, [&](std::size_t begin, std::size_t end) {
+                        std::fill(particles.fx.begin() + begin, particles.fx.begin() + end, primatives::Accumulator(0));
+                        std::fill(particles.fy.begin() + begin, particles.fy.begin() + end, primatives::Accumulator(0));
+                        std::fill(particles.fz.begin() + begin, particles.fz.begin() + end, primatives::Accumulator(0));
+                    });
+                    groups[g].add_forces();
+                    Forces &forces = held[g];
+                    pool.parallel_for(0, n, grain, [&](std::size_t begin, std::size_t end) {
+                        for (std::size_t i = begin; i < end; ++i) {
+                            forces[i] = particles.force(i);
+                        }
+                    });
+                }
+
+                // Total of the fresh and held forces, then one semi-implicit Euler sub-step
+                pool.parallel_for(0, n, grain, [&](std::size_t begin, std::size_t end) {
+                    for (std::size_t i = begin; i < end; ++i) {
+                        primatives::ParticleSystem::ForceVec3 f(0);
+                        for (const Forces &forces: held) {
+                            f += forces[i];
+                        }
+                        particles.set_force(i, f);
+                    }
+                    particles.integrate(h, begin, end);
+                });
+            }
+        }
+    } // namespace integrators
+} // namespace simulation
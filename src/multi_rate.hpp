@@ -0,0 +1,33 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "particle_system.hpp"
+
+namespace simulation {
+    namespace integrators {
+        //Multi-rate semi-implicit Euler: a step of dt is split into as many sub-steps as the fastest force group asks
+        //for, and each group is only re-evaluated `rate` times per step, evenly spread. In between its last forces
+        //are held, so stiff terms (springs, penalty contact) can be sub-stepped while slowly varying ones
+        //(gravity, drag) are evaluated once per outer step.
+        class MultiRate {
+        public:
+            struct ForceGroup {
+                int rate = 1;                       // evaluations per step
+                std::function<void()> add_forces;   // adds the group's forces to particles.f at the current state
+            };
+
+            void step(primatives::ParticleSystem &particles, float dt, const std::vector<ForceGroup> &groups);
+
+            static int substeps(const std::vector<ForceGroup> &groups);
+
+        private:
+            using Forces = std::vector<primatives::ParticleSystem::ForceVec3>;
+
+            std::vector<Forces> held; // per group, per mass
+        };
+    } // namespace integrators
+} // namespace simulation
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cmath>
+
+#include "particle_system.hpp"
+
+namespace simulation {
+    namespace primatives {
+        template<typename Scalar, typename Accumulator>
+        void BasicParticleSystem<Scalar, Accumulator>::resize(std::size_t n) {
+            px.resize(n, 0.f);
+            py.resize(n, 0.f);
+            pz.resize(n, 0.f);
+            vx.resize(n, 0.f);
+            vy.resize(n, 0.f);
+            vz.resize(n, 0.f);
+            fx.resize(n, 0.f);
+            fy.resize(n, 0.f);
+            fz.resize(n, 0.f);
+            m.resize(n, 1.f);
+            inv_mass.resize(n, 1.f);
+            air_resistance_flags.resize(n);
+            dynamic = n;
+        }
+
+        template<typename Scalar, typename Accumulator>
+        std::vector<std::uint32_t> BasicParticleSystem<Scalar, Accumulator>::partition(const FlagBits &constrained) {
+            const std::size_t n = size();
+            std::vector<std::uint32_t> new_index(n), order;
+            order.reserve(n);
+            for (int tail = 0; tail < 2; ++tail) {
+                for (std::size_t i = 0; i < n; ++i) {
+                    if (constrained.test(i) != (tail == 1)) continue;
+                    new_index[i] = (std::uint32_t) order.size();
+                    order.push_back((std::uint32_t) i);
+                }
+                if (tail == 0) dynamic = order.size();
+            }
+
+            auto permute = [&](auto &stream) {
+                auto old = stream;
+                for (std::size_t i = 0; i < n; ++i) stream[i] = old[order[i]];
+            };
+            permute(px), permute(py), permute(pz);
+            permute(vx), permute(vy), permute(vz);
+            permute(fx), permute(fy), permute(fz);
+            permute(m), permute(inv_mass);
+            FlagBits air = air_resistance_flags;
+            for (std::size_t i = 0; i < n; ++i) air_resistance_flags.set(i, air.test(order[i]));
+            return new_index;
+        }
+
+        template<typename Scalar, typename Accumulator>
+        void BasicParticleSystem<Scalar, Accumulator>::copy_positions(std::vector<glm::vec3> &out) const {
+            out.resize(size());
+            for (std::size_t i = 0; i < size(); ++i) {
+                out[i] = glm::vec3((float) px[i], (float) py[i], (float) pz[i]);
+            }
+        }
+
+        template<typename Scalar, typename Accumulator>
+        void BasicParticleSystem<Scalar, Accumulator>::apply_gravity(const glm::vec3 &g, std::size_t begin, std::size_t end) {
+            end = std::min(end, dynamic);
+            for (std::size_t i = begin; i < end; ++i) {
+                fx[i] = (Accumulator) m[i] * g.x;
+                fy[i] = (Accumulator) m[i] * g.y;
+                fz[i] = (Accumulator) m[i] * g.z;
+            }
+        }
+
+        template<typename Scalar, typename Accumulator>
+        void BasicParticleSystem<Scalar, Accumulator>::apply_air_resistance(float c_d, std::size_t begin, std::size_t end) {
+            // -|v|^2 * c_d * normalize(v) == -c_d * |v| * v, which is also zero for v == 0
+            end = std::min(end, dynamic);
+            for (std::size_t i = begin; i < end; ++i) {
+                if (!air_resistance_flags.test(i)) continue;
+                Scalar speed = std::sqrt(vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i]);
+                Scalar s = -c_d * speed;
+                fx[i] += s * vx[i];
+                fy[i] += s * vy[i];
+                fz[i] += s * vz[i];
+            }
+        }
+
+        template<typename Scalar, typename Accumulator>
+        void BasicParticleSystem<Scalar, Accumulator>::integrate(float dt, std::size_t begin, std::size_t end) {
+            end = std::min(end, dynamic);
+            for (std::size_t i = begin; i < end; ++i) {
+                vx[i] += (Scalar) (fx[i] * inv_mass[i] * dt);
+                vy[i] += (Scalar) (fy[i] * inv_mass[i] * dt);
+                vz[i] += (Scalar) (fz[i] * inv_mass[i] * dt);
+                px[i] += vx[i] * dt;
+                py[i] += vy[i] * dt;
+                pz[i] += vz[i] * dt;
+            }
+        }
+
+        //Every layout of Precision, so the precision benchmark can run them side by side in any build
+        template class BasicParticleSystem<float, float>;
+        template class BasicParticleSystem<double, double>;
+        template class BasicParticleSystem<float, double>;
+    } // namespace primatives
+} // namespace simulation
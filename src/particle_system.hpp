@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "precision.hpp"
+
+namespace simulation {
+    namespace primatives {
+        //Packed per-particle boolean flags (one bit per particle)
+        class FlagBits {
+        public:
+            void resize(std::size_t n) { words.resize((n + 63) / 64, 0ull); }
+
+            bool test(std::size_t i) const { return (words[i >> 6] >> (i & 63)) & 1ull; }
+
+            void set(std::size_t i, bool value) {
+                if (value) {
+                    words[i >> 6] |= 1ull << (i & 63);
+                } else {
+                    words[i >> 6] &= ~(1ull << (i & 63));
+                }
+            }
+
+            bool any() const {
+                for (std::uint64_t word: words) {
+                    if (word != 0ull) return true;
+                }
+                return false;
+            }
+
+        private:
+            std::vector<std::uint64_t> words;
+        };
+
+        //Structure-of-arrays store for the mass points of a simulation.
+        //Each pass (forces, drag, integration) only streams the components it touches.
+        //State is held as Scalar and forces are summed as Accumulator (see Precision); set-up and
+        //render upload go through glm::vec3.
+        template<typename Scalar, typename Accumulator = Scalar>
+        class BasicParticleSystem {
+        public:
+            using Vec3 = glm::vec<3, Scalar>;
+            using ForceVec3 = glm::vec<3, Accumulator>;
+
+            BasicParticleSystem() = default;
+            explicit BasicParticleSystem(std::size_t n) { resize(n); }
+
+            void resize(std::size_t n);
+            std::size_t size() const { return px.size(); }
+
+            // Per-particle accessors (convenience for set-up and rendering, not for hot loops)
+            Vec3 position(std::size_t i) const { return {px[i], py[i], pz[i]}; }
+            Vec3 velocity(std::size_t i) const { return {vx[i], vy[i], vz[i]}; }
+            ForceVec3 force(std::size_t i) const { return {fx[i], fy[i], fz[i]}; }
+            Scalar mass(std::size_t i) const { return m[i]; }
+            bool fixed(std::size_t i) const { return i >= dynamic; }
+            bool air_resistance(std::size_t i) const { return air_resistance_flags.test(i); }
+
+            void set_position(std::size_t i, const Vec3 &p) { px[i] = p.x; py[i] = p.y; pz[i] = p.z; }
+            void set_velocity(std::size_t i, const Vec3 &v) { vx[i] = v.x; vy[i] = v.y; vz[i] = v.z; }
+            void set_force(std::size_t i, const ForceVec3 &f) { fx[i] = f.x; fy[i] = f.y; fz[i] = f.z; }
+            void add_force(std::size_t i, const ForceVec3 &f) { fx[i] += f.x; fy[i] += f.y; fz[i] += f.z; }
+            void set_mass(std::size_t i, Scalar mass) { m[i] = mass; inv_mass[i] = Scalar(1) / mass; }
+            void set_air_resistance(std::size_t i, bool value) { air_resistance_flags.set(i, value); }
+            // Resizes out to size() and copies the positions into it (snapshots for rendering)
+            void copy_positions(std::vector<glm::vec3> &out) const;
+
+            // Masses [0, dynamic_count()) are integrated. The constrained tail [dynamic_count(), size()) is placed
+            // by KinematicConstraints (pins, paths, rigid attachments); the bulk passes below never visit it.
+            std::size_t dynamic_count() const { return dynamic; }
+            // Stable-partitions the masses flagged in `constrained` into the tail and returns the new index of
+            // every old one. Meant for set-up, before anything refers to the masses by index.
+            std::vector<std::uint32_t> partition(const FlagBits &constrained);
+
+            // Bulk passes, over all particles or over [begin, end) so they can be chunked across threads
+            void apply_gravity(const glm::vec3 &g) { apply_gravity(g, 0, size()); }
+            void apply_air_resistance(float c_d) { apply_air_resistance(c_d, 0, size()); }
+            void integrate(float dt) { integrate(dt, 0, size()); }
+            // The range passes clamp [begin, end) to the dynamic masses
+            void apply_gravity(const glm::vec3 &g, std::size_t begin, std::size_t end);    // f = m * g (overwrites previous forces)
+            void apply_air_resistance(float c_d, std::size_t begin, std::size_t end);      // f += -c_d * |v| * v on flagged particles
+            void integrate(float dt, std::size_t begin, std::size_t end);                  // Semi-implicit Euler
+
+            //Component streams
+            std::vector<Scalar> px, py, pz;
+            std::vector<Scalar> vx, vy, vz;
+            std::vector<Accumulator> fx, fy, fz;
+            std::vector<Scalar> m, inv_mass;
+            FlagBits air_resistance_flags;
+
+        private:
+            std::size_t dynamic = 0;
+        };
+
+        //Particle store of this build (see build_precision)
+        using ParticleSystem = BasicParticleSystem<Scalar, Accumulator>;
+    } // namespace primatives
+} // namespace simulation
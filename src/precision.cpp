@@ -0,0 +1,14 @@
+#include "precision.hpp"
+
+namespace simulation {
+    const char *precision_name(Precision precision) {
+        switch (precision) {
+            case Precision::Double:
+                return "double";
+            case Precision::Mixed:
+                return "mixed (float storage, double sums)";
+            default:
+                return "single";
+        }
+    }
+} // namespace simulation
@@ -0,0 +1,41 @@
+#pragma once
+
+namespace simulation {
+    //Floating point layout of the simulation state
+    enum class Precision {
+        Single,     // float state and force sums
+        Double,     // double state and force sums (the SIMD spring kernels are unavailable)
+        Mixed       // float state, spring math and render upload; forces summed in double
+    };
+    const char *precision_name(Precision precision);
+
+    template<Precision P>
+    struct PrecisionTypes {
+        using Scalar = float;       // positions, velocities, masses
+        using Accumulator = float;  // force streams
+    };
+    template<>
+    struct PrecisionTypes<Precision::Double> {
+        using Scalar = double;
+        using Accumulator = double;
+    };
+    template<>
+    struct PrecisionTypes<Precision::Mixed> {
+        using Scalar = float;
+        using Accumulator = double;
+    };
+
+    //Precision of this build, set by the SIMULATION_PRECISION CMake option (single, double or mixed)
+#if defined(SIMULATION_PRECISION_DOUBLE)
+    constexpr Precision build_precision = Precision::Double;
+#elif defined(SIMULATION_PRECISION_MIXED)
+    constexpr Precision build_precision = Precision::Mixed;
+#else
+    constexpr Precision build_precision = Precision::Single;
+#endif
+
+    namespace primatives {
+        using Scalar = PrecisionTypes<build_precision>::Scalar;
+        using Accumulator = PrecisionTypes<build_precision>::Accumulator;
+    } // namespace primatives
+} // namespace simulation
@@ -0,0 +1,141 @@
+#include <algorithm>
+
+#include "projective_dynamics.hpp"
+#include "thread_pool.hpp"
+
+namespace simulation {
+    namespace integrators {
+        void ProjectiveDynamics::build(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles) {
+            const std::size_t n = particles.size();
+            adjacency.build(springs, n);
+
+            // Coupling graph of the free masses (fixed ones are eliminated from the system)
+            std::vector<std::uint32_t> offsets(n + 1, 0), neighbours;
+            neighbours.reserve(adjacency.entries.size());
+            for (std::size_t i = 0; i < n; ++i) {
+                if (!particles.fixed(i)) {
+                    for (std::uint32_t k = adjacency.row_begin(i); k < adjacency.row_end(i); ++k) {
+                        const primatives::Spring &spring = springs[adjacency.spring_of(adjacency.entries[k])];
+                        std::uint32_t other = adjacency.is_mass_b(adjacency.entries[k]) ? spring.mass_a : spring.mass_b;
+                        if (!particles.fixed(other)) neighbours.push_back(other);
+                    }
+                }
+                offsets[i + 1] = (std::uint32_t) neighbours.size();
+            }
+
+            order = nested_dissection(offsets, neighbours);
+            slot.resize(n);
+            for (std::size_t r = 0; r < n; ++r) {
+                slot[order[r]] = (std::uint32_t) r;
+            }
+
+            // Same graph in solve order
+            std::vector<std::uint32_t> solve_offsets(n + 1, 0), solve_neighbours;
+            solve_neighbours.reserve(neighbours.size());
+            for (std::size_t r = 0; r < n; ++r) {
+                for (std::uint32_t k = offsets[order[r]]; k < offsets[order[r] + 1]; ++k) {
+                    solve_neighbours.push_back(slot[neighbours[k]]);
+                }
+                solve_offsets[r + 1] = (std::uint32_t) solve_neighbours.size();
+            }
+            cholesky.analyse(solve_offsets, solve_neighbours);
+            factored_dt = 0.f;
+
+            inertial.assign(n, glm::vec3(0.f));
+            current.assign(n, glm::vec3(0.f));
+            projections.assign(springs.size(), glm::vec3(0.f));
+            rhs.assign(n, glm::vec4(0.f));
+        }
+
+        void ProjectiveDynamics::factor(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles,
+                                        float dt) {
+            cholesky.set_zero();
+            for (std::size_t i = 0; i < particles.size(); ++i) {
+                cholesky.at(slot[i], slot[i]) = particles.fixed(i) ? 1.f : particles.mass(i) / (dt * dt);
+            }
+            for (const primatives::Spring &spring: springs) {
+                const bool fixed_a = particles.fixed(spring.mass_a), fixed_b = particles.fixed(spring.mass_b);
+                const std::uint32_t a = slot[spring.mass_a], b = slot[spring.mass_b];
+                if (!fixed_a) cholesky.at(a, a) += spring.k_s;
+                if (!fixed_b) cholesky.at(b, b) += spring.k_s;
+                if (!fixed_a && !fixed_b) cholesky.at(a, b) -= spring.k_s;
+            }
+            // Positive masses make the matrix strictly diagonally dominant, so this cannot fail
+            cholesky.factor();
+            factored_dt = dt;
+        }
+
+        void ProjectiveDynamics::project(const primatives::SpringTable &springs, std::size_t begin, std::size_t end) {
+            for (std::size_t s = begin; s < end; ++s) {
+                glm::vec3 d = current[springs[s].mass_b] - current[springs[s].mass_a];
+                float l = glm::length(d);
+                projections[s] = l > 0.f ? d * (springs[s].rest_l / l) : d;
+            }
+        }
+
+        void ProjectiveDynamics::gather(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles,
+                                        float dt, std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                if (particles.fixed(i)) {
+                    rhs[slot[i]] = glm::vec4(current[i], 0.f);
+                    continue;
+                }
+                glm::vec3 sum = (float) particles.mass(i) / (dt * dt) * inertial[i];
+                for (std::uint32_t k = adjacency.row_begin(i); k < adjacency.row_end(i); ++k) {
+                    std::uint32_t entry = adjacency.entries[k];
+                    const primatives::Spring &spring = springs[adjacency.spring_of(entry)];
+                    glm::vec3 p = projections[adjacency.spring_of(entry)];
+                    std::uint32_t other = adjacency.is_mass_b(entry) ? spring.mass_a : spring.mass_b;
+                    sum += adjacency.is_mass_b(entry) ? spring.k_s * p : -spring.k_s * p;
+                    // Coupling to a fixed mass moves to the right-hand side
+                    if (particles.fixed(other)) sum += spring.k_s * current[other];
+                }
+                rhs[slot[i]] = glm::vec4(sum, 0.f);
+            }
+        }
+
+        void ProjectiveDynamics::step(const primatives::SpringTable &springs, primatives::ParticleSystem &particles,
+                                      float dt) {
+            threading::ThreadPool &pool = threading::pool();
+            if (slot.size() != particles.size() || projections.size() != springs.size()) build(springs, particles);
+            if (dt != factored_dt) factor(springs, particles, dt);
+
+            // Inertial target, also the initial guess
+            pool.parallel_for(0, particles.size(), 2048, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    inertial[i] = particles.position(i);
+                    if (!particles.fixed(i)) {
+                        inertial[i] += dt * glm::vec3(particles.velocity(i)) +
+                                       (dt * dt * (float) particles.inv_mass[i]) * glm::vec3(particles.force(i));
+                    }
+                    current[i] = inertial[i];
+                }
+            });
+
+            for (int iteration = 0; iteration < iterations; ++iteration) {
+                // Local step
+                pool.parallel_for(0, springs.size(), 4096, [&](std::size_t begin, std::size_t end) {
+                    project(springs, begin, end);
+                });
+                // Global step
+                pool.parallel_for(0, particles.size(), 2048, [&](std::size_t begin, std::size_t end) {
+                    gather(springs, particles, dt, begin, end);
+                });
+                cholesky.solve(rhs);
+                pool.parallel_for(0, particles.size(), 2048, [&](std::size_t begin, std::size_t end) {
+                    for (std::size_t i = begin; i < end; ++i) {
+                        current[i] = glm::vec3(rhs[slot[i]]);
+                    }
+                });
+            }
+
+            pool.parallel_for(0, particles.dynamic_count(), 2048, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    particles.set_velocity(i, (primatives::ParticleSystem::Vec3(current[i]) - particles.position(i)) /
+                                              primatives::Scalar(dt));
+                    particles.set_position(i, current[i]);
+                }
+            });
+        }
+    } // namespace integrators
+} // namespace simulation
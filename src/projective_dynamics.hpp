@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "particle_system.hpp"
+#include "sparse_cholesky.hpp"
+#include "spring_adjacency.hpp"
+#include "spring_table.hpp"
+
+namespace simulation {
+    namespace integrators {
+        //Projective Dynamics for spring networks (Bouaziz et al. 2014). A step minimises
+        //      |M^1/2 (x - s)|^2 / (2 h^2) + sum k_s / 2 |x_b - x_a - p|^2,     s = x + h v + h^2 M^-1 f_ext
+        //by alternating a local step, which projects every spring onto its rest length (p = rest_l * d / |d|,
+        //parallel over springs), and a global step, which solves the constant system
+        //      (M / h^2 + sum k_s (e_a - e_b)(e_a - e_b)^T) x = M s / h^2 + sum k_s (e_b - e_a) p
+        //for all three coordinates at once with a sparse Cholesky factor (nested dissection ordering) whose
+        //pattern is computed once per topology and whose values are refactored only when the time step changes.
+        //Spring damping k_d is not modelled; the implicit projection is dissipative by itself.
+        //Fixed particles are eliminated from the system and keep their positions.
+        class ProjectiveDynamics {
+        public:
+            // Computes the fill-reducing ordering and the pattern of the factor; must be called again when the
+            // springs, masses or fixed flags change
+            void build(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles);
+
+            // particles.f must hold the external forces (gravity, drag, ...) only, not the spring forces.
+            // Refactors the system matrix first if dt differs from the previous step.
+            void step(const primatives::SpringTable &springs, primatives::ParticleSystem &particles, float dt);
+
+            int iterations = 10;
+
+            std::size_t factor_entries() const { return cholesky.factor_entries(); }
+
+        private:
+            void factor(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles, float dt);
+            void project(const primatives::SpringTable &springs, std::size_t begin, std::size_t end);
+            void gather(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles, float dt,
+                        std::size_t begin, std::size_t end);
+
+            primatives::SpringAdjacency adjacency;
+            std::vector<std::uint32_t> order;       // solve index -> mass
+            std::vector<std::uint32_t> slot;        // mass -> solve index
+            SparseCholesky cholesky;
+            float factored_dt = 0.f;
+
+            std::vector<glm::vec3> inertial;        // s, per mass
+            std::vector<glm::vec3> current;         // x during the iterations, per mass
+            std::vector<glm::vec3> projections;     // p, per spring
+            std::vector<glm::vec4> rhs;             // per solve index, w = 0
+        };
+    } // namespace integrators
+} // namespace simulation
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+namespace simulation {
+    namespace collision {
+        //Axis-aligned bounding box
+        struct Box {
+            glm::vec3 min{0.f}, max{0.f};
+        };
+
+        inline bool overlaps(const Box &a, const Box &b) {
+            return glm::all(glm::lessThanEqual(a.min, b.max)) && glm::all(glm::lessThanEqual(b.min, a.max));
+        }
+
+        inline bool contains(const Box &box, const glm::vec3 &p) {
+            return glm::all(glm::lessThanEqual(box.min, p)) && glm::all(glm::lessThanEqual(p, box.max));
+        }
+
+        inline Box merge(const Box &a, const Box &b) { return {glm::min(a.min, b.min), glm::max(a.max, b.max)}; }
+
+        inline float surface_area(const Box &box) {
+            glm::vec3 d = glm::max(box.max - box.min, glm::vec3(0.f));
+            return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+        }
+
+        //Closest point to p on triangle abc (Ericson, Real-Time Collision Detection 5.1.5), as barycentric weights
+        //of a, b and c
+        inline glm::vec3 closest_on_triangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+            glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+            float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+            if (d1 <= 0.f && d2 <= 0.f) return {1.f, 0.f, 0.f};
+
+            glm::vec3 bp = p - b;
+            float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+            if (d3 >= 0.f && d4 <= d3) return {0.f, 1.f, 0.f};
+
+            float vc = d1 * d4 - d3 * d2;
+            if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f) {
+                float v = d1 / (d1 - d3);
+                return {1.f - v, v, 0.f};
+            }
+
+            glm::vec3 cp = p - c;
+            float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+            if (d6 >= 0.f && d5 <= d6) return {0.f, 0.f, 1.f};
+
+            float vb = d5 * d2 - d1 * d6;
+            if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f) {
+                float w = d2 / (d2 - d6);
+                return {1.f - w, 0.f, w};
+            }
+
+            float va = d3 * d6 - d5 * d4;
+            if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f) {
+                float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+                return {0.f, 1.f - w, w};
+            }
+
+            float denominator = 1.f / (va + vb + vc);
+            float v = vb * denominator, w = vc * denominator;
+            return {1.f - v - w, v, w};
+        }
+
+        //Closest points of segments p0p1 and q0q1 (Ericson 5.1.9), as parameters s on p and t on q
+        inline glm::vec2 closest_on_segments(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &q0, const glm::vec3 &q1) {
+            const float epsilon = 1.e-12f;
+            glm::vec3 d1 = p1 - p0, d2 = q1 - q0, r = p0 - q0;
+            float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+            if (a <= epsilon && e <= epsilon) return {0.f, 0.f};
+            if (a <= epsilon) return {0.f, glm::clamp(f / e, 0.f, 1.f)};
+
+            float c = glm::dot(d1, r);
+            if (e <= epsilon) return {glm::clamp(-c / a, 0.f, 1.f), 0.f};
+
+            float b = glm::dot(d1, d2), denominator = a * e - b * b;
+            // Parallel segments pick s = 0
+            float s = denominator > epsilon ? glm::clamp((b * f - c * e) / denominator, 0.f, 1.f) : 0.f;
+            float t = (b * s + f) / e;
+            if (t < 0.f) {
+                t = 0.f;
+                s = glm::clamp(-c / a, 0.f, 1.f);
+            } else if (t > 1.f) {
+                t = 1.f;
+                s = glm::clamp((b - c) / a, 0.f, 1.f);
+            }
+            return {s, t};
+        }
+
+        //Ray origin + t * direction against triangle abc (Moller-Trumbore). Returns t, or a negative value on a miss;
+        //barycentric receives the weights of a, b and c at the hit
+        inline float intersect_triangle(const glm::vec3 &origin, const glm::vec3 &direction, const glm::vec3 &a,
+                                        const glm::vec3 &b, const glm::vec3 &c, glm::vec3 &barycentric) {
+            glm::vec3 ab = b - a, ac = c - a;
+            glm::vec3 pv = glm::cross(direction, ac);
+            float determinant = glm::dot(ab, pv);
+            if (std::abs(determinant) < 1.e-12f) return -1.f;
+            float inv_determinant = 1.f / determinant;
+            glm::vec3 tv = origin - a;
+            float u = glm::dot(tv, pv) * inv_determinant;
+            if (u < 0.f || u > 1.f) return -1.f;
+            glm::vec3 qv = glm::cross(tv, ab);
+            float v = glm::dot(direction, qv) * inv_determinant;
+            if (v < 0.f || u + v > 1.f) return -1.f;
+            barycentric = {1.f - u - v, u, v};
+            return glm::dot(ac, qv) * inv_determinant;
+        }
+
+        //Trilinear interpolation at f in [0, 1]^3 between the corner values c[x + 2 y + 4 z] of a cell, and its exact
+        //gradient (per unit of f)
+        inline float trilinear(const float c[8], const glm::vec3 &f, glm::vec3 &gradient) {
+            float c00 = glm::mix(c[0], c[1], f.x), c10 = glm::mix(c[2], c[3], f.x);
+            float c01 = glm::mix(c[4], c[5], f.x), c11 = glm::mix(c[6], c[7], f.x);
+            float c0 = glm::mix(c00, c10, f.y), c1 = glm::mix(c01, c11, f.y);
+            gradient.x = glm::mix(glm::mix(c[1] - c[0], c[3] - c[2], f.y), glm::mix(c[5] - c[4], c[7] - c[6], f.y), f.z);
+            gradient.y = glm::mix(c10 - c00, c11 - c01, f.z);
+            gradient.z = c1 - c0;
+            return glm::mix(c0, c1, f.z);
+        }
+    } // namespace collision
+} // namespace simulation
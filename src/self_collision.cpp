@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <mutex>
+#include <tuple>
+
+#include "proximity.hpp"
+#include "self_collision.hpp"
+#include "thread_pool.hpp"
+
+namespace simulation {
+    namespace collision {
+        namespace {
+            const std::size_t grain = 256;
+        }
+
+        std::vector<glm::uvec2> mesh_edges(const std::vector<primatives::Face> &faces, std::vector<glm::uvec3> *face_edges) {
+            auto ordered = [](std::uint32_t a, std::uint32_t b) { return a < b ? glm::uvec2(a, b) : glm::uvec2(b, a); };
+            auto less = [](const glm::uvec2 &a, const glm::uvec2 &b) { return std::make_tuple(a.x, a.y) < std::make_tuple(b.x, b.y); };
+            std::vector<glm::uvec2> edges;
+            edges.reserve(faces.size() * 3);
+            for (const primatives::Face &face: faces) {
+                edges.push_back(ordered(face.mass_a, face.mass_b));
+                edges.push_back(ordered(face.mass_b, face.mass_c));
+                edges.push_back(ordered(face.mass_c, face.mass_a));
+            }
+            // Edges shared by two faces once
+            std::sort(edges.begin(), edges.end(), less);
+            edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+            if (face_edges) {
+                auto index = [&](std::uint32_t a, std::uint32_t b) {
+                    return (std::uint32_t) (std::lower_bound(edges.begin(), edges.end(), ordered(a, b), less) - edges.begin());
+                };
+                face_edges->resize(faces.size());
+                for (std::size_t f = 0; f < faces.size(); ++f) {
+                    const primatives::Face &face = faces[f];
+                    (*face_edges)[f] = {index(face.mass_a, face.mass_b), index(face.mass_b, face.mass_c), index(face.mass_c, face.mass_a)};
+                }
+            }
+            return edges;
+        }
+
+        void SelfCollision::build(const std::vector<primatives::Face> &faces, float cell_size) {
+            this->faces = faces;
+            this->cell_size = cell_size;
+            edges = mesh_edges(faces);
+            contacts.clear();
+        }
+
+        void SelfCollision::solve(primatives::ParticleSystem &particles) {
+            contacts.clear();
+            if (faces.empty()) return;
+            threading::ThreadPool &pool = threading::pool();
+            const std::size_t n = particles.size();
+
+            //Snapshot of the positions, then the boxes: faces grown by the thickness, edges by half of it each
+            positions.resize(n);
+            pool.parallel_for(0, n, 1024, [this, &particles](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i) positions[i] = glm::vec3(particles.position(i));
+            });
+            face_boxes.resize(faces.size());
+            pool.parallel_for(0, faces.size(), 1024, [this](std::size_t begin, std::size_t end) {
+                for (std::size_t f = begin; f < end; ++f) {
+                    const glm::vec3 &a = positions[faces[f].mass_a], &b = positions[faces[f].mass_b], &c = positions[faces[f].mass_c];
+                    face_boxes[f] = {glm::min(glm::min(a, b), c) - thickness, glm::max(glm::max(a, b), c) + thickness};
+                }
+            });
+            edge_boxes.resize(edges.size());
+            pool.parallel_for(0, edges.size(), 1024, [this](std::size_t begin, std::size_t end) {
+                for (std::size_t e = begin; e < end; ++e) {
+                    const glm::vec3 &a = positions[edges[e].x], &b = positions[edges[e].y];
+                    edge_boxes[e] = {glm::min(a, b) - 0.5f * thickness, glm::max(a, b) + 0.5f * thickness};
+                }
+            });
+            const float cell = std::max(cell_size, thickness);
+            face_hash.build(face_boxes, cell);
+            edge_hash.build(edge_boxes, cell);
+
+            //Detection, in parallel over masses and over edges
+            std::mutex mutex;
+            pool.parallel_for(0, n, grain, [&](std::size_t begin, std::size_t end) {
+                std::vector<Contact> found;
+                find_point_triangle(begin, end, found);
+                std::lock_guard<std::mutex> lock(mutex);
+                contacts.insert(contacts.end(), found.begin(), found.end());
+            });
+            pool.parallel_for(0, edges.size(), grain, [&](std::size_t begin, std::size_t end) {
+                std::vector<Contact> found;
+                find_edge_edge(begin, end, found);
+                std::lock_guard<std::mutex> lock(mutex);
+                contacts.insert(contacts.end(), found.begin(), found.end());
+            });
+
+            //Chunks finish in any order and shared buckets can report a pair twice: sort, so the resolution order
+            //(and the result) does not depend on the threads, and drop the repeats
+            auto key = [](const Contact &c) { return std::make_tuple(c.edge_edge, c.first, c.second); };
+            std::sort(contacts.begin(), contacts.end(), [&](const Contact &a, const Contact &b) { return key(a) < key(b); });
+            contacts.erase(std::unique(contacts.begin(), contacts.end(),
+                                       [&](const Contact &a, const Contact &b) { return key(a) == key(b); }),
+                           contacts.end());
+
+            //Resolution one contact after the other (Gauss-Seidel), contacts are few next to the masses
+            for (const Contact &contact: contacts) resolve(particles, contact);
+        }
+
+        void SelfCollision::find_point_triangle(std::size_t begin, std::size_t end, std::vector<Contact> &found) const {
+            const float thickness2 = thickness * thickness;
+            for (std::size_t i = begin; i < end; ++i) {
+                const glm::vec3 &p = positions[i];
+                face_hash.for_each_in_cell(face_hash.cell_of(p), [&](std::uint32_t f) {
+                    const primatives::Face &face = faces[f];
+                    if (face.mass_a == i || face.mass_b == i || face.mass_c == i || !contains(face_boxes[f], p)) return;
+                    const glm::vec3 &a = positions[face.mass_a], &b = positions[face.mass_b], &c = positions[face.mass_c];
+                    glm::vec3 w = closest_on_triangle(p, a, b, c);
+                    glm::vec3 d = p - (w.x * a + w.y * b + w.z * c);
+                    float distance2 = glm::dot(d, d);
+                    if (distance2 >= thickness2) return;
+                    // On the face itself the side is unknown, push along the face normal
+                    glm::vec3 normal = distance2 > 1.e-12f ? d / std::sqrt(distance2) : glm::cross(b - a, c - a);
+                    if (glm::dot(normal, normal) <= 1.e-12f) return;
+                    found.push_back({false, (std::uint32_t) i, f, {(std::uint32_t) i, face.mass_a, face.mass_b, face.mass_c},
+                                     {1.f, -w.x, -w.y, -w.z}, glm::normalize(normal)});
+                });
+            }
+        }
+
+        void SelfCollision::find_edge_edge(std::size_t begin, std::size_t end, std::vector<Contact> &found) const {
+            const float thickness2 = thickness * thickness;
+            for (std::size_t e = begin; e < end; ++e) {
+                const glm::uvec2 &edge = edges[e];
+                const Box &box = edge_boxes[e];
+                glm::ivec3 lo = edge_hash.cell_of(box.min), hi = edge_hash.cell_of(box.max);
+                glm::ivec3 extent = hi - lo + 1;
+                if ((std::uint64_t) extent.x * extent.y * extent.z > SpatialHash::max_cells_per_object) continue;
+
+                auto test = [&](const glm::ivec3 &cell, std::uint32_t o) {
+                    const glm::uvec2 &other = edges[o];
+                    if (o <= e || other.x == edge.x || other.x == edge.y || other.y == edge.x || other.y == edge.y) return;
+                    if (!overlaps(box, edge_boxes[o])) return;
+                    // Both boxes cover several cells, only the first cell they share reports the pair
+                    if (glm::max(lo, edge_hash.cell_of(edge_boxes[o].min)) != cell) return;
+
+                    const glm::vec3 &p0 = positions[edge.x], &p1 = positions[edge.y];
+                    const glm::vec3 &q0 = positions[other.x], &q1 = positions[other.y];
+                    glm::vec2 st = closest_on_segments(p0, p1, q0, q1);
+                    glm::vec3 d = glm::mix(p0, p1, st.x) - glm::mix(q0, q1, st.y);
+                    float distance2 = glm::dot(d, d);
+                    if (distance2 >= thickness2) return;
+                    // Crossing edges have no separating direction, use the one perpendicular to both
+                    glm::vec3 normal = distance2 > 1.e-12f ? d / std::sqrt(distance2) : glm::cross(p1 - p0, q1 - q0);
+                    if (glm::dot(normal, normal) <= 1.e-12f) return;
+                    found.push_back({true, (std::uint32_t) e, o, {edge.x, edge.y, other.x, other.y},
+                                     {1.f - st.x, st.x, st.y - 1.f, -st.y}, glm::normalize(normal)});
+                };
+                for (int x = lo.x; x <= hi.x; ++x) {
+                    for (int y = lo.y; y <= hi.y; ++y) {
+                        for (int z = lo.z; z <= hi.z; ++z) {
+                            glm::ivec3 cell(x, y, z);
+                            edge_hash.for_each_in_cell(cell, [&](std::uint32_t o) { test(cell, o); });
+                        }
+                    }
+                }
+            }
+        }
+
+        void SelfCollision::resolve(primatives::ParticleSystem &particles, const Contact &contact) const {
+            using Vec3 = primatives::ParticleSystem::Vec3;
+            float inv_mass[4], sum = 0.f, gap = -thickness, approach = 0.f;
+            for (int k = 0; k < 4; ++k) {
+                const std::uint32_t i = contact.mass[k];
+                inv_mass[k] = particles.fixed(i) ? 0.f : (float) particles.inv_mass[i];
+                sum += inv_mass[k] * contact.weight[k] * contact.weight[k];
+                gap += contact.weight[k] * glm::dot(contact.normal, glm::vec3(particles.position(i)));
+                approach += contact.weight[k] * glm::dot(contact.normal, glm::vec3(particles.velocity(i)));
+            }
+            if (sum <= 0.f) return;
+
+            //Project the pair apart and take out the approaching normal velocity (inelastic)
+            float push = gap < 0.f ? -gap / sum : 0.f;
+            float stop = approach < 0.f ? -approach / sum : 0.f;
+            for (int k = 0; k < 4; ++k) {
+                const std::uint32_t i = contact.mass[k];
+                float w = inv_mass[k] * contact.weight[k];
+                particles.set_position(i, particles.position(i) + Vec3(w * push * contact.normal));
+                particles.set_velocity(i, particles.velocity(i) + Vec3(w * stop * contact.normal));
+            }
+        }
+    } // namespace collision
+} // namespace simulation
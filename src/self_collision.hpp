@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "particle_system.hpp"
+#include "spatial_hash.hpp"
+#include "spring_table.hpp"
+
+namespace simulation {
+    namespace collision {
+        // Edges of faces, each once with its smaller mass first; face_edges, if given, gets the indices of the
+        // three edges of every face (ab, bc, ca)
+        std::vector<glm::uvec2> mesh_edges(const std::vector<primatives::Face> &faces,
+                                           std::vector<glm::uvec3> *face_edges = nullptr);
+
+        //Proximity-based self-collision of a triangle mesh (the cloth) against itself.
+        //Each step the faces and edges are hashed into SpatialHash grids whose cells are about an edge long, then
+        //every mass is tested against the faces in its cell (point-triangle) and every edge against the edges in
+        //its cells (edge-edge), both in parallel. Pairs closer than `thickness` become contacts, which are
+        //resolved after the integrator's step by projecting them apart and removing their approaching velocity.
+        //Contacts only see penetrations shallower than `thickness`; a mass crossing a whole face in one step
+        //passes through.
+        class SelfCollision {
+        public:
+            // Topology: the edges of faces, and which masses belong to which face
+            void build(const std::vector<primatives::Face> &faces, float cell_size);
+            // Finds the contacts at the current positions and resolves them
+            void solve(primatives::ParticleSystem &particles);
+
+            std::size_t contact_count() const { return contacts.size(); }
+
+            float thickness = 0.1f;
+
+        private:
+            //Contact between a mass and a face (masses p, a, b, c) or two edges (p0, p1 and q0, q1).
+            //Its gap is dot(normal, sum of weight * position) - thickness, with weights summing to zero
+            struct Contact {
+                bool edge_edge = false;
+                std::uint32_t first = 0, second = 0; // mass and face, or both edges
+                std::uint32_t mass[4] = {0, 0, 0, 0};
+                float weight[4] = {0.f, 0.f, 0.f, 0.f};
+                glm::vec3 normal{0.f};
+            };
+
+            void find_point_triangle(std::size_t begin, std::size_t end, std::vector<Contact> &found) const;
+            void find_edge_edge(std::size_t begin, std::size_t end, std::vector<Contact> &found) const;
+            void resolve(primatives::ParticleSystem &particles, const Contact &contact) const;
+
+            std::vector<primatives::Face> faces;
+            std::vector<glm::uvec2> edges;
+            float cell_size = 1.f;
+
+            std::vector<glm::vec3> positions; // per mass, scratch of solve()
+            std::vector<Box> face_boxes, edge_boxes;
+            SpatialHash face_hash, edge_hash;
+            std::vector<Contact> contacts;
+        };
+    } // namespace collision
+} // namespace simulation
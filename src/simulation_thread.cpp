@@ -0,0 +1,41 @@
+#include <chrono>
+
+#include "simulation_thread.hpp"
+
+namespace simulation {
+    namespace threading {
+        SimulationThread::SimulationThread(Body body) : body(std::move(body)) {
+            thread = std::thread([this] { run(); });
+        }
+
+        SimulationThread::~SimulationThread() {
+            {
+                std::unique_lock<std::mutex> guard = lock();
+                stopping = true;
+            }
+            wake_up.notify_one();
+            thread.join();
+        }
+
+        std::unique_lock<std::mutex> SimulationThread::lock() {
+            waiting.fetch_add(1);
+            std::unique_lock<std::mutex> guard(mutex);
+            waiting.fetch_sub(1);
+            return guard;
+        }
+
+        void SimulationThread::run() {
+            while (true) {
+                // std::mutex is not fair: without this the loop could re-take the lock before a waiting UI thread
+                while (waiting.load() > 0) {
+                    std::this_thread::yield();
+                }
+                std::unique_lock<std::mutex> guard(mutex);
+                if (stopping) return;
+                if (!body()) {
+                    wake_up.wait_for(guard, std::chrono::milliseconds(1), [this] { return stopping || woken.exchange(false); });
+                }
+            }
+        }
+    } // namespace threading
+} // namespace simulation
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace simulation {
+    namespace threading {
+        //Runs the simulation on its own thread, one unit of work (e.g. one step) at a time.
+        //Every unit runs with the simulation lock held; another thread (the UI) takes the lock to read or change
+        //anything the units depend on, and gets it as soon as the unit in flight finishes.
+        class SimulationThread {
+        public:
+            // Returns false when there was nothing to do; the thread then idles until wake() or a short timeout
+            using Body = std::function<bool()>;
+
+            explicit SimulationThread(Body body);
+            ~SimulationThread();
+
+            SimulationThread(const SimulationThread &) = delete;
+            SimulationThread &operator=(const SimulationThread &) = delete;
+
+            // Blocks until the unit in flight is done and keeps the next one from starting while held
+            std::unique_lock<std::mutex> lock();
+            // Ends an idle wait early, call after changing what the body depends on
+            void wake() {
+                woken.store(true);
+                wake_up.notify_one();
+            }
+
+        private:
+            void run();
+
+            Body body;
+            std::mutex mutex;
+            std::condition_variable wake_up;
+            std::atomic<int> waiting{0}; // threads queued in lock(), the simulation thread steps aside for them
+            std::atomic<bool> woken{false};
+            bool stopping = false;
+            std::thread thread;
+        };
+    } // namespace threading
+} // namespace simulation
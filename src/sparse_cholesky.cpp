@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "sparse_cholesky.hpp"
+
+#if defined(__SSE__) || defined(_M_X64)
+#define SIMULATION_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace simulation {
+    namespace integrators {
+        namespace {
+            const std::uint32_t none = ~0u;
+
+            //Recursive level-set bisection state for nested_dissection()
+            struct Dissection {
+                const std::vector<std::uint32_t> &offsets;
+                const std::vector<std::uint32_t> &neighbours;
+                std::vector<std::uint32_t> order;
+                std::vector<std::uint32_t> part;    // id of the piece a node currently belongs to
+                std::vector<std::uint32_t> seen;    // stamp of the last search that reached a node
+                std::vector<std::uint32_t> level;
+                std::uint32_t next_part = 1, next_stamp = 1;
+
+                Dissection(const std::vector<std::uint32_t> &offsets, const std::vector<std::uint32_t> &neighbours)
+                        : offsets(offsets), neighbours(neighbours), part(offsets.size() - 1, 0),
+                          seen(offsets.size() - 1, 0), level(offsets.size() - 1, 0) {}
+
+                // Breadth-first search from root inside piece id; visited nodes in search order
+                void search(std::uint32_t root, std::uint32_t id, std::vector<std::uint32_t> &visited) {
+                    const std::uint32_t stamp = next_stamp++;
+                    visited.clear();
+                    visited.push_back(root);
+                    seen[root] = stamp;
+                    level[root] = 0;
+                    for (std::size_t head = 0; head < visited.size(); ++head) {
+                        std::uint32_t node = visited[head];
+                        for (std::uint32_t k = offsets[node]; k < offsets[node + 1]; ++k) {
+                            std::uint32_t next = neighbours[k];
+                            if (part[next] == id && seen[next] != stamp) {
+                                seen[next] = stamp;
+                                level[next] = level[node] + 1;
+                                visited.push_back(next);
+                            }
+                        }
+                    }
+                }
+
+                void dissect(const std::vector<std::uint32_t> &nodes) {
+                    if (nodes.size() <= 32) {
+                        order.insert(order.end(), nodes.begin(), nodes.end());
+                        return;
+                    }
+                    const std::uint32_t id = next_part++;
+                    for (std::uint32_t node: nodes) {
+                        part[node] = id;
+                    }
+
+                    std::vector<std::uint32_t> visited;
+                    search(nodes.front(), id, visited);
+                    if (visited.size() < nodes.size()) {
+                        // Several connected components: order each on its own
+                        std::vector<std::vector<std::uint32_t>> components;
+                        const std::uint32_t component_id = next_part++;
+                        for (std::uint32_t node: nodes) {
+                            if (part[node] != id) continue;
+                            search(node, id, visited);
+                            for (std::uint32_t member: visited) {
+                                part[member] = component_id;
+                            }
+                            components.push_back(visited);
+                        }
+                        for (const std::vector<std::uint32_t> &component: components) {
+                            dissect(component);
+                        }
+                        return;
+                    }
+
+                    // Pseudo-peripheral root: move to the deepest node while that increases the depth
+                    std::uint32_t depth = level[visited.back()];
+                    std::vector<std::uint32_t> candidate;
+                    for (int pass = 0; pass < 4; ++pass) {
+                        search(visited.back(), id, candidate);
+                        if (level[candidate.back()] <= depth) break;
+                        depth = level[candidate.back()];
+                        visited.swap(candidate);
+                    }
+                    if (depth < 2) {
+                        order.insert(order.end(), nodes.begin(), nodes.end());
+                        return;
+                    }
+
+                    // Separator: the smallest level whose preceding levels hold 30-70% of the nodes
+                    std::vector<std::size_t> level_size(depth + 1, 0);
+                    for (std::uint32_t node: visited) {
+                        level_size[level[node]]++;
+                    }
+                    std::uint32_t separator = 0;
+                    std::size_t before = 0, best_size = nodes.size() + 1;
+                    for (std::uint32_t l = 1; l < depth; ++l) {
+                        before += level_size[l - 1];
+                        bool balanced = before * 10 >= nodes.size() * 3 && before * 10 <= nodes.size() * 7;
+                        if (balanced && level_size[l] < best_size) {
+                            best_size = level_size[l];
+                            separator = l;
+                        }
+                    }
+                    if (separator == 0) separator = depth / 2;
+
+                    std::vector<std::uint32_t> low, high, middle;
+                    for (std::uint32_t node: visited) {
+                        if (level[node] < separator) low.push_back(node);
+                        else if (level[node] > separator) high.push_back(node);
+                        else middle.push_back(node);
+                    }
+                    visited.clear();
+                    visited.shrink_to_fit();
+                    dissect(low);
+                    dissect(high);
+                    order.insert(order.end(), middle.begin(), middle.end());
+                }
+            };
+        }
+
+        std::vector<std::uint32_t> nested_dissection(const std::vector<std::uint32_t> &offsets,
+                                                     const std::vector<std::uint32_t> &neighbours) {
+            Dissection dissection(offsets, neighbours);
+            std::vector<std::uint32_t> nodes(offsets.size() - 1);
+            for (std::size_t i = 0; i < nodes.size(); ++i) {
+                nodes[i] = (std::uint32_t) i;
+            }
+            dissection.order.reserve(nodes.size());
+            dissection.dissect(nodes);
+            return dissection.order;
+        }
+
+        void SparseCholesky::analyse(const std::vector<std::uint32_t> &offsets, const std::vector<std::uint32_t> &neighbours) {
+            const std::size_t n = offsets.size() - 1;
+
+            // Upper triangle of A by columns
+            a_start.assign(n + 1, 0);
+            a_rows.clear();
+            for (std::size_t k = 0; k < n; ++k) {
+                std::size_t column_begin = a_rows.size();
+                for (std::uint32_t p = offsets[k]; p < offsets[k + 1]; ++p) {
+                    if (neighbours[p] < k) a_rows.push_back(neighbours[p]);
+                }
+                std::sort(a_rows.begin() + column_begin, a_rows.end());
+                a_rows.erase(std::unique(a_rows.begin() + column_begin, a_rows.end()), a_rows.end());
+                a_rows.push_back((std::uint32_t) k);
+                a_start[k + 1] = (std::uint32_t) a_rows.size();
+            }
+            a_values.assign(a_rows.size(), 0.f);
+
+            // Elimination tree (with path compression through ancestor)
+            parent.assign(n, none);
+            std::vector<std::uint32_t> ancestor(n, none);
+            for (std::size_t k = 0; k < n; ++k) {
+                for (std::uint32_t p = a_start[k]; p + 1 < a_start[k + 1]; ++p) {
+                    for (std::uint32_t i = a_rows[p]; i != none && i < k;) {
+                        std::uint32_t next = ancestor[i];
+                        ancestor[i] = (std::uint32_t) k;
+                        if (next == none) parent[i] = (std::uint32_t) k;
+                        i = next;
+                    }
+                }
+            }
+
+            // Column counts of L: row k of L is the reach of column k of A in the elimination tree
+            marks.assign(n, 0);
+            stack.assign(n, 0);
+            fill.assign(n, 0);
+            work.assign(n, 0.0);
+            std::vector<std::size_t> counts(n, 1);
+            for (std::size_t k = 0; k < n; ++k) {
+                for (std::size_t t = reach(k, stack); t < n; ++t) {
+                    counts[stack[t]]++;
+                }
+            }
+            column_start.assign(n + 1, 0);
+            for (std::size_t j = 0; j < n; ++j) {
+                column_start[j + 1] = column_start[j] + counts[j];
+            }
+            factor_rows.assign(column_start[n], 0);
+            factor_values.assign(column_start[n], 0.f);
+        }
+
+        std::size_t SparseCholesky::reach(std::size_t k, std::vector<std::uint32_t> &out) {
+            // Marks are stamped with k + 1, so they only need clearing once per pass over the rows
+            const std::uint32_t stamp = (std::uint32_t) k + 1;
+            std::size_t top = size();
+            marks[k] = stamp;
+            for (std::uint32_t p = a_start[k]; p + 1 < a_start[k + 1]; ++p) {
+                std::size_t length = 0;
+                for (std::uint32_t i = a_rows[p]; marks[i] != stamp; i = parent[i]) {
+                    out[length++] = i;
+                    marks[i] = stamp;
+                }
+                while (length > 0) {
+                    out[--top] = out[--length];
+                }
+            }
+            return top;
+        }
+
+        void SparseCholesky::set_zero() {
+            std::memset(a_values.data(), 0, a_values.size() * sizeof(float));
+        }
+
+        float &SparseCholesky::at(std::size_t row, std::size_t column) {
+            std::uint32_t i = (std::uint32_t) std::min(row, column), k = (std::uint32_t) std::max(row, column);
+            auto first = a_rows.begin() + a_start[k], last = a_rows.begin() + a_start[k + 1];
+            return a_values[std::lower_bound(first, last, i) - a_rows.begin()];
+        }
+
+        bool SparseCholesky::factor() {
+            const std::size_t n = size();
+            std::fill(marks.begin(), marks.end(), 0u);
+            std::fill(fill.begin(), fill.end(), 0u);
+            for (std::size_t k = 0; k < n; ++k) {
+                std::size_t top = reach(k, stack);
+                for (std::uint32_t p = a_start[k]; p < a_start[k + 1]; ++p) {
+                    work[a_rows[p]] = a_values[p];
+                }
+                double diagonal = work[k];
+                work[k] = 0.0;
+
+                // Sparse triangular solve for row k of L, in topological order of the reach
+                for (std::size_t t = top; t < n; ++t) {
+                    std::uint32_t i = stack[t];
+                    double l_ki = work[i] / (double) factor_values[column_start[i]];
+                    work[i] = 0.0;
+                    for (std::size_t p = column_start[i] + 1; p < column_start[i] + fill[i]; ++p) {
+                        work[factor_rows[p]] -= (double) factor_values[p] * l_ki;
+                    }
+                    diagonal -= l_ki * l_ki;
+                    std::size_t p = column_start[i] + fill[i]++;
+                    factor_rows[p] = (std::uint32_t) k;
+                    factor_values[p] = (float) l_ki;
+                }
+                if (!(diagonal > 0.0)) return false;
+                std::size_t p = column_start[k] + fill[k]++;
+                factor_rows[p] = (std::uint32_t) k;
+                factor_values[p] = (float) std::sqrt(diagonal);
+            }
+            return true;
+        }
+
+        void SparseCholesky::solve(std::vector<glm::vec4> &b) const {
+            const std::size_t n = size();
+            float *x = &b[0].x;
+#ifdef SIMULATION_SSE
+            // L y = b, by columns
+            for (std::size_t j = 0; j < n; ++j) {
+                __m128 y = _mm_div_ps(_mm_loadu_ps(x + 4 * j), _mm_set1_ps(factor_values[column_start[j]]));
+                _mm_storeu_ps(x + 4 * j, y);
+                for (std::size_t p = column_start[j] + 1; p < column_start[j + 1]; ++p) {
+                    float *row = x + 4 * factor_rows[p];
+                    _mm_storeu_ps(row, _mm_sub_ps(_mm_loadu_ps(row), _mm_mul_ps(_mm_set1_ps(factor_values[p]), y)));
+                }
+            }
+            // L^T x = y, by rows of L^T
+            for (std::size_t j = n; j-- > 0;) {
+                __m128 sum = _mm_loadu_ps(x + 4 * j);
+                for (std::size_t p = column_start[j] + 1; p < column_start[j + 1]; ++p) {
+                    sum = _mm_sub_ps(sum, _mm_mul_ps(_mm_set1_ps(factor_values[p]), _mm_loadu_ps(x + 4 * factor_rows[p])));
+                }
+                _mm_storeu_ps(x + 4 * j, _mm_div_ps(sum, _mm_set1_ps(factor_values[column_start[j]])));
+            }
+#else
+            (void) x;
+            for (std::size_t j = 0; j < n; ++j) {
+                b[j] /= factor_values[column_start[j]];
+                for (std::size_t p = column_start[j] + 1; p < column_start[j + 1]; ++p) {
+                    b[factor_rows[p]] -= factor_values[p] * b[j];
+                }
+            }
+            for (std::size_t j = n; j-- > 0;) {
+                glm::vec4 sum = b[j];
+                for (std::size_t p = column_start[j] + 1; p < column_start[j + 1]; ++p) {
+                    sum -= factor_values[p] * b[factor_rows[p]];
+                }
+                b[j] = sum / factor_values[column_start[j]];
+            }
+#endif
+        }
+    } // namespace integrators
+} // namespace simulation
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace simulation {
+    namespace integrators {
+        //Fill-reducing nested dissection ordering of an undirected graph given as CSR neighbour lists.
+        //Each connected piece is split by a breadth-first level set (the smallest one near the middle),
+        //the two sides are ordered recursively and the separator goes last. Returns order[new index] = old index.
+        std::vector<std::uint32_t> nested_dissection(const std::vector<std::uint32_t> &offsets,
+                                                     const std::vector<std::uint32_t> &neighbours);
+
+        //Sparse Cholesky factorisation A = L L^T of a symmetric positive definite matrix.
+        //analyse() computes the elimination tree and the exact pattern of L once; factor() then refills
+        //L in place (up-looking, row by row), so refactoring with new values allocates nothing.
+        //L is stored by columns in floats; the factorisation accumulates in double.
+        class SparseCholesky {
+        public:
+            // Pattern of A given as CSR neighbour lists of a symmetric graph (diagonal implied)
+            void analyse(const std::vector<std::uint32_t> &offsets, const std::vector<std::uint32_t> &neighbours);
+
+            std::size_t size() const { return parent.size(); }
+            std::size_t factor_entries() const { return factor_rows.size(); }
+
+            void set_zero();
+            // Entry (row, column) of A, either triangle; must be part of the analysed pattern
+            float &at(std::size_t row, std::size_t column);
+
+            // Factors the current values of A; returns false if A is not positive definite
+            bool factor();
+            // Solves A x = b in place for three right-hand sides at once (x, y and z; w is ignored)
+            void solve(std::vector<glm::vec4> &b) const;
+
+        private:
+            std::size_t reach(std::size_t k, std::vector<std::uint32_t> &out);
+
+            //A, upper triangle by columns: rows i <= k of column k, sorted, diagonal last
+            std::vector<std::uint32_t> a_start, a_rows;
+            std::vector<float> a_values;
+
+            //Elimination tree and L by columns, diagonal first
+            std::vector<std::uint32_t> parent;
+            std::vector<std::size_t> column_start;
+            std::vector<std::uint32_t> factor_rows;
+            std::vector<float> factor_values;
+
+            //Workspace of factor()
+            std::vector<std::uint32_t> marks, stack, fill;
+            std::vector<double> work;
+        };
+    } // namespace integrators
+} // namespace simulation
@@ -0,0 +1,105 @@
+#include <algorithm>
+
+#include "spatial_hash.hpp"
+#include "thread_pool.hpp"
+
+namespace simulation {
+    namespace collision {
+        namespace {
+            const std::size_t grain = 1024;
+
+            // values[0] must be 0; turns values[1..n] from counts into running sums, i.e. values[i] is the start of i
+            void prefix_sum(std::vector<std::uint32_t> &values) {
+                const std::size_t n = values.size();
+                threading::ThreadPool &pool = threading::pool();
+                if (n <= 4 * grain || pool.size() == 1) {
+                    for (std::size_t i = 1; i < n; ++i) values[i] += values[i - 1];
+                    return;
+                }
+                // Chunk totals, their (short) scan, then every chunk scanned from its offset
+                const std::size_t chunk = std::max(grain, (n + pool.size() - 1) / pool.size());
+                const std::size_t chunks = (n + chunk - 1) / chunk;
+                std::vector<std::uint32_t> offset(chunks + 1, 0);
+                pool.parallel_for(0, n, chunk, [&](std::size_t begin, std::size_t end) {
+                    std::uint32_t sum = 0;
+                    for (std::size_t i = begin; i < end; ++i) sum += values[i];
+                    offset[begin / chunk + 1] = sum;
+                });
+                for (std::size_t c = 0; c < chunks; ++c) offset[c + 1] += offset[c];
+                pool.parallel_for(0, n, chunk, [&](std::size_t begin, std::size_t end) {
+                    std::uint32_t sum = offset[begin / chunk];
+                    for (std::size_t i = begin; i < end; ++i) values[i] = sum += values[i];
+                });
+            }
+        }
+
+        void SpatialHash::build(const std::vector<Box> &boxes, float cell_size) {
+            threading::ThreadPool &pool = threading::pool();
+            inv_cell_size = 1.f / cell_size;
+            const std::size_t n = boxes.size();
+            auto cell_range = [this, &boxes](std::size_t i, glm::ivec3 &lo, glm::ivec3 &hi) {
+                lo = cell_of(boxes[i].min);
+                hi = cell_of(boxes[i].max);
+                glm::ivec3 extent = hi - lo + 1;
+                std::uint64_t cells = (std::uint64_t) extent.x * (std::uint64_t) extent.y * (std::uint64_t) extent.z;
+                return cells <= max_cells_per_object ? (std::uint32_t) cells : 0u;
+            };
+
+            //Count the cells of every object and place its pairs
+            object_start.resize(n + 1);
+            object_start[0] = 0;
+            pool.parallel_for(0, n, grain, [&](std::size_t begin, std::size_t end) {
+                glm::ivec3 lo, hi;
+                for (std::size_t i = begin; i < end; ++i) object_start[i + 1] = cell_range(i, lo, hi);
+            });
+            prefix_sum(object_start);
+            const std::uint32_t pairs = object_start[n];
+
+            //Table of at least as many buckets as pairs keeps the shared buckets rare
+            std::uint32_t buckets = 1;
+            while (buckets < pairs) buckets <<= 1;
+            mask = buckets - 1;
+            if (bucket_fill.size() < buckets) bucket_fill = std::vector<std::atomic<std::uint32_t>>(buckets);
+            pool.parallel_for(0, buckets, grain, [this](std::size_t begin, std::size_t end) {
+                for (std::size_t b = begin; b < end; ++b) bucket_fill[b].store(0, std::memory_order_relaxed);
+            });
+
+            //Counting sort: bucket sizes (the count a pair bumps is its place in the bucket), bucket offsets, then
+            //every pair into its place
+            pair_bucket.resize(pairs);
+            pair_rank.resize(pairs);
+            pool.parallel_for(0, n, grain, [&](std::size_t begin, std::size_t end) {
+                glm::ivec3 lo, hi;
+                for (std::size_t i = begin; i < end; ++i) {
+                    if (cell_range(i, lo, hi) == 0) continue;
+                    std::uint32_t k = object_start[i];
+                    for (int x = lo.x; x <= hi.x; ++x) {
+                        for (int y = lo.y; y <= hi.y; ++y) {
+                            for (int z = lo.z; z <= hi.z; ++z) {
+                                std::uint32_t b = bucket({x, y, z});
+                                pair_bucket[k] = b;
+                                pair_rank[k++] = bucket_fill[b].fetch_add(1, std::memory_order_relaxed);
+                            }
+                        }
+                    }
+                }
+            });
+
+            bucket_start.resize(buckets + 1);
+            bucket_start[0] = 0;
+            pool.parallel_for(0, buckets, grain, [this](std::size_t begin, std::size_t end) {
+                for (std::size_t b = begin; b < end; ++b) bucket_start[b + 1] = bucket_fill[b].load(std::memory_order_relaxed);
+            });
+            prefix_sum(bucket_start);
+
+            entries.resize(pairs);
+            pool.parallel_for(0, n, grain, [this](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    for (std::uint32_t k = object_start[i]; k < object_start[i + 1]; ++k) {
+                        entries[bucket_start[pair_bucket[k]] + pair_rank[k]] = (std::uint32_t) i;
+                    }
+                }
+            });
+        }
+    } // namespace collision
+} // namespace simulation
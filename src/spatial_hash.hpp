@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "proximity.hpp"
+
+namespace simulation {
+    namespace collision {
+        //Uniform grid over unbounded space, hashed into a table sized to the number of entries.
+        //Every object is entered into each cell its box overlaps. build() is a parallel counting sort into flat
+        //arrays (bucket offsets and object ids), so a rebuild per step allocates nothing once the arrays have grown.
+        //Different cells can share a bucket: a query sees a superset of the objects in its cell and tests exactly.
+        class SpatialHash {
+        public:
+            void build(const std::vector<Box> &boxes, float cell_size);
+
+            glm::ivec3 cell_of(const glm::vec3 &p) const { return glm::ivec3(glm::floor(p * inv_cell_size)); }
+            float cell_size() const { return 1.f / inv_cell_size; }
+            std::size_t entry_count() const { return entries.size(); }
+
+            // Calls fn(object) for every object entered into the bucket of cell
+            template<typename Fn>
+            void for_each_in_cell(const glm::ivec3 &cell, Fn &&fn) const {
+                if (entries.empty()) return;
+                const std::uint32_t b = bucket(cell);
+                for (std::uint32_t k = bucket_start[b]; k < bucket_start[b + 1]; ++k) fn(entries[k]);
+            }
+
+            // Boxes spanning more cells than this (an exploded simulation) are left out of the table
+            static constexpr std::uint32_t max_cells_per_object = 4096;
+
+        private:
+            std::uint32_t bucket(const glm::ivec3 &cell) const {
+                return ((std::uint32_t) cell.x * 73856093u ^ (std::uint32_t) cell.y * 19349663u ^
+                        (std::uint32_t) cell.z * 83492791u) & mask;
+            }
+
+            float inv_cell_size = 1.f;
+            std::uint32_t mask = 0;                  // bucket count - 1, a power of two
+            std::vector<std::uint32_t> object_start; // per object + 1, offsets of its (object, cell) pairs
+            std::vector<std::uint32_t> pair_bucket;  // per (object, cell) pair
+            std::vector<std::uint32_t> pair_rank;    // per (object, cell) pair, its place within the bucket
+            std::vector<std::atomic<std::uint32_t>> bucket_fill; // per bucket
+            std::vector<std::uint32_t> bucket_start; // per bucket + 1
+            std::vector<std::uint32_t> entries;      // object ids grouped by bucket
+        };
+    } // namespace collision
+} // namespace simulation
@@ -0,0 +1,23 @@
+#include "spring_adjacency.hpp"
+
+namespace simulation {
+    namespace primatives {
+        void SpringAdjacency::build(const SpringTable &springs, std::size_t mass_count) {
+            offsets.assign(mass_count + 1, 0);
+            for (const Spring &spring: springs) {
+                offsets[spring.mass_a + 1]++;
+                offsets[spring.mass_b + 1]++;
+            }
+            for (std::size_t m = 0; m < mass_count; ++m) {
+                offsets[m + 1] += offsets[m];
+            }
+
+            entries.resize(offsets[mass_count]);
+            std::vector<std::uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+            for (std::size_t i = 0; i < springs.size(); ++i) {
+                entries[cursor[springs[i].mass_a]++] = (std::uint32_t) (i << 1);
+                entries[cursor[springs[i].mass_b]++] = (std::uint32_t) (i << 1 | 1u);
+            }
+        }
+    } // namespace primatives
+} // namespace simulation
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "spring_table.hpp"
+
+namespace simulation {
+    namespace primatives {
+        //Per-mass incidence lists of a spring table in compressed sparse row form.
+        //Entry (spring << 1 | 1) means the mass is the spring's mass_b, i.e. it receives -F.
+        //Within a row springs appear in table order, so a gather over a row always sums in the same order.
+        class SpringAdjacency {
+        public:
+            void build(const SpringTable &springs, std::size_t mass_count);
+
+            std::size_t mass_count() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+            std::uint32_t row_begin(std::size_t mass) const { return offsets[mass]; }
+            std::uint32_t row_end(std::size_t mass) const { return offsets[mass + 1]; }
+
+            static std::uint32_t spring_of(std::uint32_t entry) { return entry >> 1; }
+            static bool is_mass_b(std::uint32_t entry) { return (entry & 1u) != 0; }
+
+            std::vector<std::uint32_t> offsets;
+            std::vector<std::uint32_t> entries;
+        };
+    } // namespace primatives
+} // namespace simulation
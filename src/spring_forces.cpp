@@ -0,0 +1,347 @@
+#include <cmath>
+#include <cstddef>
+
+#include "spring_forces.hpp"
+#include "thread_pool.hpp"
+
+// The SIMD kernels gather float state, so double builds fall back to the scalar kernel
+#if (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)) && \
+    !defined(SIMULATION_PRECISION_DOUBLE)
+#define SIMULATION_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+// Per-function ISA selection, so one binary carries every kernel and picks one at runtime
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMULATION_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMULATION_TARGET(isa)
+#endif
+
+namespace simulation {
+    namespace forces {
+        namespace {
+            // The SIMD kernels gather spring fields straight out of the table
+            static_assert(sizeof(primatives::Spring) == 5 * sizeof(float), "Spring must stay a packed 20 byte record");
+            static_assert(offsetof(primatives::Spring, mass_b) == 4 && offsetof(primatives::Spring, rest_l) == 8 &&
+                          offsetof(primatives::Spring, k_s) == 12 && offsetof(primatives::Spring, k_d) == 16,
+                          "Unexpected Spring layout");
+
+            using primatives::Scalar;
+            using primatives::Accumulator;
+
+            struct Streams {
+                const Scalar *px, *py, *pz;
+                const Scalar *vx, *vy, *vz;
+                Accumulator *fx, *fy, *fz;
+
+                explicit Streams(primatives::ParticleSystem &particles)
+                        : px(particles.px.data()), py(particles.py.data()), pz(particles.pz.data()),
+                          vx(particles.vx.data()), vy(particles.vy.data()), vz(particles.vz.data()),
+                          fx(particles.fx.data()), fy(particles.fy.data()), fz(particles.fz.data()) {}
+
+                void scatter(std::uint32_t a, std::uint32_t b, Scalar f_x, Scalar f_y, Scalar f_z) const {
+                    fx[a] += f_x;
+                    fy[a] += f_y;
+                    fz[a] += f_z;
+                    fx[b] -= f_x;
+                    fy[b] -= f_y;
+                    fz[b] -= f_z;
+                }
+            };
+
+            // Force of one spring on its mass_a
+            inline void spring_force(const primatives::Spring &spring, const Streams &s,
+                                     Scalar &f_x, Scalar &f_y, Scalar &f_z) {
+                const std::uint32_t a = spring.mass_a, b = spring.mass_b;
+                Scalar dx = s.px[b] - s.px[a], dy = s.py[b] - s.py[a], dz = s.pz[b] - s.pz[a];
+                Scalar l2 = dx * dx + dy * dy + dz * dz;
+                // k_s * (|d| - rest_l) * d / |d| == k_s * (1 - rest_l / |d|) * d
+                Scalar inv_l = l2 > 0 ? 1 / std::sqrt(l2) : 0;
+                Scalar stretch = l2 > 0 ? spring.k_s * (1 - spring.rest_l * inv_l) : 0;
+                f_x = stretch * dx - spring.k_d * (s.vx[a] - s.vx[b]);
+                f_y = stretch * dy - spring.k_d * (s.vy[a] - s.vy[b]);
+                f_z = stretch * dz - spring.k_d * (s.vz[a] - s.vz[b]);
+            }
+
+            void kernel_scalar(const primatives::Spring *spring, std::size_t begin, std::size_t end, const Streams &s) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    Scalar f_x, f_y, f_z;
+                    spring_force(spring[i], s, f_x, f_y, f_z);
+                    s.scatter(spring[i].mass_a, spring[i].mass_b, f_x, f_y, f_z);
+                }
+            }
+
+#ifdef SIMULATION_X86
+            SIMULATION_TARGET("sse2")
+            void kernel_sse2(const primatives::Spring *spring, std::size_t begin, std::size_t end, const Streams &s) {
+                const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+                const __m128 half = _mm_set1_ps(0.5f), three_halves = _mm_set1_ps(1.5f);
+                alignas(16) float out_x[4], out_y[4], out_z[4];
+
+                std::size_t i = begin;
+                for (; i + 4 <= end; i += 4) {
+                    const primatives::Spring *sp = spring + i;
+                    const std::uint32_t a0 = sp[0].mass_a, a1 = sp[1].mass_a, a2 = sp[2].mass_a, a3 = sp[3].mass_a;
+                    const std::uint32_t b0 = sp[0].mass_b, b1 = sp[1].mass_b, b2 = sp[2].mass_b, b3 = sp[3].mass_b;
+#define SIMULATION_GATHER4(stream, i0, i1, i2, i3) _mm_setr_ps(stream[i0], stream[i1], stream[i2], stream[i3])
+                    __m128 dx = _mm_sub_ps(SIMULATION_GATHER4(s.px, b0, b1, b2, b3), SIMULATION_GATHER4(s.px, a0, a1, a2, a3));
+                    __m128 dy = _mm_sub_ps(SIMULATION_GATHER4(s.py, b0, b1, b2, b3), SIMULATION_GATHER4(s.py, a0, a1, a2, a3));
+                    __m128 dz = _mm_sub_ps(SIMULATION_GATHER4(s.pz, b0, b1, b2, b3), SIMULATION_GATHER4(s.pz, a0, a1, a2, a3));
+                    __m128 dvx = _mm_sub_ps(SIMULATION_GATHER4(s.vx, a0, a1, a2, a3), SIMULATION_GATHER4(s.vx, b0, b1, b2, b3));
+                    __m128 dvy = _mm_sub_ps(SIMULATION_GATHER4(s.vy, a0, a1, a2, a3), SIMULATION_GATHER4(s.vy, b0, b1, b2, b3));
+                    __m128 dvz = _mm_sub_ps(SIMULATION_GATHER4(s.vz, a0, a1, a2, a3), SIMULATION_GATHER4(s.vz, b0, b1, b2, b3));
+#undef SIMULATION_GATHER4
+                    __m128 rest = _mm_setr_ps(sp[0].rest_l, sp[1].rest_l, sp[2].rest_l, sp[3].rest_l);
+                    __m128 k_s = _mm_setr_ps(sp[0].k_s, sp[1].k_s, sp[2].k_s, sp[3].k_s);
+                    __m128 k_d = _mm_setr_ps(sp[0].k_d, sp[1].k_d, sp[2].k_d, sp[3].k_d);
+
+                    __m128 l2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    __m128 valid = _mm_cmpgt_ps(l2, zero);
+                    // rsqrt estimate (12 bits) + one Newton-Raphson step (~22 bits)
+                    __m128 y = _mm_rsqrt_ps(l2);
+                    y = _mm_mul_ps(y, _mm_sub_ps(three_halves, _mm_mul_ps(_mm_mul_ps(half, l2), _mm_mul_ps(y, y))));
+                    __m128 stretch = _mm_and_ps(valid, _mm_mul_ps(k_s, _mm_sub_ps(one, _mm_mul_ps(rest, y))));
+
+                    _mm_store_ps(out_x, _mm_sub_ps(_mm_mul_ps(stretch, dx), _mm_mul_ps(k_d, dvx)));
+                    _mm_store_ps(out_y, _mm_sub_ps(_mm_mul_ps(stretch, dy), _mm_mul_ps(k_d, dvy)));
+                    _mm_store_ps(out_z, _mm_sub_ps(_mm_mul_ps(stretch, dz), _mm_mul_ps(k_d, dvz)));
+                    for (int j = 0; j < 4; ++j) {
+                        s.scatter(sp[j].mass_a, sp[j].mass_b, out_x[j], out_y[j], out_z[j]);
+                    }
+                }
+                kernel_scalar(spring, i, end, s);
+            }
+
+            SIMULATION_TARGET("avx2")
+            void kernel_avx2(const primatives::Spring *spring, std::size_t begin, std::size_t end, const Streams &s) {
+                const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f);
+                const __m256 half = _mm256_set1_ps(0.5f), three_halves = _mm256_set1_ps(1.5f);
+                // Offsets (in 4 byte words) of the same field in 8 consecutive springs
+                const __m256i stride = _mm256_setr_epi32(0, 5, 10, 15, 20, 25, 30, 35);
+                alignas(32) float out_x[8], out_y[8], out_z[8];
+
+                std::size_t i = begin;
+                for (; i + 8 <= end; i += 8) {
+                    const primatives::Spring *sp = spring + i;
+                    const int *words = reinterpret_cast<const int *>(sp);
+                    const float *fields = reinterpret_cast<const float *>(sp);
+                    __m256i a = _mm256_i32gather_epi32(words + 0, stride, 4);
+                    __m256i b = _mm256_i32gather_epi32(words + 1, stride, 4);
+                    __m256 rest = _mm256_i32gather_ps(fields + 2, stride, 4);
+                    __m256 k_s = _mm256_i32gather_ps(fields + 3, stride, 4);
+                    __m256 k_d = _mm256_i32gather_ps(fields + 4, stride, 4);
+
+                    __m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(s.px, b, 4), _mm256_i32gather_ps(s.px, a, 4));
+                    __m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(s.py, b, 4), _mm256_i32gather_ps(s.py, a, 4));
+                    __m256 dz = _mm256_sub_ps(_mm256_i32gather_ps(s.pz, b, 4), _mm256_i32gather_ps(s.pz, a, 4));
+                    __m256 dvx = _mm256_sub_ps(_mm256_i32gather_ps(s.vx, a, 4), _mm256_i32gather_ps(s.vx, b, 4));
+                    __m256 dvy = _mm256_sub_ps(_mm256_i32gather_ps(s.vy, a, 4), _mm256_i32gather_ps(s.vy, b, 4));
+                    __m256 dvz = _mm256_sub_ps(_mm256_i32gather_ps(s.vz, a, 4), _mm256_i32gather_ps(s.vz, b, 4));
+
+                    __m256 l2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                              _mm256_mul_ps(dz, dz));
+                    __m256 valid = _mm256_cmp_ps(l2, zero, _CMP_GT_OQ);
+                    // rsqrt estimate (12 bits) + one Newton-Raphson step (~22 bits)
+                    __m256 y = _mm256_rsqrt_ps(l2);
+                    y = _mm256_mul_ps(y, _mm256_sub_ps(three_halves,
+                                                       _mm256_mul_ps(_mm256_mul_ps(half, l2), _mm256_mul_ps(y, y))));
+                    __m256 stretch = _mm256_and_ps(valid, _mm256_mul_ps(k_s, _mm256_sub_ps(one, _mm256_mul_ps(rest, y))));
+
+                    _mm256_store_ps(out_x, _mm256_sub_ps(_mm256_mul_ps(stretch, dx), _mm256_mul_ps(k_d, dvx)));
+                    _mm256_store_ps(out_y, _mm256_sub_ps(_mm256_mul_ps(stretch, dy), _mm256_mul_ps(k_d, dvy)));
+                    _mm256_store_ps(out_z, _mm256_sub_ps(_mm256_mul_ps(stretch, dz), _mm256_mul_ps(k_d, dvz)));
+                    for (int j = 0; j < 8; ++j) {
+                        s.scatter(sp[j].mass_a, sp[j].mass_b, out_x[j], out_y[j], out_z[j]);
+                    }
+                }
+                kernel_scalar(spring, i, end, s);
+            }
+#endif
+
+            SimdLevel detect_simd_level() {
+#if defined(SIMULATION_X86) && (defined(__GNUC__) || defined(__clang__))
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+                if (__builtin_cpu_supports("sse2")) return SimdLevel::SSE2;
+#elif defined(SIMULATION_X86) && defined(_MSC_VER)
+                int info[4];
+                __cpuid(info, 0);
+                int max_leaf = info[0];
+                __cpuid(info, 1);
+                bool sse2 = (info[3] & (1 << 26)) != 0;
+                bool avx_enabled = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+                if (avx_enabled && max_leaf >= 7) {
+                    __cpuidex(info, 7, 0);
+                    if (info[1] & (1 << 5)) return SimdLevel::AVX2;
+                }
+                if (sse2) return SimdLevel::SSE2;
+#endif
+                return SimdLevel::Scalar;
+            }
+        }
+
+        SimdLevel best_simd_level() {
+            static const SimdLevel level = detect_simd_level();
+            return level;
+        }
+
+        bool simd_level_supported(SimdLevel level) {
+            return (int) level <= (int) best_simd_level();
+        }
+
+        const char *simd_level_name(SimdLevel level) {
+            switch (level) {
+                case SimdLevel::SSE2:
+                    return "SSE2";
+                case SimdLevel::AVX2:
+                    return "AVX2";
+                default:
+                    return "scalar";
+            }
+        }
+
+        void accumulate_spring_forces(const primatives::SpringTable &springs, primatives::ParticleSystem &particles) {
+            accumulate_spring_forces(springs, particles, best_simd_level(), true);
+        }
+
+        void accumulate_spring_forces(const primatives::SpringTable &springs, primatives::ParticleSystem &particles,
+                                      SimdLevel level, bool parallel) {
+            using Kernel = void (*)(const primatives::Spring *, std::size_t, std::size_t, const Streams &);
+            Kernel kernel = kernel_scalar;
+            switch (simd_level_supported(level) ? level : SimdLevel::Scalar) {
+#ifdef SIMULATION_X86
+                case SimdLevel::AVX2:
+                    kernel = kernel_avx2;
+                    break;
+                case SimdLevel::SSE2:
+                    kernel = kernel_sse2;
+                    break;
+#endif
+                default:
+                    break;
+            }
+
+            const Streams streams(particles);
+            const primatives::Spring *data = springs.data();
+            if (!springs.coloured()) {
+                kernel(data, 0, springs.size(), streams);
+                return;
+            }
+
+            // Chunks are a multiple of 8 springs so SIMD groups line up with the serial evaluation
+            const std::size_t grain = 2048;
+            threading::ThreadPool &pool = threading::pool();
+            for (std::size_t c = 0; c < springs.colour_count(); ++c) {
+                if (parallel && pool.size() > 1) {
+                    pool.parallel_for(springs.colour_begin(c), springs.colour_end(c), grain,
+                                      [&](std::size_t begin, std::size_t end) { kernel(data, begin, end, streams); });
+                } else {
+                    kernel(data, springs.colour_begin(c), springs.colour_end(c), streams);
+                }
+            }
+        }
+
+        const char *accumulation_name(Accumulation accumulation) {
+            switch (accumulation) {
+                case Accumulation::GatherCached:
+                    return "Gather (cached)";
+                case Accumulation::GatherRecompute:
+                    return "Gather (recompute)";
+                default:
+                    return "Coloured scatter";
+            }
+        }
+
+        void SpringForces::build(const primatives::SpringTable &springs, std::size_t mass_count) {
+            adjacency.build(springs, mass_count);
+            cache_x.assign(springs.size(), 0.f);
+            cache_y.assign(springs.size(), 0.f);
+            cache_z.assign(springs.size(), 0.f);
+        }
+
+        void SpringForces::accumulate(const primatives::SpringTable &springs, primatives::ParticleSystem &particles,
+                                      Accumulation accumulation) {
+            evaluate(springs, particles, accumulation);
+            apply(springs, particles, accumulation);
+        }
+
+        void SpringForces::evaluate(const primatives::SpringTable &springs, primatives::ParticleSystem &particles,
+                                    Accumulation accumulation) {
+            if (accumulation != Accumulation::GatherCached || adjacency.mass_count() != particles.size()) return;
+
+            // Every spring once into the cache (springs are independent here)
+            const Streams streams(particles);
+            const primatives::Spring *data = springs.data();
+            Scalar *c_x = cache_x.data(), *c_y = cache_y.data(), *c_z = cache_z.data();
+            threading::pool().parallel_for(0, springs.size(), 4096, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    spring_force(data[i], streams, c_x[i], c_y[i], c_z[i]);
+                }
+            });
+        }
+
+        void SpringForces::apply(const primatives::SpringTable &springs, primatives::ParticleSystem &particles,
+                                 Accumulation accumulation) {
+            if (accumulation == Accumulation::ColouredScatter || adjacency.mass_count() != particles.size()) {
+                accumulate_spring_forces(springs, particles);
+                return;
+            }
+
+            const Streams streams(particles);
+            const primatives::Spring *data = springs.data();
+            const std::uint32_t *offsets = adjacency.offsets.data();
+            const std::uint32_t *entries = adjacency.entries.data();
+            threading::ThreadPool &pool = threading::pool();
+
+            if (accumulation == Accumulation::GatherCached) {
+                const Scalar *c_x = cache_x.data(), *c_y = cache_y.data(), *c_z = cache_z.data();
+                // Gathers stop at the constrained tail, whose forces would only be discarded
+                pool.parallel_for(0, particles.dynamic_count(), 1024, [&](std::size_t begin, std::size_t end) {
+                    for (std::size_t m = begin; m < end; ++m) {
+                        Accumulator f_x = 0, f_y = 0, f_z = 0;
+                        for (std::uint32_t e = offsets[m]; e < offsets[m + 1]; ++e) {
+                            std::uint32_t i = primatives::SpringAdjacency::spring_of(entries[e]);
+                            Accumulator sign = primatives::SpringAdjacency::is_mass_b(entries[e]) ? -1 : 1;
+                            f_x += sign * c_x[i];
+                            f_y += sign * c_y[i];
+                            f_z += sign * c_z[i];
+                        }
+                        streams.fx[m] += f_x;
+                        streams.fy[m] += f_y;
+                        streams.fz[m] += f_z;
+                    }
+                });
+            } else {
+                // Each endpoint evaluates its incident springs itself: twice the arithmetic, no scratch traffic
+                pool.parallel_for(0, particles.dynamic_count(), 1024, [&](std::size_t begin, std::size_t end) {
+                    for (std::size_t m = begin; m < end; ++m) {
+                        Accumulator f_x = 0, f_y = 0, f_z = 0;
+                        for (std::uint32_t e = offsets[m]; e < offsets[m + 1]; ++e) {
+                            Scalar s_x, s_y, s_z;
+                            spring_force(data[primatives::SpringAdjacency::spring_of(entries[e])], streams, s_x, s_y, s_z);
+                            Accumulator sign = primatives::SpringAdjacency::is_mass_b(entries[e]) ? -1 : 1;
+                            f_x += sign * s_x;
+                            f_y += sign * s_y;
+                            f_z += sign * s_z;
+                        }
+                        streams.fx[m] += f_x;
+                        streams.fy[m] += f_y;
+                        streams.fz[m] += f_z;
+                    }
+                });
+            }
+        }
+
+        void accumulate_spring_forces_reference(const primatives::SpringTable &springs,
+                                                primatives::ParticleSystem &particles) {
+            for (const primatives::Spring &spring: springs) {
+                particles.add_force(spring.mass_a, spring.force_a(particles));
+                particles.add_force(spring.mass_b, spring.force_b(particles));
+            }
+        }
+    } // namespace forces
+} // namespace simulation
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+#include "particle_system.hpp"
+#include "spring_adjacency.hpp"
+#include "spring_table.hpp"
+
+namespace simulation {
+    namespace forces {
+        //Instruction sets the batched spring kernel can be run with
+        enum class SimdLevel {
+            Scalar,
+            SSE2,   // 4 springs per iteration
+            AVX2    // 8 springs per iteration
+        };
+
+        //Best level supported by this CPU (detected once via CPUID)
+        SimdLevel best_simd_level();
+        bool simd_level_supported(SimdLevel level);
+        const char *simd_level_name(SimdLevel level);
+
+        //Adds the Hooke + damping force of every spring to both of its endpoints (+F on mass_a, -F on mass_b).
+        //Each spring is evaluated once; the default overload dispatches to best_simd_level() and, if the table
+        //is coloured, spreads each colour batch over threading::pool(). Batches are always evaluated one after
+        //another with SIMD groups aligned to the batch start, so the result is bit-identical for any thread count.
+        //
+        //The SIMD kernels use a hardware reciprocal square root refined by one Newton-Raphson step.
+        //Accumulated forces match the scalar kernel to within 5e-5 of the largest accumulated force
+        //(the error is dominated by 1 - rest_l / |d| cancelling for springs near rest length);
+        //endpoint scatters happen in spring order, exactly as in the scalar kernel.
+        void accumulate_spring_forces(const primatives::SpringTable &springs, primatives::ParticleSystem &particles);
+        void accumulate_spring_forces(const primatives::SpringTable &springs, primatives::ParticleSystem &particles,
+                                      SimdLevel level, bool parallel = false);
+
+        //How spring forces reach the particles
+        enum class Accumulation {
+            ColouredScatter,    // +F/-F scattered per colour batch (accumulate_spring_forces)
+            GatherCached,       // forces computed once per spring into a scratch array, then gathered per mass
+            GatherRecompute     // every mass re-evaluates its incident springs, no scratch array
+        };
+        const char *accumulation_name(Accumulation accumulation);
+
+        //Spring force evaluation with a selectable accumulation strategy. The gather strategies walk a CSR
+        //adjacency and let each thread own a disjoint range of masses, so they need no colouring or atomics
+        //and sum each mass's springs in the same order for any thread count.
+        class SpringForces {
+        public:
+            // Must be called again whenever the spring table changes
+            void build(const primatives::SpringTable &springs, std::size_t mass_count);
+            void accumulate(const primatives::SpringTable &springs, primatives::ParticleSystem &particles,
+                            Accumulation accumulation);
+
+            // accumulate() split in two phases for task graphs: evaluate() only reads positions and velocities
+            // (it fills the cache in GatherCached mode and is a no-op otherwise), apply() adds the forces to f.
+            void evaluate(const primatives::SpringTable &springs, primatives::ParticleSystem &particles,
+                          Accumulation accumulation);
+            void apply(const primatives::SpringTable &springs, primatives::ParticleSystem &particles,
+                       Accumulation accumulation);
+
+        private:
+            primatives::SpringAdjacency adjacency;
+            std::vector<primatives::Scalar> cache_x, cache_y, cache_z;
+        };
+
+        //Same result through Spring::force_a()/force_b(), i.e. two full evaluations per spring.
+        //Kept as the reference the batched kernels are checked and benchmarked against.
+        void accumulate_spring_forces_reference(const primatives::SpringTable &springs,
+                                                primatives::ParticleSystem &particles);
+    } // namespace forces
+} // namespace simulation
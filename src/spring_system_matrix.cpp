@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cstring>
+
+#include "spring_system_matrix.hpp"
+#include "thread_pool.hpp"
+
+#if defined(__SSE__) || defined(_M_X64)
+#define SIMULATION_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace simulation {
+    namespace integrators {
+        namespace {
+            constexpr std::size_t block_floats = 12;
+
+            std::uint32_t find_slot(const std::vector<std::uint32_t> &row_offsets, const std::vector<std::uint32_t> &columns,
+                                    std::size_t row, std::size_t column) {
+                auto first = columns.begin() + row_offsets[row];
+                auto last = columns.begin() + row_offsets[row + 1];
+                return (std::uint32_t) (std::lower_bound(first, last, (std::uint32_t) column) - columns.begin());
+            }
+        }
+
+        void SpringSystemMatrix::build(const primatives::SpringTable &springs, std::size_t mass_count) {
+            // Neighbour lists per row, diagonal included
+            std::vector<std::vector<std::uint32_t>> neighbours(mass_count);
+            for (std::size_t i = 0; i < mass_count; ++i) {
+                neighbours[i].push_back((std::uint32_t) i);
+            }
+            for (const primatives::Spring &spring: springs) {
+                neighbours[spring.mass_a].push_back(spring.mass_b);
+                neighbours[spring.mass_b].push_back(spring.mass_a);
+            }
+
+            row_offsets.assign(mass_count + 1, 0);
+            columns.clear();
+            for (std::size_t i = 0; i < mass_count; ++i) {
+                std::vector<std::uint32_t> &row = neighbours[i];
+                std::sort(row.begin(), row.end());
+                row.erase(std::unique(row.begin(), row.end()), row.end());
+                columns.insert(columns.end(), row.begin(), row.end());
+                row_offsets[i + 1] = (std::uint32_t) columns.size();
+            }
+
+            diagonal_slots.resize(mass_count);
+            for (std::size_t i = 0; i < mass_count; ++i) {
+                diagonal_slots[i] = find_slot(row_offsets, columns, i, i);
+            }
+            slots.resize(springs.size());
+            for (std::size_t s = 0; s < springs.size(); ++s) {
+                const std::uint32_t a = springs[s].mass_a, b = springs[s].mass_b;
+                slots[s] = {diagonal_slots[a], diagonal_slots[b],
+                            find_slot(row_offsets, columns, a, b), find_slot(row_offsets, columns, b, a)};
+            }
+
+            values.assign(columns.size() * block_floats, 0.f);
+        }
+
+        void SpringSystemMatrix::set_zero() {
+            std::memset(values.data(), 0, values.size() * sizeof(float));
+        }
+
+        void SpringSystemMatrix::set_block(std::uint32_t slot, const glm::mat3 &block) {
+            float *v = &values[slot * block_floats];
+            for (int c = 0; c < 3; ++c) {
+                v[4 * c + 0] = block[c].x;
+                v[4 * c + 1] = block[c].y;
+                v[4 * c + 2] = block[c].z;
+                v[4 * c + 3] = 0.f;
+            }
+        }
+
+        void SpringSystemMatrix::add_block(std::uint32_t slot, const glm::mat3 &block) {
+            float *v = &values[slot * block_floats];
+            for (int c = 0; c < 3; ++c) {
+                v[4 * c + 0] += block[c].x;
+                v[4 * c + 1] += block[c].y;
+                v[4 * c + 2] += block[c].z;
+            }
+        }
+
+        glm::mat3 SpringSystemMatrix::block(std::uint32_t slot) const {
+            const float *v = &values[slot * block_floats];
+            return glm::mat3(v[0], v[1], v[2], v[4], v[5], v[6], v[8], v[9], v[10]);
+        }
+
+        void SpringSystemMatrix::multiply_rows(const glm::vec4 *x, glm::vec4 *y, std::size_t begin, std::size_t end) const {
+            const float *v = values.data();
+            for (std::size_t i = begin; i < end; ++i) {
+#ifdef SIMULATION_SSE
+                __m128 sum = _mm_setzero_ps();
+                for (std::uint32_t k = row_offsets[i]; k < row_offsets[i + 1]; ++k) {
+                    const float *b = v + k * block_floats;
+                    const float *xc = &x[columns[k]].x;
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(b + 0), _mm_set1_ps(xc[0])));
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(b + 4), _mm_set1_ps(xc[1])));
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(b + 8), _mm_set1_ps(xc[2])));
+                }
+                _mm_storeu_ps(&y[i].x, sum);
+#else
+                glm::vec4 sum(0.f);
+                for (std::uint32_t k = row_offsets[i]; k < row_offsets[i + 1]; ++k) {
+                    const float *b = v + k * block_floats;
+                    const glm::vec4 &xc = x[columns[k]];
+                    sum += glm::vec4(b[0], b[1], b[2], b[3]) * xc.x
+                           + glm::vec4(b[4], b[5], b[6], b[7]) * xc.y
+                           + glm::vec4(b[8], b[9], b[10], b[11]) * xc.z;
+                }
+                y[i] = sum;
+#endif
+            }
+        }
+
+        void SpringSystemMatrix::multiply(const std::vector<glm::vec4> &x, std::vector<glm::vec4> &y) const {
+            threading::pool().parallel_for(0, rows(), 512, [&](std::size_t begin, std::size_t end) {
+                multiply_rows(x.data(), y.data(), begin, end);
+            });
+        }
+    } // namespace integrators
+} // namespace simulation
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "spring_table.hpp"
+
+namespace simulation {
+    namespace integrators {
+        //Symmetric 3x3 block sparse (BSR) matrix with the sparsity pattern of a spring network:
+        //one diagonal block per mass and one block per spring endpoint pair, both ways round.
+        //The pattern and the slot of every block a spring touches are computed once by build(),
+        //so refilling the numeric values each step is allocation-free and costs O(nnz).
+        //
+        //A block is stored as three columns padded to four floats, and vectors are glm::vec4 with w = 0,
+        //so a block-vector product is three aligned 4-wide multiply-adds.
+        class SpringSystemMatrix {
+        public:
+            struct SpringSlots {
+                std::uint32_t aa, bb, ab, ba;
+            };
+
+            // Must be called again whenever the spring table changes
+            void build(const primatives::SpringTable &springs, std::size_t mass_count);
+
+            std::size_t rows() const { return diagonal_slots.size(); }
+            std::size_t block_count() const { return columns.size(); }
+
+            std::uint32_t diagonal_slot(std::size_t row) const { return diagonal_slots[row]; }
+            const SpringSlots &spring_slots(std::size_t spring) const { return slots[spring]; }
+
+            void set_zero();
+            void set_block(std::uint32_t slot, const glm::mat3 &block);
+            void add_block(std::uint32_t slot, const glm::mat3 &block);
+            glm::mat3 block(std::uint32_t slot) const;
+
+            // y = A x, rows chunked over threading::pool()
+            void multiply(const std::vector<glm::vec4> &x, std::vector<glm::vec4> &y) const;
+
+        private:
+            void multiply_rows(const glm::vec4 *x, glm::vec4 *y, std::size_t begin, std::size_t end) const;
+
+            std::vector<std::uint32_t> row_offsets;
+            std::vector<std::uint32_t> columns;
+            std::vector<std::uint32_t> diagonal_slots;
+            std::vector<SpringSlots> slots;     // per spring, in table order
+            std::vector<float> values;          // 12 floats per block
+        };
+    } // namespace integrators
+} // namespace simulation
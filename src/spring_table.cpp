@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <utility>
+
+#include "spring_table.hpp"
+
+namespace simulation {
+    namespace primatives {
+        void SpringTable::sort_by_first_endpoint() {
+            for (Spring &spring: springs) {
+                if (spring.mass_b < spring.mass_a) {
+                    std::swap(spring.mass_a, spring.mass_b);
+                }
+            }
+            std::stable_sort(springs.begin(), springs.end(), [](const Spring &lhs, const Spring &rhs) {
+                return lhs.mass_a != rhs.mass_a ? lhs.mass_a < rhs.mass_a : lhs.mass_b < rhs.mass_b;
+            });
+            colour_offsets.clear();
+        }
+
+        void SpringTable::colour() {
+            std::size_t mass_count = 0;
+            for (const Spring &spring: springs) {
+                mass_count = std::max<std::size_t>(mass_count, std::max(spring.mass_a, spring.mass_b) + 1);
+            }
+
+            // used[w][m] bit k: mass m already has a spring of colour 64 * w + k
+            std::vector<std::vector<std::uint64_t>> used;
+            std::vector<std::uint32_t> spring_colour(springs.size());
+            std::vector<std::size_t> colour_sizes;
+            for (std::size_t i = 0; i < springs.size(); ++i) {
+                const std::uint32_t a = springs[i].mass_a, b = springs[i].mass_b;
+                std::size_t colour = 0;
+                for (std::size_t w = 0;; ++w) {
+                    if (w == used.size()) {
+                        used.emplace_back(mass_count, 0ull);
+                    }
+                    std::uint64_t free_bits = ~(used[w][a] | used[w][b]);
+                    if (free_bits != 0ull) {
+                        int bit = 0;
+                        while (!((free_bits >> bit) & 1ull)) ++bit;
+                        used[w][a] |= 1ull << bit;
+                        used[w][b] |= 1ull << bit;
+                        colour = 64 * w + bit;
+                        break;
+                    }
+                }
+                spring_colour[i] = (std::uint32_t) colour;
+                if (colour >= colour_sizes.size()) {
+                    colour_sizes.resize(colour + 1, 0);
+                }
+                colour_sizes[colour]++;
+            }
+
+            // Stable counting sort of the springs by colour
+            colour_offsets.assign(colour_sizes.size() + 1, 0);
+            for (std::size_t c = 0; c < colour_sizes.size(); ++c) {
+                colour_offsets[c + 1] = colour_offsets[c] + colour_sizes[c];
+            }
+            std::vector<std::size_t> cursor(colour_offsets.begin(), colour_offsets.end() - 1);
+            std::vector<Spring> sorted(springs.size());
+            for (std::size_t i = 0; i < springs.size(); ++i) {
+                sorted[cursor[spring_colour[i]]++] = springs[i];
+            }
+            springs.swap(sorted);
+        }
+    } // namespace primatives
+} // namespace simulation
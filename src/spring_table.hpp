@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "particle_system.hpp"
+
+namespace simulation {
+    namespace primatives {
+        //Spring connections used in all simulations.
+        //Endpoints are 32-bit indices into a ParticleSystem, so a spring is a 20 byte POD record
+        //that stays valid when the particle store is resized, copied or shared between threads.
+        struct Spring {
+            std::uint32_t mass_a = 0;
+            std::uint32_t mass_b = 0;
+            float rest_l = 0.f;
+            float k_s = 0.f;
+            float k_d = 0.f;
+
+            // Function to calculate spring length
+            float length(const ParticleSystem &particles) const {
+                return glm::length(particles.position(mass_b) - particles.position(mass_a));
+            }
+
+            // Function to calculate spring force (applied on mass a)
+            glm::vec3 force_a(const ParticleSystem &particles) const {
+                glm::vec3 delta_p = glm::vec3(particles.position(mass_b) - particles.position(mass_a));
+                float current_l = glm::length(delta_p);
+                float displacement = current_l - rest_l;
+                glm::vec3 force = k_s * displacement * glm::normalize(delta_p);
+                glm::vec3 damping_force = k_d * glm::vec3(particles.velocity(mass_a) - particles.velocity(mass_b));
+                return force - damping_force;
+            }
+
+            // Function to calculate spring force (applied on mass b)
+            glm::vec3 force_b(const ParticleSystem &particles) const {
+                return force_a(particles) * -1.f;
+            }
+        };
+
+        //Face connections used (can just be a render primative or a simulation primatives for the bonus)
+        struct Face {
+            std::uint32_t mass_a = 0;
+            std::uint32_t mass_b = 0;
+            std::uint32_t mass_c = 0;
+        };
+
+        //Flat, index-based spring topology of a model
+        class SpringTable {
+        public:
+            void reserve(std::size_t n) { springs.reserve(n); }
+            void clear() { springs.clear(); colour_offsets.clear(); }
+            std::size_t size() const { return springs.size(); }
+            bool empty() const { return springs.empty(); }
+
+            void add(std::size_t mass_a, std::size_t mass_b, float rest_l, float k_s, float k_d) {
+                springs.push_back({(std::uint32_t) mass_a, (std::uint32_t) mass_b, rest_l, k_s, k_d});
+                colour_offsets.clear();
+            }
+
+            Spring &operator[](std::size_t i) { return springs[i]; }
+            const Spring &operator[](std::size_t i) const { return springs[i]; }
+            const Spring *data() const { return springs.data(); }
+
+            std::vector<Spring>::iterator begin() { return springs.begin(); }
+            std::vector<Spring>::iterator end() { return springs.end(); }
+            std::vector<Spring>::const_iterator begin() const { return springs.begin(); }
+            std::vector<Spring>::const_iterator end() const { return springs.end(); }
+
+            //Reorders springs for locality: endpoints are swapped so that mass_a < mass_b (the force is
+            //antisymmetric, so this does not change the result) and springs are sorted by (mass_a, mass_b).
+            //Clears any colouring.
+            void sort_by_first_endpoint();
+
+            //Greedy edge colouring of the spring graph. Springs are regrouped (stably) into colour batches
+            //[colour_begin(c), colour_end(c)) in which no two springs share a mass, so a batch can be
+            //evaluated in parallel without atomics. The table order is the batch order, so serial and
+            //parallel evaluation perform the same additions in the same order.
+            void colour();
+            bool coloured() const { return !colour_offsets.empty(); }
+            std::size_t colour_count() const { return coloured() ? colour_offsets.size() - 1 : 0; }
+            std::size_t colour_begin(std::size_t c) const { return colour_offsets[c]; }
+            std::size_t colour_end(std::size_t c) const { return colour_offsets[c + 1]; }
+
+        private:
+            std::vector<Spring> springs;
+            std::vector<std::size_t> colour_offsets;
+        };
+    } // namespace primatives
+} // namespace simulation
@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include "step_controller.hpp"
+
+namespace simulation {
+    namespace integrators {
+        void StepController::reset() {
+            current_dt = 0.f;
+            time_owed = 0.0;
+            simulated = 0.0;
+            scheduled_steps = 0;
+            accepted = 0;
+            rejected = 0;
+            realtime_ratio = 0.0;
+        }
+
+        float StepController::quantise(float proposal) const {
+            float cap = std::min(dt_max, safety * stable_dt);
+            float dt = dt_max;
+            while (dt > proposal || dt > cap) {
+                if (dt * 0.5f < dt_min) return std::min(dt_min, dt_max);
+                dt *= 0.5f;
+            }
+            return dt;
+        }
+
+        float StepController::error_estimate(const primatives::ParticleSystem &particles, float h) const {
+            float max_dv_squared = 0.f;
+            for (std::size_t i = 0; i < particles.size(); ++i) {
+                float dx = float(particles.vx[i] - vx[i]), dy = float(particles.vy[i] - vy[i]), dz = float(particles.vz[i] - vz[i]);
+                float dv_squared = dx * dx + dy * dy + dz * dz;
+                // NaN compares false: make a blown-up step maximal so it is rejected
+                if (!(dv_squared <= max_dv_squared)) {
+                    max_dv_squared = std::isnan(dv_squared) ? std::numeric_limits<float>::infinity() : dv_squared;
+                }
+            }
+            return 0.5f * h * std::sqrt(max_dv_squared);
+        }
+
+        void StepController::save(const primatives::ParticleSystem &particles) {
+            px = particles.px;
+            py = particles.py;
+            pz = particles.pz;
+            vx = particles.vx;
+            vy = particles.vy;
+            vz = particles.vz;
+        }
+
+        void StepController::restore(primatives::ParticleSystem &particles) const {
+            particles.px = px;
+            particles.py = py;
+            particles.pz = pz;
+            particles.vx = vx;
+            particles.vy = vy;
+            particles.vz = vz;
+        }
+
+        void StepController::advance(primatives::ParticleSystem &particles, float duration, const StepFunction &step,
+                                     const RollbackFunction &rolled_back) {
+            schedule(duration);
+            while (attempt(particles, step, rolled_back)) {}
+        }
+
+        void StepController::schedule(float duration) {
+            if (time_owed <= 0.0) {
+                scheduled_at = std::chrono::steady_clock::now();
+                simulated = 0.0;
+                scheduled_steps = 0;
+            }
+            time_owed += duration;
+        }
+
+        bool StepController::attempt(primatives::ParticleSystem &particles, const StepFunction &step,
+                                     const RollbackFunction &rolled_back) {
+            if (time_owed <= 0.0) return false;
+            if (current_dt <= 0.f) current_dt = quantise(dt_min); // start cautiously, accepted steps double it
+            current_dt = quantise(current_dt);                      // limits may have changed since the last call
+
+            float h = current_dt;
+            save(particles);
+            step(h);
+            ++scheduled_steps;
+            float error = error_estimate(particles, h);
+            // Error ~ h^2, so h * sqrt(tolerance / error) would just meet the tolerance
+            float factor = error > 0.f ? safety * std::sqrt(tolerance / error) : 2.f;
+            if (error > tolerance && h > dt_min) {
+                restore(particles);
+                rolled_back();
+                ++rejected;
+                current_dt = quantise(h * std::min(factor, 0.5f));
+            } else {
+                ++accepted;
+                time_owed -= h;
+                simulated += h;
+                current_dt = quantise(h * std::min(std::max(factor, 0.2f), 2.f));
+            }
+            if (scheduled_steps >= max_steps) time_owed = 0.0; // drop the debt and run slower than requested instead
+
+            if (time_owed <= 0.0) {
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - scheduled_at;
+                realtime_ratio = simulated / std::max(elapsed.count(), 1e-9);
+            }
+            return true;
+        }
+    } // namespace integrators
+} // namespace simulation
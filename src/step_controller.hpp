@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "particle_system.hpp"
+
+namespace simulation {
+    namespace integrators {
+        //Adaptive time step control around any integrator. The local error of a step is estimated from the
+        //embedded Euler/trapezoid pair on the position update, h / 2 * max |v_new - v_old|, which needs no extra
+        //force evaluations. Steps above the tolerance are rolled back and retried at a smaller dt; accepted
+        //steps let dt grow again, capped by dt_max and by the stiffness bound of the integrator.
+        //dt is quantised to dt_max / 2^k so solvers that cache per-dt data (projective dynamics)
+        //only refactor when the level changes.
+        class StepController {
+        public:
+            using StepFunction = std::function<void(float dt)>;
+            using RollbackFunction = std::function<void()>;
+
+            // Forgets the step history and time debt, e.g. after a reset or a model change
+            void reset();
+
+            // Steps until `duration` more simulated seconds have passed (overshoot is carried over to the next call).
+            // step advances the simulation owning `particles`; rolled_back is called after a rejected step
+            // restored their positions and velocities.
+            void advance(primatives::ParticleSystem &particles, float duration, const StepFunction &step,
+                         const RollbackFunction &rolled_back);
+
+            //The same one step at a time, so a caller can let go of the simulation between steps
+            // Adds `duration` simulated seconds for attempt() to cover
+            void schedule(float duration);
+            // One step towards the scheduled time, rolled back (and retried smaller on the next call) if its error is
+            // too large; returns false, without stepping, once the scheduled time is covered
+            bool attempt(primatives::ParticleSystem &particles, const StepFunction &step, const RollbackFunction &rolled_back);
+            bool idle() const { return time_owed <= 0.0; }
+
+            //User limits
+            float dt_min = 1.e-5f, dt_max = 0.01f;
+            float tolerance = 1.e-3f;                                    // position error per step
+            float stable_dt = std::numeric_limits<float>::infinity();    // stiffness bound, set by the caller
+            float safety = 0.9f;
+            int max_steps = 4096;                                        // per schedule(), the remaining time is dropped
+
+            //Statistics
+            float dt() const { return current_dt; }
+            int accepted_steps() const { return accepted; }
+            int rejected_steps() const { return rejected; }
+            double sim_seconds_per_second() const { return realtime_ratio; }   // over the last scheduled time
+
+        private:
+            float quantise(float proposal) const;
+            float error_estimate(const primatives::ParticleSystem &particles, float h) const;
+            void save(const primatives::ParticleSystem &particles);
+            void restore(primatives::ParticleSystem &particles) const;
+
+            std::vector<primatives::Scalar> px, py, pz, vx, vy, vz; // state before the step in flight
+            float current_dt = 0.f;
+            double time_owed = 0.0;
+            double simulated = 0.0;  // of the scheduled time so far
+            int scheduled_steps = 0; // attempts on the scheduled time so far
+            std::chrono::steady_clock::time_point scheduled_at;
+            int accepted = 0, rejected = 0;
+            double realtime_ratio = 0.0;
+        };
+    } // namespace integrators
+} // namespace simulation
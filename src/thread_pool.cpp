@@ -0,0 +1,223 @@
+#include <algorithm>
+
+#include "thread_pool.hpp"
+
+namespace simulation {
+    namespace threading {
+        namespace {
+            // Queue owned by the current thread; threads outside the pool share slot 0
+            thread_local unsigned current_slot = 0;
+        }
+
+        //////////////////////////////////////////////////
+        ////               ThreadPool                 ////
+        //////////////////////////////////////////////////
+
+        ThreadPool::ThreadPool(unsigned thread_count) {
+            start(std::max(thread_count, 1u) - 1);
+        }
+
+        ThreadPool::~ThreadPool() {
+            stop();
+        }
+
+        void ThreadPool::resize(unsigned thread_count) {
+            thread_count = std::max(thread_count, 1u);
+            if (thread_count == size()) return;
+            stop();
+            start(thread_count - 1);
+        }
+
+        void ThreadPool::start(unsigned worker_count) {
+            stopping = false;
+            queues.clear();
+            for (unsigned slot = 0; slot <= worker_count; ++slot) {
+                queues.push_back(std::make_unique<Queue>());
+            }
+            workers.reserve(worker_count);
+            for (unsigned slot = 1; slot <= worker_count; ++slot) {
+                workers.emplace_back([this, slot] { worker_loop(slot); });
+            }
+        }
+
+        void ThreadPool::stop() {
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+                stopping = true;
+            }
+            sleep.notify_all();
+            for (std::thread &worker: workers) {
+                worker.join();
+            }
+            workers.clear();
+        }
+
+        void ThreadPool::push(const Task &task) {
+            Queue &queue = *queues[std::min<std::size_t>(current_slot, queues.size() - 1)];
+            queued.fetch_add(1); // before the task becomes visible, so a thief can never drive it below zero
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.tasks.push_back(task);
+            }
+            {
+                std::lock_guard<std::mutex> lock(sleep_mutex);
+            }
+            sleep.notify_one();
+        }
+
+        bool ThreadPool::try_pop(Task &task) {
+            const std::size_t count = queues.size();
+            const std::size_t own = std::min<std::size_t>(current_slot, count - 1);
+            {
+                Queue &queue = *queues[own];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (!queue.tasks.empty()) {
+                    task = queue.tasks.back();
+                    queue.tasks.pop_back();
+                    queued.fetch_sub(1);
+                    return true;
+                }
+            }
+            for (std::size_t k = 1; k < count; ++k) {
+                Queue &victim = *queues[(own + k) % count];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.tasks.empty()) {
+                    task = victim.tasks.front();
+                    victim.tasks.pop_front();
+                    queued.fetch_sub(1);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void ThreadPool::execute(const Task &task) {
+            (*task.fn)(task.begin, task.end);
+            if (task.pending->fetch_sub(1) == 1 && task.graph != nullptr) {
+                task.graph->finish(task.node);
+            }
+        }
+
+        void ThreadPool::help_until_done(const std::atomic<std::size_t> &pending) {
+            Task task;
+            while (pending.load() != 0) {
+                if (try_pop(task)) {
+                    execute(task);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        void ThreadPool::worker_loop(unsigned slot) {
+            current_slot = slot;
+            Task task;
+            while (true) {
+                if (try_pop(task)) {
+                    execute(task);
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                sleep.wait(lock, [&] { return stopping || queued.load() > 0; });
+                if (stopping) return;
+            }
+        }
+
+        void ThreadPool::parallel_for(std::size_t begin, std::size_t end, std::size_t grain, const RangeFunction &fn) {
+            if (begin >= end) return;
+            grain = std::max<std::size_t>(grain, 1);
+            std::size_t chunks = (end - begin + grain - 1) / grain;
+            if (workers.empty() || chunks == 1) {
+                for (std::size_t chunk_begin = begin; chunk_begin < end; chunk_begin += grain) {
+                    fn(chunk_begin, std::min(chunk_begin + grain, end));
+                }
+                return;
+            }
+
+            std::atomic<std::size_t> pending(chunks);
+            // Pushed last-to-first so the owner pops chunks in order while thieves take the far end
+            for (std::size_t chunk = chunks; chunk-- > 0;) {
+                Task task;
+                task.fn = &fn;
+                task.begin = begin + chunk * grain;
+                task.end = std::min(task.begin + grain, end);
+                task.pending = &pending;
+                push(task);
+            }
+            help_until_done(pending);
+        }
+
+        //////////////////////////////////////////////////
+        ////                TaskGraph                 ////
+        //////////////////////////////////////////////////
+
+        TaskGraph::NodeId TaskGraph::add(std::function<void()> fn, const std::vector<NodeId> &after) {
+            return add_parallel_for(0, 1, 1, [fn = std::move(fn)](std::size_t, std::size_t) { fn(); }, after);
+        }
+
+        TaskGraph::NodeId TaskGraph::add_parallel_for(std::size_t begin, std::size_t end, std::size_t grain,
+                                                      RangeFunction fn, const std::vector<NodeId> &after) {
+            NodeId id = nodes.size();
+            nodes.emplace_back();
+            Node &node = nodes.back();
+            node.fn = std::move(fn);
+            node.begin = begin;
+            node.end = end;
+            node.grain = std::max<std::size_t>(grain, 1);
+            node.dependency_count = after.size();
+            for (NodeId dependency: after) {
+                nodes[dependency].successors.push_back(id);
+            }
+            return id;
+        }
+
+        void TaskGraph::release(NodeId id) {
+            Node &node = nodes[id];
+            std::size_t chunks = node.end > node.begin ? (node.end - node.begin + node.grain - 1) / node.grain : 0;
+            if (chunks == 0) {
+                finish(id);
+                return;
+            }
+            node.pending_chunks.store(chunks);
+            for (std::size_t chunk = chunks; chunk-- > 0;) {
+                ThreadPool::Task task;
+                task.fn = &node.fn;
+                task.begin = node.begin + chunk * node.grain;
+                task.end = std::min(task.begin + node.grain, node.end);
+                task.pending = &node.pending_chunks;
+                task.graph = this;
+                task.node = id;
+                pool->push(task);
+            }
+        }
+
+        void TaskGraph::finish(NodeId id) {
+            for (NodeId successor: nodes[id].successors) {
+                if (nodes[successor].waiting_on.fetch_sub(1) == 1) {
+                    release(successor);
+                }
+            }
+            unfinished.fetch_sub(1);
+        }
+
+        void TaskGraph::run(ThreadPool &thread_pool) {
+            if (nodes.empty()) return;
+            pool = &thread_pool;
+            unfinished.store(nodes.size());
+            for (Node &node: nodes) {
+                node.waiting_on.store(node.dependency_count);
+            }
+            for (NodeId id = 0; id < nodes.size(); ++id) {
+                if (nodes[id].dependency_count == 0) {
+                    release(id);
+                }
+            }
+            pool->help_until_done(unfinished);
+        }
+
+        ThreadPool &pool() {
+            static ThreadPool shared_pool;
+            return shared_pool;
+        }
+    } // namespace threading
+} // namespace simulation
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace simulation {
+    namespace threading {
+        class TaskGraph;
+
+        //Persistent work-stealing pool. Every thread (the calling thread is slot 0) owns a deque of range tasks:
+        //it pops its own newest work and steals the oldest work of the others when it runs dry.
+        //Workers are created once and sleep while there is nothing queued.
+        class ThreadPool {
+        public:
+            using RangeFunction = std::function<void(std::size_t begin, std::size_t end)>;
+
+            explicit ThreadPool(unsigned thread_count = std::thread::hardware_concurrency());
+            ~ThreadPool();
+
+            ThreadPool(const ThreadPool &) = delete;
+            ThreadPool &operator=(const ThreadPool &) = delete;
+
+            // Number of threads taking part in a job, including the calling thread
+            unsigned size() const { return (unsigned) workers.size() + 1; }
+            // Must not be called while work is in flight
+            void resize(unsigned thread_count);
+
+            // Calls fn on consecutive chunks of [begin, end), each at most `grain` long and starting at
+            // begin + k * grain, and blocks until all chunks are done. The calling thread executes queued
+            // work while it waits, so parallel_for may be nested inside tasks.
+            void parallel_for(std::size_t begin, std::size_t end, std::size_t grain, const RangeFunction &fn);
+
+        private:
+            friend class TaskGraph;
+
+            struct Task {
+                const RangeFunction *fn = nullptr;
+                std::size_t begin = 0, end = 0;
+                std::atomic<std::size_t> *pending = nullptr; // decremented once the task ran
+                TaskGraph *graph = nullptr;                  // set for graph nodes: notified when pending hits 0
+                std::size_t node = 0;
+            };
+
+            struct Queue {
+                std::mutex mutex;
+                std::deque<Task> tasks;
+            };
+
+            void start(unsigned worker_count);
+            void stop();
+            void worker_loop(unsigned slot);
+
+            void push(const Task &task);
+            bool try_pop(Task &task);
+            void execute(const Task &task);
+            void help_until_done(const std::atomic<std::size_t> &pending);
+
+            std::vector<std::thread> workers;
+            std::vector<std::unique_ptr<Queue>> queues; // one per slot
+
+            std::atomic<std::size_t> queued{0};
+            std::mutex sleep_mutex;
+            std::condition_variable sleep;
+            bool stopping = false;
+        };
+
+        //Reusable graph of (possibly chunked) tasks with dependencies.
+        //Nodes whose dependencies are done run concurrently; a chunked node is spread over the pool.
+        class TaskGraph {
+        public:
+            using NodeId = std::size_t;
+            using RangeFunction = ThreadPool::RangeFunction;
+
+            NodeId add(std::function<void()> fn, const std::vector<NodeId> &after = {});
+            NodeId add_parallel_for(std::size_t begin, std::size_t end, std::size_t grain, RangeFunction fn,
+                                    const std::vector<NodeId> &after = {});
+
+            // Runs every node once, respecting dependencies, and blocks until all are done
+            void run(ThreadPool &pool);
+
+        private:
+            friend class ThreadPool;
+
+            struct Node {
+                RangeFunction fn;
+                std::size_t begin = 0, end = 1, grain = 1;
+                std::vector<NodeId> successors;
+                std::size_t dependency_count = 0;
+                std::atomic<std::size_t> waiting_on{0};
+                std::atomic<std::size_t> pending_chunks{0};
+            };
+
+            void release(NodeId node);
+            void finish(NodeId node);
+
+            std::deque<Node> nodes; // stable addresses
+            std::atomic<std::size_t> unfinished{0};
+            ThreadPool *pool = nullptr;
+        };
+
+        //Pool shared by all models
+        ThreadPool &pool();
+    } // namespace threading
+} // namespace simulation
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+
+namespace simulation {
+    namespace threading {
+        //Lock-free single-writer / single-reader hand-off of the latest complete value.
+        //The writer fills back() and publishes it; the reader picks up the most recent published slot with
+        //update() and reads front(). Neither side ever waits, and the reader never sees a half-written value
+        //(values published in between are skipped).
+        template<typename T>
+        class TripleBuffer {
+        public:
+            // Writer side
+            T &back() { return slots[back_index]; }
+            void publish() {
+                back_index = middle.exchange(back_index | fresh, std::memory_order_acq_rel) & index_mask;
+            }
+
+            // Reader side: swaps in the latest published value, returns false if nothing new was published
+            bool update() {
+                if ((middle.load(std::memory_order_relaxed) & fresh) == 0) return false;
+                front_index = middle.exchange(front_index, std::memory_order_acq_rel) & index_mask;
+                return true;
+            }
+            const T &front() const { return slots[front_index]; }
+
+        private:
+            static constexpr unsigned index_mask = 3u;
+            static constexpr unsigned fresh = 4u; // set on the middle index while it holds an unread value
+
+            T slots[3];
+            unsigned back_index = 0, front_index = 1;   // owned by the writer / the reader
+            std::atomic<unsigned> middle{2};
+        };
+    } // namespace threading
+} // namespace simulation
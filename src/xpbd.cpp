@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <cmath>
+
+#include "xpbd.hpp"
+
+namespace simulation {
+    namespace integrators {
+        namespace {
+            using Vec3 = primatives::ParticleSystem::Vec3;
+
+            //Multiplier update of one spring constraint with compliance and damping; n is the unit direction a -> b.
+            //w holds the inverse masses with fixed particles at 0.
+            inline bool constraint_step(const primatives::Spring &spring, const primatives::ParticleSystem &particles,
+                                        const std::vector<float> &w, const std::vector<Vec3> &previous,
+                                        float lambda, float inv_h, float &delta_lambda, glm::vec3 &n) {
+                const std::uint32_t a = spring.mass_a, b = spring.mass_b;
+                float w_sum = w[a] + w[b];
+                if (w_sum == 0.f || spring.k_s <= 0.f) return false;
+
+                Vec3 x_a = particles.position(a), x_b = particles.position(b);
+                glm::vec3 d = x_b - x_a;
+                float l = glm::length(d);
+                if (l == 0.f) return false;
+                n = d / l;
+
+                float inv_k = 1.f / spring.k_s;
+                float alpha = inv_k * inv_h * inv_h;            // compliance / h^2
+                float gamma = spring.k_d * inv_k * inv_h;       // alpha * (h^2 k_d) / h
+                float c = l - spring.rest_l;
+                float c_dot = glm::dot(n, glm::vec3((x_b - previous[b]) - (x_a - previous[a])));
+                delta_lambda = (-c - alpha * lambda - gamma * c_dot) / ((1.f + gamma) * w_sum + alpha);
+                return true;
+            }
+        }
+
+        const char *constraint_solver_name(ConstraintSolver solver) {
+            switch (solver) {
+                case ConstraintSolver::Jacobi:
+                    return "Jacobi";
+                default:
+                    return "Gauss-Seidel (coloured)";
+            }
+        }
+
+        void XPBD::build(const primatives::SpringTable &springs, std::size_t mass_count) {
+            adjacency.build(springs, mass_count);
+            lambda.assign(springs.size(), 0.f);
+            corrections.assign(springs.size(), glm::vec3(0.f));
+            previous.assign(mass_count, Vec3(0));
+            weights.assign(mass_count, 0.f);
+        }
+
+        void XPBD::solve_gauss_seidel(const primatives::SpringTable &springs, primatives::ParticleSystem &particles,
+                                      float inv_h, std::size_t begin, std::size_t end) {
+            for (std::size_t s = begin; s < end; ++s) {
+                const primatives::Spring &spring = springs[s];
+                float delta_lambda;
+                glm::vec3 n;
+                if (!constraint_step(spring, particles, weights, previous, lambda[s], inv_h, delta_lambda, n)) continue;
+                lambda[s] += delta_lambda;
+                particles.set_position(spring.mass_a, particles.position(spring.mass_a) - Vec3(weights[spring.mass_a] * delta_lambda * n));
+                particles.set_position(spring.mass_b, particles.position(spring.mass_b) + Vec3(weights[spring.mass_b] * delta_lambda * n));
+            }
+        }
+
+        void XPBD::solve_jacobi(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles,
+                                float inv_h, std::size_t begin, std::size_t end) {
+            for (std::size_t s = begin; s < end; ++s) {
+                float delta_lambda;
+                glm::vec3 n;
+                if (!constraint_step(springs[s], particles, weights, previous, lambda[s], inv_h, delta_lambda, n)) {
+                    corrections[s] = glm::vec3(0.f);
+                    continue;
+                }
+                // Scaled per constraint rather than averaged per mass, so lambda tracks the applied correction
+                const primatives::Spring &spring = springs[s];
+                std::uint32_t shared = std::max(adjacency.row_end(spring.mass_a) - adjacency.row_begin(spring.mass_a),
+                                                adjacency.row_end(spring.mass_b) - adjacency.row_begin(spring.mass_b));
+                delta_lambda *= jacobi_relaxation / (float) shared;
+                lambda[s] += delta_lambda;
+                corrections[s] = delta_lambda * n;
+            }
+        }
+
+        void XPBD::apply_jacobi(primatives::ParticleSystem &particles, std::size_t begin, std::size_t end) {
+            // Sum of the corrections of all incident constraints, gathered per mass
+            for (std::size_t i = begin; i < end; ++i) {
+                if (weights[i] == 0.f) continue;
+                glm::vec3 sum(0.f);
+                for (std::uint32_t k = adjacency.row_begin(i); k < adjacency.row_end(i); ++k) {
+                    std::uint32_t entry = adjacency.entries[k];
+                    const glm::vec3 &correction = corrections[primatives::SpringAdjacency::spring_of(entry)];
+                    sum += primatives::SpringAdjacency::is_mass_b(entry) ? correction : -correction;
+                }
+                particles.set_position(i, particles.position(i) + Vec3(weights[i] * sum));
+            }
+        }
+
+        void XPBD::step(const primatives::SpringTable &springs, primatives::ParticleSystem &particles, float dt,
+                        const threading::ThreadPool::RangeFunction &project) {
+            threading::ThreadPool &pool = threading::pool();
+            if (previous.size() != particles.size() || lambda.size() != springs.size()) build(springs, particles.size());
+            const float h = dt / (float) std::max(substeps, 1), inv_h = 1.f / h;
+            const primatives::Scalar step_h = h;
+            const std::size_t mass_grain = 2048, spring_grain = 2048;
+
+            for (std::size_t i = 0; i < particles.size(); ++i) {
+                weights[i] = particles.fixed(i) ? 0.f : (float) particles.inv_mass[i];
+            }
+
+            for (int substep = 0; substep < std::max(substeps, 1); ++substep) {
+                // Predict
+                pool.parallel_for(0, particles.size(), mass_grain, [&](std::size_t begin, std::size_t end) {
+                    for (std::size_t i = begin; i < end; ++i) {
+                        previous[i] = particles.position(i);
+                    }
+                    for (std::size_t i = begin; i < std::min(end, particles.dynamic_count()); ++i) {
+                        particles.set_velocity(i, particles.velocity(i) + step_h * particles.inv_mass[i] * Vec3(particles.force(i)));
+                        particles.set_position(i, previous[i] + step_h * particles.velocity(i));
+                    }
+                });
+                std::fill(lambda.begin(), lambda.end(), 0.f);
+
+                // Constraint iterations
+                for (int iteration = 0; iteration < iterations; ++iteration) {
+                    if (solver == ConstraintSolver::Jacobi) {
+                        pool.parallel_for(0, springs.size(), spring_grain, [&](std::size_t begin, std::size_t end) {
+                            solve_jacobi(springs, particles, inv_h, begin, end);
+                        });
+                        pool.parallel_for(0, particles.size(), mass_grain, [&](std::size_t begin, std::size_t end) {
+                            apply_jacobi(particles, begin, end);
+                        });
+                    } else if (springs.coloured()) {
+                        // No two springs of a batch share a mass, so a batch can be solved in parallel
+                        for (std::size_t c = 0; c < springs.colour_count(); ++c) {
+                            pool.parallel_for(springs.colour_begin(c), springs.colour_end(c), spring_grain,
+                                              [&](std::size_t begin, std::size_t end) {
+                                                  solve_gauss_seidel(springs, particles, inv_h, begin, end);
+                                              });
+                        }
+                    } else {
+                        solve_gauss_seidel(springs, particles, inv_h, 0, springs.size());
+                    }
+                }
+
+                if (project) {
+                    pool.parallel_for(0, particles.size(), mass_grain, project);
+                }
+
+                // Velocities from the position change
+                pool.parallel_for(0, particles.dynamic_count(), mass_grain, [&](std::size_t begin, std::size_t end) {
+                    for (std::size_t i = begin; i < end; ++i) {
+                        particles.set_velocity(i, (particles.position(i) - previous[i]) / step_h);
+                    }
+                });
+            }
+        }
+    } // namespace integrators
+} // namespace simulation
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "particle_system.hpp"
+#include "spring_adjacency.hpp"
+#include "spring_table.hpp"
+#include "thread_pool.hpp"
+
+namespace simulation {
+    namespace integrators {
+        //How XPBD sweeps over the constraints
+        enum class ConstraintSolver {
+            ColouredGaussSeidel,    // in place, one colour batch after another (batches in parallel)
+            Jacobi                  // all constraints from the same positions, each scaled by 1 / (constraints per endpoint)
+        };
+        const char *constraint_solver_name(ConstraintSolver solver);
+
+        //Extended Position Based Dynamics (Macklin et al. 2016) with small steps: every spring is a distance
+        //constraint C = |x_b - x_a| - rest_l with compliance 1 / k_s and damping k_d, and a step is split into
+        //sub-steps that each predict positions from the external forces, run a few constraint iterations
+        //and derive velocities from the position change. Both solvers are deterministic for any thread count.
+        class XPBD {
+        public:
+            // Must be called again whenever the spring table changes
+            void build(const primatives::SpringTable &springs, std::size_t mass_count);
+
+            // particles.f must hold the external forces only; they are held constant over the sub-steps.
+            // project, if given, runs on chunks of masses after each sub-step's constraint iterations
+            // (e.g. collision projection), before velocities are updated.
+            void step(const primatives::SpringTable &springs, primatives::ParticleSystem &particles, float dt,
+                      const threading::ThreadPool::RangeFunction &project = nullptr);
+
+            ConstraintSolver solver = ConstraintSolver::ColouredGaussSeidel;
+            int substeps = 10;
+            int iterations = 1;
+            float jacobi_relaxation = 2.f;  // over-relaxation of the scaled Jacobi corrections
+
+        private:
+            void solve_gauss_seidel(const primatives::SpringTable &springs, primatives::ParticleSystem &particles,
+                                    float inv_h, std::size_t begin, std::size_t end);
+            void solve_jacobi(const primatives::SpringTable &springs, const primatives::ParticleSystem &particles,
+                              float inv_h, std::size_t begin, std::size_t end);
+            void apply_jacobi(primatives::ParticleSystem &particles, std::size_t begin, std::size_t end);
+
+            primatives::SpringAdjacency adjacency;
+            std::vector<float> lambda;                  // per spring
+            std::vector<glm::vec3> corrections;         // per spring, Jacobi only: dlambda * n (mass_b moves by +w_b times it, mass_a by -w_a)
+            std::vector<primatives::ParticleSystem::Vec3> previous; // per mass, position at the start of the sub-step
+            std::vector<float> weights;                 // per mass, inverse mass or 0 if fixed
+        };
+    } // namespace integrators
+} // namespace simulation